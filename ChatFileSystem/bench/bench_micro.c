@@ -0,0 +1,325 @@
+// bench_micro.c
+// 컴포넌트 단위 마이크로 벤치마크 (make bench-micro)
+//  - 서버 오브젝트(server_main.o 제외)와 클라이언트 채팅 히스토리를 그대로 링크해서 측정
+//  - 결과: stderr 에 표, stdout 에 JSON 한 줄씩 (커밋 간 비교용)
+//  - 할당 횟수는 링커 --wrap 으로 센 malloc/calloc/realloc/posix_memalign 호출 수
+//    (libc 내부 할당, 예: fopen 은 포함되지 않음)
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include "protocol.h"
+#include "../server/server_auth.h"
+#include "../server/server_conn.h"
+#include "../server/server_io.h"
+
+// 클라이언트 채팅 모듈을 같이 넣고 서버 쪽과 겹치는 이름만 바꿈 (push_history 는 static)
+#define print_chat            client_print_chat
+#define print_chat_msg        client_print_chat_msg
+#define redraw_chat_window    client_redraw_chat_window
+#define send_chat_message     client_send_chat_message
+#define handle_chat_message   client_handle_chat_message
+#define handle_direct_message client_handle_direct_message
+#include "../client/client_chat.c"
+#undef handle_chat_message
+
+#define MAX_CLIENTS   10
+#define TARGET_SEC    0.3      // 벤치마크 하나당 측정 시간
+#define LOG_THREADS   4
+
+extern int  presence_text_page(const char *after, char *buf, size_t bufsize);
+extern void broadcast(int sender_fd, Message *msg, int max_clients);
+extern void server_log(const char *fmt, ...);
+
+// server_main.c 대신 제공하는 심볼
+int client_sockets[MAX_CLIENTS] = {0};
+int sock = -1;
+char username[MAX_NAME] = "bench";
+WINDOW *win_chat = NULL;
+int g_headless = 0;
+
+static long dispatched = 0;
+
+void handle_client_message(int idx, Message *msg) {
+    (void)idx;
+    (void)msg;
+    dispatched++;
+}
+
+void finish_login(int idx, unsigned gen, int fd, const char *id, bool ok) {
+    (void)idx; (void)gen; (void)fd; (void)id; (void)ok;
+}
+
+
+/* ===================== 할당 횟수 (--wrap) ===================== */
+
+static unsigned long alloc_count = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+int   __real_posix_memalign(void **p, size_t align, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+int __wrap_posix_memalign(void **p, size_t align, size_t size) {
+    __atomic_fetch_add(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __real_posix_memalign(p, align, size);
+}
+
+
+/* ===================== 측정 틀 ===================== */
+
+typedef void (*bench_fn)(long iters);
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * iters 를 늘려가며 TARGET_SEC 근처가 될 때까지 반복 → ns/op, 할당/op 출력
+ */
+static void run_bench(const char *name, bench_fn fn) {
+    long iters = 1;
+    double elapsed = 0;
+    unsigned long allocs = 0;
+
+    fn(1);      // 워밍업 (풀/캐시 채우기)
+
+    while (1) {
+        unsigned long a0 = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+        double t0 = now_sec();
+        fn(iters);
+        elapsed = now_sec() - t0;
+        allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - a0;
+
+        if (elapsed >= TARGET_SEC || iters >= (1L << 30)) break;
+
+        // 목표 시간에 맞춰 다음 반복 횟수 추정 (한 번에 최대 100배)
+        long next = elapsed > 0 ? (long)(iters * (TARGET_SEC * 1.2 / elapsed)) : iters * 100;
+        if (next > iters * 100) next = iters * 100;
+        if (next <= iters) next = iters * 2;
+        iters = next;
+    }
+
+    double ns = elapsed * 1e9 / iters;
+    double apo = (double)allocs / iters;
+
+    fprintf(stderr, "%-28s %12ld iters %12.1f ns/op %8.3f allocs/op\n", name, iters, ns, apo);
+    printf("{\"bench\":\"%s\",\"iters\":%ld,\"ns_per_op\":%.2f,\"allocs_per_op\":%.4f}\n",
+           name, iters, ns, apo);
+    fflush(stdout);
+}
+
+
+/* ===================== 준비 ===================== */
+
+// 가짜 접속자 10명 (fd 는 실제로 쓰지 않음, flush 하지 않으므로)
+#define FAKE_FD_BASE 900
+
+static void setup_fake_clients(void) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        char name[MAX_NAME];
+        snprintf(name, sizeof(name), "user%d", i);
+
+        client_sockets[i] = FAKE_FD_BASE + i;
+        set_client_index(FAKE_FD_BASE + i, i);
+        conn_open(i);
+        register_user(FAKE_FD_BASE + i, name);
+    }
+}
+
+static void reset_queues(void) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (client_sockets[i] > 0) conn_reset(i);
+    }
+}
+
+
+/* ===================== 벤치마크 ===================== */
+
+static void bench_frame_encode(long iters) {
+    for (long k = 0; k < iters; k++) {
+        Message msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = MSG_CHAT;
+        strcpy(msg.sender, "user1");
+        snprintf(msg.data, sizeof(msg.data), "hello %ld", k);
+
+        OutFrame *f = frame_new(&msg);
+        frame_release(f);
+    }
+}
+
+// socketpair 에 프레임을 쓰고 conn_read → io_complete 로 잘라서 핸들러까지 (프레임당)
+static int decode_pair[2] = { -1, -1 };
+
+static void bench_frame_decode(long iters) {
+    Message frames[8];
+    memset(frames, 0, sizeof(frames));
+    for (int k = 0; k < 8; k++) {
+        frames[k].type = MSG_CHAT;
+        strcpy(frames[k].sender, "user0");
+        strcpy(frames[k].data, "ping");
+    }
+
+    int fd = client_sockets[0];
+    client_sockets[0] = decode_pair[0];
+    set_client_index(decode_pair[0], 0);
+
+    long done = 0;
+    while (done < iters) {
+        int n = iters - done < 8 ? (int)(iters - done) : 8;
+        if (write(decode_pair[1], frames, sizeof(Message) * n) < 0) break;
+
+        long before = dispatched;
+        while (dispatched - before < n) {
+            conn_read(0);
+            io_complete();
+        }
+        done += n;
+    }
+
+    set_client_index(decode_pair[0], -1);
+    client_sockets[0] = fd;
+    set_client_index(fd, 0);
+}
+
+static void bench_user_list_page(long iters) {
+    char buf[1024];
+    for (long k = 0; k < iters; k++) {
+        presence_text_page("", buf, sizeof(buf));
+    }
+}
+
+static volatile long sink;
+
+static void bench_lookup_fd(long iters) {
+    long acc = 0;
+    for (long k = 0; k < iters; k++) {
+        acc += get_client_index(FAKE_FD_BASE + (int)(k % MAX_CLIENTS));
+    }
+    sink = acc;
+}
+
+static void bench_lookup_name(long iters) {
+    static const char *names[MAX_CLIENTS] = {
+        "user0", "user1", "user2", "user3", "user4",
+        "user5", "user6", "user7", "user8", "user9"
+    };
+    long acc = 0;
+    for (long k = 0; k < iters; k++) {
+        acc += find_user_index(names[k % MAX_CLIENTS]);
+    }
+    sink = acc;
+}
+
+static void bench_get_username(long iters) {
+    long acc = 0;
+    for (long k = 0; k < iters; k++) {
+        acc += get_username(FAKE_FD_BASE + (int)(k % MAX_CLIENTS))[0];
+    }
+    sink = acc;
+}
+
+static long log_per_thread;
+
+static void* log_thread(void *arg) {
+    long id = (long)arg;
+    for (long k = 0; k < log_per_thread; k++) {
+        server_log("bench thread %ld line %ld", id, k);
+    }
+    return NULL;
+}
+
+// LOG_THREADS 개 스레드가 동시에 기록 (ns/op = 전체 시간 / 전체 줄 수)
+static void bench_server_log(long iters) {
+    pthread_t tids[LOG_THREADS];
+    log_per_thread = (iters + LOG_THREADS - 1) / LOG_THREADS;
+
+    for (long t = 0; t < LOG_THREADS; t++) {
+        pthread_create(&tids[t], NULL, log_thread, (void *)t);
+    }
+    for (int t = 0; t < LOG_THREADS; t++) {
+        pthread_join(tids[t], NULL);
+    }
+}
+
+// 접속자 10명에게 broadcast (메모리 큐까지만, 32번마다 큐 비움)
+static void bench_broadcast(long iters) {
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_CHAT;
+    strcpy(msg.sender, "user0");
+    strcpy(msg.data, "fan-out");
+
+    for (long k = 0; k < iters; k++) {
+        broadcast(-1, &msg, MAX_CLIENTS);
+        if ((k & 31) == 31) reset_queues();
+    }
+    reset_queues();
+}
+
+// 히스토리가 가득 찬 상태에서 한 줄 추가
+static void bench_push_history(long iters) {
+    while (chat_history_count < MAX_HISTORY) push_history("warmup line", 0);
+
+    for (long k = 0; k < iters; k++) {
+        push_history("[user1]: hello there", (int)(k & 1));
+    }
+}
+
+
+int main(void) {
+    // server_log 는 ./server/server_log.txt 에 쓰므로 임시 디렉토리에서 실행
+    char dir[] = "/tmp/bench_micro.XXXXXX";
+    if (!mkdtemp(dir) || chdir(dir) < 0) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    io_engine_init(IO_ENGINE_POSIX);
+    setup_fake_clients();
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, decode_pair) < 0) {
+        perror("socketpair");
+        return 1;
+    }
+
+    run_bench("frame_encode", bench_frame_encode);
+    run_bench("frame_decode_socketpair", bench_frame_decode);
+    run_bench("user_list_page", bench_user_list_page);
+    run_bench("lookup_fd_to_index", bench_lookup_fd);
+    run_bench("lookup_username", bench_lookup_name);
+    run_bench("get_username", bench_get_username);
+    run_bench("server_log_4_threads", bench_server_log);
+    run_bench("broadcast_10_clients", bench_broadcast);
+    run_bench("client_push_history", bench_push_history);
+
+    unlink("server/server_log.txt");
+    rmdir("server");
+    if (chdir("/") == 0) rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,382 @@
+// client_batch.c
+// 배치 모드 (-B): ncurses 없이 stdin 명령으로 업로드/다운로드를 한 세션에서 몰아서 처리
+//  - 명령은 읽는 대로 실행 (다른 프로그램이 파이프로 계속 넣어줘도 됨)
+//  - 업로드는 메인 스레드에서 차례로, 다운로드는 큐에 넣고 하나 끝날 때마다 recv_thread 가 다음 요청
+//    → 한 연결에서 업로드와 다운로드가 동시에 흐름 (서버는 연결당 다운로드 하나)
+//  - 전송마다 결과를 JSON 한 줄로 stdout, 진행 메시지는 stderr
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include "protocol.h"
+
+extern int  sock;
+extern char username[MAX_NAME];
+extern char server_host[];
+extern int  server_port;
+extern volatile int g_push_skip;
+
+extern int  connect_server(void);
+extern ssize_t recv_all(int sock, void *buf, size_t size);
+extern ssize_t send_all(int sock, const void *buf, size_t size);
+extern void save_session_token(const char *data);
+extern void *recv_thread(void *arg);
+extern int  upload_file(int sock, const char *filename, const char *username, int ttl_seconds);
+extern const char *upload_last_error(void);
+extern int  download_file(int sock, const char *filename);
+extern void client_log(const char *fmt, ...);
+
+// 종료 코드
+#define BATCH_OK        0    // 전부 성공
+#define BATCH_FAILED    1    // 실패한 전송이 있음
+#define BATCH_USAGE     2    // 잘못된 인자/명령 (잘못된 명령 줄은 건너뛰고 나머지는 실행)
+#define BATCH_CONNECT   3    // 연결 실패 (서버가 거절한 경우 포함)
+#define BATCH_LOGIN     4    // 로그인 실패
+#define BATCH_LOST      5    // 도중에 연결이 끊기고 재접속도 실패
+
+typedef enum { JOB_UPLOAD, JOB_DOWNLOAD } JobType;
+
+typedef struct {
+    JobType type;
+    char    name[256];
+    int     ttl_minutes;
+} BatchJob;
+
+// 아래 상태는 메인 스레드(stdin, 업로드)와 recv_thread(다운로드)가 같이 씀
+static pthread_mutex_t batch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  batch_cond  = PTHREAD_COND_INITIALIZER;
+
+static BatchJob *jobs = NULL;     // 지금까지 읽은 전송 (realloc 으로 늘어나므로 mutex 안에서만)
+static int       njobs = 0;
+
+static int  dl_next = 0;          // 다음에 요청할 다운로드를 찾기 시작할 위치
+static int  dl_current = -1;      // 요청 중인 다운로드 (없으면 -1)
+static int  dl_left = 0;          // 큐에 있거나 진행 중인 다운로드 수
+static int  sig_busy = 0;         // 업로드가 서명을 받는 중 → 다운로드 요청 보류
+static long dl_started = 0;
+
+static int       n_ok = 0, n_failed = 0, n_transfers = 0;
+static long long total_bytes = 0;
+static long      batch_started = 0;
+
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+// JSON 문자열 (따옴표/역슬래시/제어문자만 이스케이프)
+static void put_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+    putchar('"');
+}
+
+static double mb_per_s(long long bytes, long ms) {
+    return ms > 0 ? bytes / 1000.0 / ms : 0.0;
+}
+
+/**
+ * 전송 하나의 결과 출력 (batch_mutex 잡은 상태에서)
+ * {"op":"upload","file":"a.bin","status":"ok","bytes":N,"ms":T,"mb_per_s":X}
+ */
+static void report_locked(const BatchJob *job, int ok, const char *error, long bytes, long started) {
+    long ms = now_ms() - started;
+
+    printf("{\"op\":\"%s\",\"file\":", job->type == JOB_UPLOAD ? "upload" : "download");
+    put_json_string(job->name);
+    printf(",\"status\":\"%s\",\"bytes\":%ld,\"ms\":%ld,\"mb_per_s\":%.2f",
+           ok ? "ok" : "failed", bytes, ms, mb_per_s(bytes, ms));
+    if (!ok) {
+        printf(",\"error\":");
+        put_json_string(error && error[0] ? error : "UNKNOWN");
+    }
+    printf("}\n");
+    fflush(stdout);
+
+    if (ok) {
+        n_ok++;
+        total_bytes += bytes;
+    } else {
+        n_failed++;
+    }
+    client_log("Batch %s %s: %s", job->type == JOB_UPLOAD ? "upload" : "download",
+               job->name, ok ? "ok" : error);
+}
+
+static void report_summary(const char *error) {
+    long ms = now_ms() - batch_started;
+
+    pthread_mutex_lock(&batch_mutex);
+    printf("{\"op\":\"summary\",\"ok\":%d,\"failed\":%d,\"pending\":%d,"
+           "\"bytes\":%lld,\"ms\":%ld,\"mb_per_s\":%.2f",
+           n_ok, n_failed, n_transfers - n_ok - n_failed, total_bytes, ms,
+           mb_per_s(total_bytes, ms));
+    if (error) {
+        printf(",\"error\":");
+        put_json_string(error);
+    }
+    printf("}\n");
+    fflush(stdout);
+    pthread_mutex_unlock(&batch_mutex);
+}
+
+/**
+ * 다운로드가 비어 있으면 큐의 다음 다운로드 요청 (batch_mutex 잡은 상태에서)
+ * 업로드가 서명을 받는 중이거나 받지 않는 푸시가 흐르는 중이면 끝날 때까지 보류
+ */
+static void next_download_locked(void) {
+    while (dl_current < 0 && !sig_busy && !g_push_skip && dl_next < njobs) {
+        int i = dl_next++;
+        if (jobs[i].type != JOB_DOWNLOAD) continue;
+
+        dl_current = i;
+        dl_started = now_ms();
+        if (download_file(sock, jobs[i].name) < 0) {
+            report_locked(&jobs[i], 0, "CREATE_FAILED", 0, dl_started);
+            dl_current = -1;
+            dl_left--;
+        }
+    }
+    pthread_cond_broadcast(&batch_cond);
+}
+
+/**
+ * recv_thread 에서 호출: 요청한 다운로드가 끝남 → 결과 출력 후 바로 다음 요청
+ */
+void batch_download_done(int ok, const char *error, long bytes) {
+    pthread_mutex_lock(&batch_mutex);
+
+    if (dl_current >= 0) {
+        if (!ok && strcmp(error, "PUSH_IN_PROGRESS") == 0) {
+            // 다른 사용자의 푸시와 겹침 → 푸시가 끝나면 같은 파일 다시
+            dl_next = dl_current;
+        } else {
+            report_locked(&jobs[dl_current], ok, error, bytes, dl_started);
+            dl_left--;
+        }
+        dl_current = -1;
+        next_download_locked();
+    }
+
+    pthread_mutex_unlock(&batch_mutex);
+}
+
+/**
+ * recv_thread 에서 호출: 받지 않은 푸시가 끝남 → 보류한 다운로드 재개
+ */
+void batch_push_done(void) {
+    pthread_mutex_lock(&batch_mutex);
+    next_download_locked();
+    pthread_mutex_unlock(&batch_mutex);
+}
+
+/**
+ * 델타 업로드의 서명 전송은 서버에서 다운로드와 같은 자리를 씀
+ * → 받는 동안은 다운로드를 비워 둠 (진행 중인 다운로드가 끝날 때까지 대기)
+ */
+void batch_sig_acquire(void) {
+    pthread_mutex_lock(&batch_mutex);
+    while (dl_current >= 0) pthread_cond_wait(&batch_cond, &batch_mutex);
+    sig_busy = 1;
+    pthread_mutex_unlock(&batch_mutex);
+}
+
+void batch_sig_release(void) {
+    pthread_mutex_lock(&batch_mutex);
+    sig_busy = 0;
+    next_download_locked();
+    pthread_mutex_unlock(&batch_mutex);
+}
+
+/**
+ * recv_thread 에서 호출: 연결이 끊기고 재접속도 실패
+ */
+void batch_connection_lost(void) {
+    report_summary("CONNECTION_LOST");
+    exit(BATCH_LOST);
+}
+
+// -P 파일의 첫 줄, 없으면 $CFS_PASSWORD (명령줄 인자에는 비밀번호를 받지 않음)
+static int read_password(const char *passfile, char *pw, size_t size) {
+    if (passfile) {
+        FILE *fp = fopen(passfile, "r");
+        if (!fp) {
+            perror(passfile);
+            return -1;
+        }
+        if (!fgets(pw, size, fp)) pw[0] = '\0';
+        fclose(fp);
+        pw[strcspn(pw, "\r\n")] = '\0';
+        return 0;
+    }
+
+    const char *env = getenv("CFS_PASSWORD");
+    if (!env) {
+        fprintf(stderr, "password required: -P <file> or $CFS_PASSWORD\n");
+        return -1;
+    }
+    snprintf(pw, size, "%s", env);
+    return 0;
+}
+
+static int login(const char *user, const char *pw) {
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_LOGIN;
+    snprintf(msg.data, sizeof(msg.data), "%s %s", user, pw);
+    if (send_all(sock, &msg, sizeof(msg)) < 0 || recv_all(sock, &msg, sizeof(msg)) <= 0) {
+        fprintf(stderr, "connection closed during login\n");
+        return BATCH_CONNECT;
+    }
+
+    if (msg.type == MSG_ERROR) {
+        // 만석/접속 속도 제한
+        fprintf(stderr, "server refused connection (%.63s)\n", msg.data);
+        return BATCH_CONNECT;
+    }
+    if (msg.type != MSG_LOGIN_OK) {
+        fprintf(stderr, "login failed (%s)\n", user);
+        client_log("Login Failed (%s)", user);
+        return BATCH_LOGIN;
+    }
+
+    snprintf(username, MAX_NAME, "%s", user);
+    save_session_token(msg.data);
+    client_log("Batch login (%s)", username);
+    return BATCH_OK;
+}
+
+static int add_job_locked(const BatchJob *job) {
+    BatchJob *grown = realloc(jobs, (njobs + 1) * sizeof(BatchJob));
+    if (!grown) return -1;
+    jobs = grown;
+    jobs[njobs] = *job;
+    n_transfers++;
+    return njobs++;
+}
+
+static void run_upload(const BatchJob *job) {
+    long started = now_ms();
+    int rc = upload_file(sock, job->name, username, job->ttl_minutes * 60);
+
+    struct stat sb;
+    long bytes = rc == 0 && stat(job->name, &sb) == 0 ? (long)sb.st_size : 0;
+
+    pthread_mutex_lock(&batch_mutex);
+    report_locked(job, rc == 0, upload_last_error(), bytes, started);
+    pthread_mutex_unlock(&batch_mutex);
+}
+
+static void wait_downloads(void) {
+    pthread_mutex_lock(&batch_mutex);
+    while (dl_left > 0) pthread_cond_wait(&batch_cond, &batch_mutex);
+    pthread_mutex_unlock(&batch_mutex);
+}
+
+/**
+ * stdin 명령을 읽는 대로 실행 (빈 줄, # 주석은 무시)
+ *   upload <경로> [ttl_분]  : 바로 업로드 (끝날 때까지 다음 줄을 읽지 않음)
+ *   download <이름>         : 다운로드 큐에 넣고 다음 줄로
+ *   wait                    : 큐의 다운로드가 다 끝날 때까지
+ * 반환: 잘못된 명령 줄이 있었으면 -1
+ */
+static int run_commands(void) {
+    char line[1024];
+    int lineno = 0, bad = 0;
+
+    while (fgets(line, sizeof(line), stdin)) {
+        char cmd[16], name[256];
+        int ttl = 0;
+
+        lineno++;
+        int n = sscanf(line, "%15s %255s %d", cmd, name, &ttl);
+        if (n <= 0 || cmd[0] == '#') continue;
+
+        BatchJob job;
+        memset(&job, 0, sizeof(job));
+        snprintf(job.name, sizeof(job.name), "%s", n >= 2 ? name : "");
+
+        if (strcmp(cmd, "upload") == 0 && n >= 2 && ttl >= 0) {
+            job.type = JOB_UPLOAD;
+            job.ttl_minutes = ttl;
+
+            pthread_mutex_lock(&batch_mutex);
+            int rc = add_job_locked(&job);
+            pthread_mutex_unlock(&batch_mutex);
+            if (rc >= 0) run_upload(&job);
+        } else if (strcmp(cmd, "download") == 0 && n == 2) {
+            job.type = JOB_DOWNLOAD;
+
+            pthread_mutex_lock(&batch_mutex);
+            if (add_job_locked(&job) >= 0) {
+                dl_left++;
+                next_download_locked();
+            }
+            pthread_mutex_unlock(&batch_mutex);
+        } else if (strcmp(cmd, "wait") == 0 && n == 1) {
+            wait_downloads();
+        } else {
+            fprintf(stderr, "stdin:%d: bad command: %s", lineno, line);
+            bad = 1;
+        }
+    }
+
+    wait_downloads();
+    return bad ? -1 : 0;
+}
+
+/**
+ * -B 진입점 (client_main.c): 반환값이 그대로 프로세스 종료 코드
+ */
+int batch_main(const char *user, const char *passfile) {
+    char pw[128];
+
+    if (read_password(passfile, pw, sizeof(pw)) < 0) return BATCH_USAGE;
+
+    // 끊긴 연결에 쓰다가 죽지 않도록 (recv_thread 가 재접속/종료 처리)
+    signal(SIGPIPE, SIG_IGN);
+
+    sock = connect_server();
+    if (sock < 0) {
+        fprintf(stderr, "connect failed: %s:%d\n", server_host, server_port);
+        return BATCH_CONNECT;
+    }
+
+    int rc = login(user, pw);
+    memset(pw, 0, sizeof(pw));
+    if (rc != BATCH_OK) {
+        close(sock);
+        return rc;
+    }
+
+    batch_started = now_ms();
+
+    pthread_t recv_tid;
+    pthread_create(&recv_tid, NULL, recv_thread, NULL);
+
+    int bad = run_commands() < 0;
+
+    report_summary(NULL);
+
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_EXIT;
+    strcpy(msg.sender, username);
+    send_all(sock, &msg, sizeof(msg));
+    client_log("Batch exit");
+
+    if (bad) return BATCH_USAGE;
+    return n_failed > 0 ? BATCH_FAILED : BATCH_OK;
+}
@@ -15,7 +15,9 @@ extern WINDOW *win_chat;
 
 // 외부 변수 (client_main.c에서 정의)
 extern int  sock;
+extern ssize_t send_all(int sock, const void *buf, size_t size);
 extern char username[MAX_NAME];
+extern int  g_headless;     // 배치 모드: 화면 대신 stderr 로
 
 // =====================
 //   채팅 히스토리
@@ -64,6 +66,10 @@ static void push_history(const char *text, int right_align) {
  * right_align = 1 → 오른쪽 정렬
  */
 static void add_chat_line(const char *text, int right_align) {
+    if (g_headless) {
+        fprintf(stderr, "%s\n", text);
+        return;
+    }
     if (!win_chat) return;
 
     int maxy, maxx;
@@ -175,13 +181,50 @@ void send_chat_message(const char *msg_text) {
     strcpy(msg.sender, username);
     strcpy(msg.data, msg_text);
 
-    send(sock, &msg, sizeof(msg), 0);
+    send_all(sock, &msg, sizeof(msg));
 }
 
 /**
  * 서버에서 받은 채팅 메시지 처리
  */
 void handle_chat_message(Message *msg) {
-    // sender가 나인지에 따라 print_chat_msg가 알아서 좌/우 정렬
-    print_chat_msg(msg->sender, msg->data);
+    msg->data[sizeof(msg->data) - 1] = '\0';
+
+    // 여러 줄 응답(/users, /rooms 등)은 줄 단위로 출력
+    if (strchr(msg->data, '\n') == NULL) {
+        // sender가 나인지에 따라 print_chat_msg가 알아서 좌/우 정렬
+        print_chat_msg(msg->sender, msg->data);
+        return;
+    }
+
+    char *save = NULL;
+    for (char *line = strtok_r(msg->data, "\n", &save); line;
+         line = strtok_r(NULL, "\n", &save)) {
+        print_chat_msg(msg->sender, line);
+    }
+}
+
+/**
+ * 귓속말 출력 (data = "<받는사람> <본문>")
+ *  - 내가 보낸 것: 오른쪽 "[DM -> 받는사람]"
+ *  - 받은 것:      왼쪽   "[DM <- 보낸사람]"
+ */
+void handle_direct_message(Message *msg) {
+    char target[MAX_NAME] = "";
+    int consumed = 0;
+
+    msg->data[sizeof(msg->data) - 1] = '\0';
+    sscanf(msg->data, "%19s %n", target, &consumed);
+
+    char line[1024];
+    int is_self = (strcmp(msg->sender, username) == 0);
+
+    if (is_self) {
+        snprintf(line, sizeof(line), "[DM -> %s] %s", target, msg->data + consumed);
+    } else {
+        snprintf(line, sizeof(line), "[DM <- %s] %s", msg->sender, msg->data + consumed);
+    }
+
+    push_history(line, is_self);
+    add_chat_line(line, is_self);
 }
@@ -2,26 +2,400 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
 #include "protocol.h"
+#include "delta.h"
 #include <ncurses.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 
 
 // 외부 함수/변수
 extern WINDOW *win_chat;
 extern int sock;
+extern ssize_t send_all(int sock, const void *buf, size_t size);
 extern char username[MAX_NAME];
 extern void print_chat(const char *fmt, ...);
 
 extern volatile int g_downloading;
+extern volatile int g_push_skip;
 extern FILE *g_download_fp;
 extern char g_download_name[256];
 extern long g_download_total;
+extern const char *g_download_dir;
+
+// 배치 모드(-B): 서명 받는 동안은 다운로드를 멈춰야 함 (서버에서 같은 자리를 씀)
+extern int  g_headless;
+extern int  g_local;
+extern void batch_sig_acquire(void);
+extern void batch_sig_release(void);
 
 ssize_t w;
 ssize_t r;
 
+// 업로드 응답(READY/ACK/ERROR)은 recv_thread 가 받아서 전달해 줌
+static pthread_mutex_t upload_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  upload_cond  = PTHREAD_COND_INITIALIZER;
+static int  upload_active  = 0;
+static int  upload_state   = 0;    // 0: READY 대기, 1: 전송 중, -1: 거절됨
+static int  upload_credits = 0;    // 서버가 허락한 남은 청크 수
+static char upload_name[256];
+static char upload_error[64];      // 거절 사유 (QUOTA_EXCEEDED 등)
+
+#define UPLOAD_REPLY_TIMEOUT 10    // 초
+// fd 업로드는 서버가 파일을 다 복사한 뒤에 응답하므로 넉넉하게
+#define UPLOAD_FD_TIMEOUT    300
+
+// 이보다 작은 파일은 서명을 받지 않고 그냥 전체 업로드
+#define DELTA_MIN_SIZE       (64 * 1024)
+
+// 델타 업로드: 서버에 있는 이전 버전의 블록 서명 (recv_thread 가 채움)
+static int            sig_wait = 0;       // 서명 받는 중
+static int            sig_state = 0;      // 0: 대기, 1: 다 받음, -1: 실패
+static int            sig_block = 0;
+static long           sig_nblocks = 0;
+static long           sig_received = 0;
+static unsigned long  sig_gen = 0;
+static unsigned char *sigs = NULL;
+
+/**
+ * 다운로드 요청에만 오는 거절 (업로드 대기 중이어도 가로채지 않음)
+ */
+static int is_download_error(const char *text) {
+    return strcmp(text, "NOFILE") == 0 || strcmp(text, "PUSH_IN_PROGRESS") == 0;
+}
+
+/**
+ * recv_thread 에서 호출: 업로드 관련 응답이면 처리하고 true
+ */
+int handle_upload_reply(Message *msg) {
+    int consumed = 0;
+
+    pthread_mutex_lock(&upload_mutex);
+
+    if (upload_active && sig_wait) {
+        if (msg->type == MSG_FILE_SIG && msg->data_len == 0) {
+            // 헤더: "<파일명> <블록크기> <블록수> <세대>"
+            char name[256];
+            if (sscanf(msg->data, "%255s %d %ld %lu", name, &sig_block, &sig_nblocks,
+                       &sig_gen) == 4 && strcmp(name, upload_name) == 0) {
+                sig_received = 0;
+                free(sigs);
+                sigs = NULL;
+                if (sig_nblocks > 0) sigs = malloc((size_t)sig_nblocks * DELTA_SIG_SIZE);
+                if (sig_nblocks > 0 && !sigs) sig_state = -1;
+                else if (sig_nblocks == 0) sig_state = 1;
+            }
+            consumed = 1;
+        }
+        else if (msg->type == MSG_FILE_SIG && sigs && sig_state == 0) {
+            long count = msg->data_len / DELTA_SIG_SIZE;
+            if (count > sig_nblocks - sig_received) count = sig_nblocks - sig_received;
+
+            memcpy(sigs + sig_received * DELTA_SIG_SIZE, msg->data, count * DELTA_SIG_SIZE);
+            sig_received += count;
+            if (sig_received == sig_nblocks) sig_state = 1;
+            consumed = 1;
+        }
+        else if (msg->type == MSG_ERROR && !is_download_error(msg->data)) {
+            sig_state = -1;
+            snprintf(upload_error, sizeof(upload_error), "%.63s", msg->data);
+            consumed = 1;
+        }
+    }
+    else if (upload_active) {
+        char name[256];
+        if (msg->type == MSG_FILE_UPLOAD_FD && upload_state == 0 &&
+            sscanf(msg->data, "%255s", name) == 1 && strcmp(name, upload_name) == 0) {
+            upload_state = 1;
+            consumed = 1;
+        }
+        else if (msg->type == MSG_FILE_READY && upload_state == 0 &&
+            strcmp(msg->data, upload_name) == 0) {
+            upload_state = 1;
+            upload_credits += msg->data_len;
+            consumed = 1;
+        }
+        else if (msg->type == MSG_FILE_ACK) {
+            upload_credits += msg->data_len;
+            consumed = 1;
+        }
+        else if (msg->type == MSG_ERROR && upload_state == 0 &&
+                 !is_download_error(msg->data)) {
+            upload_state = -1;
+            snprintf(upload_error, sizeof(upload_error), "%.63s", msg->data);
+            consumed = 1;
+        }
+    }
+
+    if (consumed) pthread_cond_signal(&upload_cond);
+    pthread_mutex_unlock(&upload_mutex);
+
+    return consumed;
+}
+
+/**
+ * 조건이 만족될 때까지 대기 (timeout 초 지나면 0)
+ *  want_ready = 1: READY/거절 대기, 0: 크레딧 대기
+ */
+static int wait_upload(int want_ready, int timeout_sec) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_sec;
+
+    int ok = 1;
+    pthread_mutex_lock(&upload_mutex);
+    while (want_ready ? upload_state == 0 : upload_credits <= 0) {
+        if (pthread_cond_timedwait(&upload_cond, &upload_mutex, &deadline) == ETIMEDOUT) {
+            ok = 0;
+            break;
+        }
+    }
+    if (ok && !want_ready) upload_credits--;
+    pthread_mutex_unlock(&upload_mutex);
+    return ok;
+}
+
+static void end_upload_wait(void) {
+    pthread_mutex_lock(&upload_mutex);
+    upload_active = 0;
+    upload_state = 0;
+    upload_credits = 0;
+    sig_wait = 0;
+    free(sigs);
+    sigs = NULL;
+    pthread_mutex_unlock(&upload_mutex);
+}
+
+
+/* ===================== 델타 업로드 ===================== */
+
+/**
+ * 서버에 이전 버전 서명 요청 → 다 받을 때까지 대기
+ * (서명이 계속 들어오는 동안은 기다림, UPLOAD_REPLY_TIMEOUT 동안 진전이 없으면 포기)
+ * 반환: 1 = 이전 버전 서명 있음, 0 = 없음/실패 (전체 업로드)
+ */
+static int request_signatures(int sock, const char *filename, const char *username) {
+    pthread_mutex_lock(&upload_mutex);
+    upload_active = 1;
+    upload_state = 0;
+    upload_credits = 0;
+    sig_wait = 1;
+    sig_state = 0;
+    sig_nblocks = 0;
+    sig_received = 0;
+    snprintf(upload_name, sizeof(upload_name), "%s", filename);
+    pthread_mutex_unlock(&upload_mutex);
+
+    Message req;
+    memset(&req, 0, sizeof(req));
+    req.type = MSG_FILE_SIG_REQUEST;
+    strcpy(req.sender, username);
+    snprintf(req.data, sizeof(req.data), "%s", filename);
+    if (send_all(sock, &req, sizeof(req)) < 0) {
+        perror("write");
+        pthread_mutex_lock(&upload_mutex);
+        sig_wait = 0;
+        pthread_mutex_unlock(&upload_mutex);
+        return 0;
+    }
+
+    long last = -1;
+    pthread_mutex_lock(&upload_mutex);
+    while (sig_state == 0) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += UPLOAD_REPLY_TIMEOUT;
+
+        if (pthread_cond_timedwait(&upload_cond, &upload_mutex, &deadline) == ETIMEDOUT) {
+            if (sig_received == last) break;
+            last = sig_received;
+        }
+    }
+    int ok = sig_state == 1 && sig_nblocks > 0;
+    sig_wait = 0;
+    pthread_mutex_unlock(&upload_mutex);
+    return ok;
+}
+
+// 델타 전송 상태: 이어지는 블록 참조는 범위 하나로 합치고, 범위는 COPY 메시지에 모아서
+typedef struct {
+    int         sock;
+    const char *username;
+    Message     copy;
+    int         nruns;
+    uint32_t    run_block;
+    uint32_t    run_count;
+    long        literal;
+    long        matched;
+    int         failed;
+} DeltaOut;
+
+/**
+ * 크레딧 하나를 받아 메시지 전송 (일반 업로드와 같은 흐름 제어)
+ */
+static void delta_send(DeltaOut *d, Message *m) {
+    if (d->failed) return;
+    if (!wait_upload(0, UPLOAD_REPLY_TIMEOUT * 3)) {
+        d->failed = 1;
+        return;
+    }
+    strcpy(m->sender, d->username);
+    if (send_all(d->sock, m, sizeof(*m)) < 0) {
+        perror("write");
+        d->failed = 1;
+    }
+}
+
+static void delta_send_copy(DeltaOut *d) {
+    if (d->nruns == 0) return;
+
+    d->copy.type = MSG_FILE_COPY;
+    d->copy.data_len = d->nruns * DELTA_RUN_SIZE;
+    delta_send(d, &d->copy);
+    d->nruns = 0;
+}
+
+// 이어붙이던 범위를 COPY 메시지에 넣음 (메시지가 가득 차면 먼저 전송)
+static void delta_push_run(DeltaOut *d) {
+    if (d->run_count == 0) return;
+
+    if (d->nruns == DELTA_RUNS_PER_MSG) delta_send_copy(d);
+    memcpy(d->copy.data + d->nruns * DELTA_RUN_SIZE, &d->run_block, 4);
+    memcpy(d->copy.data + d->nruns * DELTA_RUN_SIZE + 4, &d->run_count, 4);
+    d->nruns++;
+    d->run_count = 0;
+}
+
+/**
+ * 새 데이터 전송 (그 전에 모아둔 블록 참조를 먼저 보내야 서버에서 순서가 맞음)
+ */
+static void delta_literal(DeltaOut *d, const unsigned char *p, long len) {
+    if (len <= 0) return;
+
+    delta_push_run(d);
+    delta_send_copy(d);
+
+    for (long off = 0; off < len && !d->failed; off += MAX_BUF) {
+        Message chunk;
+        int n = len - off > MAX_BUF ? MAX_BUF : (int)(len - off);
+
+        chunk.type = MSG_FILE_DATA;
+        memcpy(chunk.data, p + off, n);
+        chunk.data_len = n;
+        delta_send(d, &chunk);
+    }
+    d->literal += len;
+}
+
+static void delta_match(DeltaOut *d, uint32_t block) {
+    if (d->run_count > 0 && block == d->run_block + d->run_count) {
+        d->run_count++;
+    } else {
+        delta_push_run(d);
+        d->run_block = block;
+        d->run_count = 1;
+    }
+    d->matched += sig_block;
+}
+
+/**
+ * 새 파일을 이전 버전 서명과 비교해서 바뀐 부분만 전송 (rsync 알고리즘)
+ *  - 창을 한 바이트씩 밀며 약한 합으로 후보를 찾고 강한 해시로 확인
+ *  - 일치하면 블록 참조, 아니면 그 바이트는 새 데이터
+ * 반환: 전송한 새 데이터 바이트 (실패하면 -1)
+ */
+static long send_delta(int sock, const char *username, FILE *fp, long filesize, long *matched) {
+    unsigned char *map = mmap(NULL, filesize, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map == MAP_FAILED) return -1;
+
+    // 약한 합 → 블록 번호 해시 (마지막 블록은 짧을 수 있어서 제외)
+    long nsig = sig_nblocks - 1;
+    size_t cap = 1;
+    while (cap < (size_t)nsig * 2) cap <<= 1;
+    int32_t *table = malloc(cap * sizeof(int32_t));
+    if (!table) {
+        munmap(map, filesize);
+        return -1;
+    }
+    memset(table, 0xff, cap * sizeof(int32_t));       // -1 = 빈 칸
+
+    for (long b = 0; b < nsig; b++) {
+        uint32_t weak;
+        uint64_t strong;
+        delta_get_sig(sigs + b * DELTA_SIG_SIZE, &weak, &strong);
+
+        size_t h = (weak * 2654435761u) & (cap - 1);
+        while (table[h] >= 0) h = (h + 1) & (cap - 1);
+        table[h] = (int32_t)b;
+    }
+
+    DeltaOut d;
+    memset(&d, 0, sizeof(d));
+    d.sock = sock;
+    d.username = username;
+
+    long bs = sig_block;
+    long pos = 0, lit = 0;
+    uint32_t weak = filesize >= bs ? delta_weak(map, bs) : 0;
+
+    while (pos + bs <= filesize && !d.failed) {
+        long found = -1;
+        uint64_t strong = 0;
+        int have_strong = 0;
+
+        size_t h = (weak * 2654435761u) & (cap - 1);
+        for (; table[h] >= 0; h = (h + 1) & (cap - 1)) {
+            uint32_t sw;
+            uint64_t ss;
+            delta_get_sig(sigs + (long)table[h] * DELTA_SIG_SIZE, &sw, &ss);
+            if (sw != weak) continue;
+
+            if (!have_strong) {
+                strong = delta_strong(map + pos, bs);
+                have_strong = 1;
+            }
+            if (ss == strong) {
+                found = table[h];
+                break;
+            }
+        }
+
+        if (found >= 0) {
+            delta_literal(&d, map + lit, pos - lit);
+            delta_match(&d, (uint32_t)found);
+            pos += bs;
+            lit = pos;
+            if (pos + bs <= filesize) weak = delta_weak(map + pos, bs);
+            continue;
+        }
+
+        // 일치하지 않은 바이트가 한 청크만큼 쌓이면 바로 전송
+        if (pos - lit >= MAX_BUF) {
+            delta_literal(&d, map + lit, MAX_BUF);
+            lit += MAX_BUF;
+        }
+
+        if (pos + bs < filesize) weak = delta_roll(weak, map[pos], map[pos + bs], bs);
+        pos++;
+    }
+
+    delta_literal(&d, map + lit, filesize - lit);
+    delta_push_run(&d);
+    delta_send_copy(&d);
+
+    free(table);
+    munmap(map, filesize);
+
+    *matched = d.matched;
+    return d.failed ? -1 : d.literal;
+}
+
 
 void handle_file_data(Message *msg) {
     if (!g_downloading || g_download_fp == NULL) {
@@ -48,15 +422,137 @@ void handle_file_end(Message *msg) {
     g_download_total = 0;
 }
 
+/**
+ * 다른 사용자가 /push 로 보낸 파일 받기 시작 (data = "<파일명> <크기> <보낸사람>")
+ * 이후 MSG_FILE_DATA / MSG_FILE_END 는 다운로드와 같은 경로로 저장
+ */
+void handle_file_push(Message *msg) {
+    char name[256], from[MAX_NAME];
+    long size = 0;
+    if (sscanf(msg->data, "%255s %ld %19s", name, &size, from) != 3) return;
+
+    // 받지 않는 푸시는 MSG_FILE_END 까지 데이터를 버림 (진행 중인 다운로드에 섞이지 않게)
+    if (g_downloading) {
+        print_chat("Push from %s ignored: already downloading %s", from, g_download_name);
+        g_push_skip = 1;
+        return;
+    }
+    if (g_headless) {
+        print_chat("Push from %s ignored: %s (batch mode)", from, name);
+        g_push_skip = 1;
+        return;
+    }
+
+    // 서버가 준 이름이라도 저장 폴더 밖으로 나가지 않게 마지막 경로 요소만
+    const char *base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+
+    char savepath[512];
+    snprintf(savepath, sizeof(savepath), "%s/%s", g_download_dir, base);
+    FILE *fp = fopen(savepath, "wb");
+    if (!fp) {
+        print_chat("Push from %s: cannot create %s", from, savepath);
+        return;
+    }
+
+    g_downloading = 1;
+    g_download_fp = fp;
+    snprintf(g_download_name, sizeof(g_download_name), "%s", base);
+    g_download_total = 0;
+
+    print_chat("Receiving %s from %s (%ld bytes)", base, from, size);
+}
+
+/**
+ * 마지막 업로드가 실패한 이유 (배치 모드 결과 출력용)
+ */
+const char *upload_last_error(void) {
+    return upload_error;
+}
+
+/**
+ * 로컬(UNIX 소켓) 업로드: 파일을 열어 fd 만 넘기고 서버가 다 복사할 때까지 대기
+ */
+static int upload_file_fd(int sock, const char *filename, const char *username, int ttl_seconds) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) < 0) {
+        print_chat("Cannot open file: %s", filename);
+        snprintf(upload_error, sizeof(upload_error), "OPEN_FAILED");
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    pthread_mutex_lock(&upload_mutex);
+    upload_active = 1;
+    upload_state = 0;
+    snprintf(upload_name, sizeof(upload_name), "%s", filename);
+    pthread_mutex_unlock(&upload_mutex);
+
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_FILE_UPLOAD_FD;
+    strcpy(msg.sender, username);
+    snprintf(msg.data, sizeof(msg.data), "%s %d", filename, ttl_seconds);
+
+    // fd 는 프레임 첫 바이트와 같이 도착 → 서버는 이 프레임을 처리할 때 꺼냄
+    union {
+        char           raw[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } ctrl;
+    struct iovec iov = { &msg, sizeof(msg) };
+    struct msghdr mh;
+    memset(&mh, 0, sizeof(mh));
+    memset(&ctrl, 0, sizeof(ctrl));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctrl.raw;
+    mh.msg_controllen = sizeof(ctrl.raw);
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &fd, sizeof(int));
+
+    w = sendmsg(sock, &mh, MSG_NOSIGNAL);
+    close(fd);       // 서버가 자기 사본을 가짐
+    if (w != (ssize_t)sizeof(msg)) {
+        end_upload_wait();
+        snprintf(upload_error, sizeof(upload_error), "SEND_FAILED");
+        return -1;
+    }
+
+    print_chat("Upload starts: %s (%ld bytes, local fd)", filename, (long)sb.st_size);
+
+    if (!wait_upload(1, UPLOAD_FD_TIMEOUT) || upload_state < 0) {
+        if (upload_state == 0) snprintf(upload_error, sizeof(upload_error), "TIMEOUT");
+        print_chat("Upload failed: %s (%s)", filename, upload_error);
+        end_upload_wait();
+        return -1;
+    }
+
+    end_upload_wait();
+    print_chat("Upload Success: %s (%ld bytes)", filename, (long)sb.st_size);
+    return 0;
+}
+
 /**
  * 파일 업로드 함수
+ * 반환: 0 = 끝까지 전송, -1 = 실패 (이유는 upload_last_error)
  */
-void upload_file(int sock, const char *filename, const char *username, int ttl_seconds) {
+int upload_file(int sock, const char *filename, const char *username, int ttl_seconds) {
+
+    upload_error[0] = '\0';
+
+    // 로컬 연결이면 데이터 대신 fd 를 넘김 (델타/청크 없이 서버가 직접 읽음)
+    if (g_local) return upload_file_fd(sock, filename, username, ttl_seconds);
 
     FILE *fp = fopen(filename, "rb");
     if (!fp) { 
         print_chat("Cannot open file: %s", filename);
-        return;
+        snprintf(upload_error, sizeof(upload_error), "OPEN_FAILED");
+        return -1;
     }
 
     // 파일 크기 구하기
@@ -64,56 +560,99 @@ void upload_file(int sock, const char *filename, const char *username, int ttl_s
     long filesize = ftell(fp);
     fseek(fp, 0, SEEK_SET);
 
+    // 0) 큰 파일이면 서버에 있는 이전 버전의 서명부터 (있으면 바뀐 부분만 전송)
+    int delta = 0;
+    if (filesize >= DELTA_MIN_SIZE) {
+        if (g_headless) batch_sig_acquire();
+        delta = request_signatures(sock, filename, username);
+        if (g_headless) batch_sig_release();
+    }
+
+retry:
+    pthread_mutex_lock(&upload_mutex);
+    upload_active = 1;
+    upload_state = 0;
+    upload_credits = 0;
+    snprintf(upload_name, sizeof(upload_name), "%s", filename);
+    pthread_mutex_unlock(&upload_mutex);
+
     // 1) 업로드 요청 메시지 전송
     Message msg;
     memset(&msg, 0, sizeof(msg));
     msg.type = MSG_FILE_UPLOAD;
     strcpy(msg.sender, username);
 
-    // 🔥 서버가 기대하는 형식: "filename filesize ttl_seconds"
-    snprintf(msg.data, sizeof(msg.data), "%s %ld %d", filename, filesize, ttl_seconds);
+    // 🔥 서버가 기대하는 형식: "filename filesize ttl_seconds [DELTA gen block_size]"
+    int len = snprintf(msg.data, sizeof(msg.data), "%s %ld %d", filename, filesize, ttl_seconds);
+    if (delta) {
+        snprintf(msg.data + len, sizeof(msg.data) - len, " DELTA %lu %d", sig_gen, sig_block);
+    }
 
-    w = write(sock, &msg, sizeof(msg));
+    w = send_all(sock, &msg, sizeof(msg));
     if (w < 0) {
         perror("write");
     }
 
-    // 2) READY 메시지 대기
-    Message reply;
-    r = read(sock, &reply, sizeof(reply));
-
-    if(r < 0){
-        perror("read");
-    }
-    if (reply.type != MSG_FILE_READY) {
-        print_chat("Server rejecte Upload reqeust.");
+    // 2) READY 메시지 대기 (recv_thread 가 받아서 알려줌)
+    if (!wait_upload(1, UPLOAD_REPLY_TIMEOUT) || upload_state < 0) {
+        // 서명을 받은 뒤 서버 쪽 파일이 바뀌었으면 전체 업로드로 다시
+        if (delta && upload_state < 0 && strcmp(upload_error, "DELTA_BASE_CHANGED") == 0) {
+            delta = 0;
+            goto retry;
+        }
+        if (upload_state == 0) snprintf(upload_error, sizeof(upload_error), "TIMEOUT");
+        print_chat("Server rejecte Upload reqeust. (%s)", upload_error);
+        end_upload_wait();
         fclose(fp);
-        return;
+        return -1;
     }
 
-    print_chat("Upload starts: %s (%ld bytes)", filename, filesize);
+    print_chat("Upload starts: %s (%ld bytes%s)", filename, filesize, delta ? ", delta" : "");
 
-    // 3) 파일 전송 (청크 기반)
+    // 3) 파일 전송 (청크 기반, 크레딧 1개당 청크 1개)
     char buffer[MAX_BUF];
     long total = 0;
     int n;
+    int failed = 0;
+
+    if (delta) {
+        long matched = 0;
+        long sent = send_delta(sock, username, fp, filesize, &matched);
+        if (sent < 0) {
+            print_chat("Upload stalled: %s", filename);
+            failed = 1;
+        } else {
+            total = filesize;
+            print_chat("Delta upload: %s sent %ld new bytes, reused %ld bytes (%.1f%%)",
+                       filename, sent, matched, filesize > 0 ? matched * 100.0 / filesize : 0.0);
+        }
+    }
+
+    while (!delta && (n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+        if (!wait_upload(0, UPLOAD_REPLY_TIMEOUT * 3)) {
+            print_chat("Upload stalled: %s (%ld bytes sent)", filename, total);
+            failed = 1;
+            break;
+        }
 
-    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
         Message chunk;
         chunk.type = MSG_FILE_DATA;
         strcpy(chunk.sender, username);
         memcpy(chunk.data, buffer, n);
         chunk.data_len = n;
 
-        w = write(sock, &chunk, sizeof(chunk));
+        w = send_all(sock, &chunk, sizeof(chunk));
         
         if(w < 0){
             perror("wirte");
+            failed = 1;
+            break;
         }
         total += n;
     }
 
     fclose(fp);
+    end_upload_wait();
 
     // 4) 전송 종료 메시지
     Message end;
@@ -121,27 +660,34 @@ void upload_file(int sock, const char *filename, const char *username, int ttl_s
     strcpy(end.sender, username);
     strcpy(end.data, filename);
     end.data_len = 0;
-    w = write(sock, &end, sizeof(end));
+    w = send_all(sock, &end, sizeof(end));
 
     if(w < 0){
         perror("write");
+        failed = 1;
+    }
+    if (failed) {
+        snprintf(upload_error, sizeof(upload_error), "STALLED");
+        return -1;
     }
     print_chat("Upload Success: %s (%ld bytes)", filename, total);
+    return 0;
 }
 
 
 /**
- * 파일 다운로드 함수
+ * 파일 다운로드 함수 (요청만 보내고 데이터는 recv_thread 가 받음)
+ * 반환: 0 = 요청 보냄, -1 = 저장 파일 생성/요청 실패
  */
-void download_file(int sock, const char *filename) {
+int download_file(int sock, const char *filename) {
 
     // 1) 로컬 저장 파일 열기
     char savepath[512];
-    sprintf(savepath, "./client/%s", filename);
+    snprintf(savepath, sizeof(savepath), "%s/%s", g_download_dir, filename);
     FILE *fp = fopen(savepath, "wb");
     if (!fp) {
         print_chat("Download file create failed: %s", filename);
-        return;
+        return -1;
     }
 
     // 2) 다운로드 상태 설정
@@ -157,14 +703,15 @@ void download_file(int sock, const char *filename) {
     strcpy(req.sender, username);
     strcpy(req.data, filename);
 
-    ssize_t w = write(sock, &req, sizeof(req));
+    ssize_t w = send_all(sock, &req, sizeof(req));
     if (w < 0) {
         perror("write");
         fclose(fp);
         g_downloading = 0;
         g_download_fp = NULL;
-        return;
+        return -1;
     }
 
     print_chat("Download Starts: %s", filename);
+    return 0;
 }
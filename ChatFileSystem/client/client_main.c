@@ -1,31 +1,59 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <netdb.h>
 #include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <pthread.h>
 #include <ncurses.h>
 #include <locale.h>
 #include <signal.h>
 #include "protocol.h"
 
-void upload_file(int sock, const char *filename, const char *username, int ttl_seconds);
-void download_file(int sock, const char *filename);
+int upload_file(int sock, const char *filename, const char *username, int ttl_seconds);
+int download_file(int sock, const char *filename);
+void handle_file_push(Message *msg);
 void client_log(const char *fmt, ...);
+int handle_upload_reply(Message *msg);
 extern void print_chat(const char *format, ...);
 extern void print_chat_msg(const char *sender, const char *text);   // 추가
 extern void handle_chat_message(Message *msg);                      // 있으면 사용
+extern void handle_direct_message(Message *msg);
 extern void redraw_chat_window(void);    
 
+// 배치 모드 (client_batch.c)
+extern int  batch_main(const char *user, const char *passfile);
+extern void batch_download_done(int ok, const char *error, long bytes);
+extern void batch_push_done(void);
+extern void batch_connection_lost(void);
+
 int sock;
 char username[MAX_NAME];
 int ra;
 
+// 서버 주소 (-s host[:port] 또는 -s /경로/chat.sock)
+char server_host[256] = "127.0.0.1";
+int  server_port      = SERVER_PORT;
+int  g_local          = 0;     // UNIX 소켓으로 접속 (업로드는 fd 전달)
+
+// -B: ncurses 없이 stdin 명령으로 배치 전송 (출력은 stdout/stderr)
+int g_headless = 0;
+
+// 재접속용 세션 토큰 (LOGIN_OK 마다 새로 받음)
+char session_token[SESSION_TOKEN_LEN + 1];
+
 // 다운로드 상태
 volatile int g_downloading = 0;
+volatile int g_push_skip   = 0;     // 받지 않기로 한 푸시: MSG_FILE_END 까지 데이터 버림
 FILE *g_download_fp = NULL;
 char g_download_name[256];
 long g_download_total = 0;
+const char *g_download_dir = "./client";   // 다운로드 저장 폴더 (-d)
 
 // UI Windows
 WINDOW *win_header = NULL;
@@ -100,6 +128,31 @@ void handle_resize(int sig) {
 
 /* ----------------------- 유틸 ----------------------- */
 
+// 소켓 쓰기는 main(업로드) 과 recv_thread(다운로드 요청/PONG) 가 같이 하므로
+// 메시지 하나를 다 보낼 때까지 잠금 (send 가 중간에 나뉘면 다른 메시지가 끼어듦)
+static pthread_mutex_t send_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * 메시지 하나를 끝까지 전송 (모든 송신은 이 함수로)
+ * 반환: 보낸 바이트 수, 실패하면 -1
+ */
+ssize_t send_all(int sock, const void *buf, size_t size) {
+    size_t total = 0;
+
+    pthread_mutex_lock(&send_mutex);
+    while (total < size) {
+        ssize_t len = send(sock, (const char*)buf + total, size - total, MSG_NOSIGNAL);
+        if (len < 0 && errno == EINTR) continue;
+        if (len <= 0) {
+            pthread_mutex_unlock(&send_mutex);
+            return -1;
+        }
+        total += len;
+    }
+    pthread_mutex_unlock(&send_mutex);
+    return total;
+}
+
 ssize_t recv_all(int sock, void *buf, size_t size) {
     size_t total = 0;
 
@@ -113,6 +166,136 @@ ssize_t recv_all(int sock, void *buf, size_t size) {
     return total;
 }
 
+/**
+ * 서버에 TCP 연결 (server_host 는 IP 또는 호스트 이름)
+ * 반환: 연결된 소켓, 실패하면 -1
+ */
+int connect_server(void) {
+    struct addrinfo hints, *res, *ai;
+    char port[16];
+
+    if (g_local) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, server_host, strlen(server_host));   // 길이는 parse_server 에서 확인
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", server_port);
+    if (getaddrinfo(server_host, port, &hints, &res) != 0) return -1;
+
+    int fd = -1;
+    for (ai = res; ai; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd < 0) return -1;
+
+    // 메시지는 항상 한 프레임씩 write 하므로 Nagle 지연은 끔
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return fd;
+}
+
+/**
+ * 진행 중인 다운로드 마무리 (성공/실패 공통)
+ * 배치 모드면 결과를 넘겨서 다음 다운로드를 바로 요청하게 함
+ */
+static void download_finished(int ok, const char *error) {
+    long total = g_download_total;
+
+    if (g_download_fp) fclose(g_download_fp);
+    if (ok) {
+        print_chat("Download Success: %s (%ld bytes)", g_download_name, total);
+    } else if (strcmp(error, "NOFILE") == 0) {
+        print_chat("Download failed: %s not found on server", g_download_name);
+    } else {
+        print_chat("Download failed: %s (%s)", g_download_name, error);
+    }
+
+    g_downloading    = 0;
+    g_download_fp    = NULL;
+    g_download_total = 0;
+
+    if (g_headless) batch_download_done(ok, error, total);
+}
+
+// "LOGIN_OK <토큰>" 에서 토큰만 저장
+void save_session_token(const char *data) {
+    const char *p = strchr(data, ' ');
+    if (p && strlen(p + 1) == SESSION_TOKEN_LEN) {
+        strcpy(session_token, p + 1);
+    }
+}
+
+/**
+ * 연결이 끊겼을 때 토큰으로 세션 재개 시도 (1초 간격, 최대 RESUME_TRIES 번)
+ * 성공하면 새 연결을 기존 sock 번호에 덮어써서 입력 스레드는 그대로 사용
+ */
+#define RESUME_TRIES 10
+
+int try_resume(void) {
+    if (session_token[0] == '\0') return 0;
+
+    for (int attempt = 1; attempt <= RESUME_TRIES; attempt++) {
+        print_chat("Connection lost. Reconnecting... (%d/%d)", attempt, RESUME_TRIES);
+        sleep(1);
+
+        int fd = connect_server();
+        if (fd < 0) continue;
+
+        Message msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.type = MSG_RESUME;
+        strcpy(msg.sender, username);
+        strcpy(msg.data, session_token);
+        send_all(fd, &msg, sizeof(msg));
+
+        if (recv_all(fd, &msg, sizeof(msg)) <= 0 || msg.type == MSG_ERROR) {
+            // 만석/접속 속도 제한 → 잠시 후 다시
+            close(fd);
+            continue;
+        }
+        if (msg.type != MSG_LOGIN_OK) {
+            // 토큰 만료/거절 → 더 시도해도 소용 없음
+            close(fd);
+            client_log("Resume rejected (%s)", username);
+            return 0;
+        }
+
+        save_session_token(msg.data);
+        pthread_mutex_lock(&send_mutex);     // 보내던 메시지는 옛 소켓에서 마저
+        dup2(fd, sock);
+        pthread_mutex_unlock(&send_mutex);
+        close(fd);
+
+        // 끊기기 전 받던 다운로드/푸시는 이어받을 수 없음
+        g_push_skip = 0;
+        if (g_downloading) download_finished(0, "INTERRUPTED");
+
+        print_chat("Reconnected");
+        client_log("Session resumed (%s)", username);
+        return 1;
+    }
+
+    return 0;
+}
+
 /* ----------------------- recv_thread ----------------------- */
 
 void *recv_thread(void *arg) {
@@ -122,11 +305,28 @@ void *recv_thread(void *arg) {
     while (1) {
         ssize_t len = recv_all(sock, &msg, sizeof(Message));
         if (len <= 0) {
+            if (try_resume()) continue;
             print_chat("Server disconnected");
+            if (g_headless) batch_connection_lost();
             endwin();
             exit(0);
         }
 
+        // 업로드 응답(READY/ACK/거절)은 업로드 중인 입력 스레드로 전달
+        if ((msg.type == MSG_FILE_READY || msg.type == MSG_FILE_ACK || msg.type == MSG_FILE_SIG ||
+             msg.type == MSG_FILE_UPLOAD_FD || msg.type == MSG_ERROR) && handle_upload_reply(&msg)) {
+            continue;
+        }
+
+        // 받지 않기로 한 푸시 (서버는 다운로드와 푸시를 같이 보내지 않으므로 모두 푸시 데이터)
+        if (g_push_skip && (msg.type == MSG_FILE_DATA || msg.type == MSG_FILE_END)) {
+            if (msg.type == MSG_FILE_END) {
+                g_push_skip = 0;
+                if (g_headless) batch_push_done();
+            }
+            continue;
+        }
+
         // 파일 다운로드 처리
         if (g_downloading && (msg.type == MSG_FILE_DATA || msg.type == MSG_FILE_END)) {
 
@@ -135,15 +335,17 @@ void *recv_thread(void *arg) {
                 g_download_total += msg.data_len;
             }
 
-            if (msg.type == MSG_FILE_END) {
-                if (g_download_fp) fclose(g_download_fp);
-                print_chat("Download Success: %s (%ld bytes)",
-                           g_download_name, g_download_total);
+            if (msg.type == MSG_FILE_END) download_finished(1, NULL);
+            continue;
+        }
 
-                g_downloading    = 0;
-                g_download_fp    = NULL;
-                g_download_total = 0;
-            }
+        // 서버 하트비트 → 바로 응답 (화면에는 표시하지 않음)
+        if (msg.type == MSG_PING) {
+            Message pong;
+            memset(&pong, 0, sizeof(pong));
+            pong.type = MSG_PONG;
+            strcpy(pong.sender, username);
+            send_all(sock, &pong, sizeof(pong));
             continue;
         }
 
@@ -153,14 +355,55 @@ void *recv_thread(void *arg) {
                 handle_chat_message(&msg);
             }   
         }
+        else if (msg.type == MSG_DIRECT) {
+            handle_direct_message(&msg);
+        }
+        else if (msg.type == MSG_FILE_PUSH) {
+            handle_file_push(&msg);
+        }
+        else if (msg.type == MSG_FILE_READY) {
+            // 다운로드 시작 알림 (데이터는 위에서 처리)
+        }
+        else if (msg.type == MSG_ERROR && g_downloading) {
+            download_finished(0, msg.data);
+        }
         else if (msg.type == MSG_LOGIN_OK) {
+            save_session_token(msg.data);
             print_chat("Server: Login Success");
         }
         else if (msg.type == MSG_LOGIN_FAIL) {
             print_chat("Server: Login Fail");
         }
         else if (msg.type == MSG_LIST_RESPONSE) {
-            // print_chat("[User List]\n%s", msg.data);
+            // 첫 줄 "<seq> <전체 수> <다음 커서|->", 이후 한 줄에 이름 하나
+            unsigned long seq;
+            int total;
+            char next[MAX_NAME] = "-";
+            char *names = strchr(msg.data, '\n');
+            if (sscanf(msg.data, "%lu %d %19s", &seq, &total, next) >= 2 && names) {
+                print_chat("[Online %d]", total);
+                char *save = NULL;
+                for (char *line = strtok_r(names + 1, "\n", &save); line;
+                     line = strtok_r(NULL, "\n", &save)) {
+                    print_chat("- %s", line);
+                }
+                if (strcmp(next, "-") != 0) print_chat("more: /list %s", next);
+            }
+        }
+        else if (msg.type == MSG_PRESENCE) {
+            unsigned long seq;
+            char name[MAX_NAME + 1];
+            if (sscanf(msg.data, "%lu %20s", &seq, name) == 2) {
+                print_chat("* %s %s", name + 1, name[0] == '+' ? "is online" : "went offline");
+            }
+        }
+        else if (msg.type == MSG_FILE_LIST_RESPONSE) {
+            // 한 줄씩 끊어서 출력
+            char *save = NULL;
+            for (char *line = strtok_r(msg.data, "\n", &save); line;
+                 line = strtok_r(NULL, "\n", &save)) {
+                print_chat("%s", line);
+            }
         }
         else {
             print_chat("Server send type=%d", msg.type);
@@ -172,13 +415,76 @@ void *recv_thread(void *arg) {
 
 /* ----------------------- main ----------------------- */
 
-int main() {
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-s host[:port] | -s /path/chat.sock] [-d download_dir]\n"
+            "       %s -B -u user [-P password_file] [-s host[:port]] [-d download_dir] < commands\n"
+            "  -s  a path containing '/' connects to the server's local socket\n"
+            "      (same host only; uploads hand over the open file instead of sending it)\n"
+            "  -B  batch mode: no UI, reads commands from stdin, JSON results on stdout\n"
+            "      (password from -P file or $CFS_PASSWORD)\n"
+            "      commands: upload <path> [ttl_minutes] | download <name> | wait\n",
+            prog, prog);
+}
+
+// "host" 또는 "host:port" (IPv6 주소는 포트 없이), '/' 가 있으면 UNIX 소켓 경로
+static int parse_server(const char *arg) {
+    const char *colon = strrchr(arg, ':');
+
+    if (strchr(arg, '/')) {
+        struct sockaddr_un addr;
+        if (strlen(arg) >= sizeof(addr.sun_path)) return -1;
+        snprintf(server_host, sizeof(server_host), "%s", arg);
+        g_local = 1;
+        return 0;
+    }
+
+    if (colon && colon == strchr(arg, ':')) {
+        char *end;
+        long port = strtol(colon + 1, &end, 10);
+        if (*end != '\0' || port <= 0 || port > 65535) return -1;
+        server_port = (int)port;
+        snprintf(server_host, sizeof(server_host), "%.*s", (int)(colon - arg), arg);
+    } else {
+        snprintf(server_host, sizeof(server_host), "%s", arg);
+    }
+    return server_host[0] ? 0 : -1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *batch_user = NULL;
+    const char *passfile   = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:d:Bu:P:")) != -1) {
+        switch (opt) {
+            case 's':
+                if (parse_server(optarg) < 0) {
+                    usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'd': g_download_dir = optarg; break;
+            case 'B': g_headless = 1;          break;
+            case 'u': batch_user = optarg;     break;
+            case 'P': passfile = optarg;       break;
+            default:
+                usage(argv[0]);
+                return 2;
+        }
+    }
+    if (optind < argc || (g_headless && !batch_user) || (!g_headless && (batch_user || passfile))) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    if (g_headless) return batch_main(batch_user, passfile);
+
     setlocale(LC_ALL, "");
 
     // SIGWINCH 핸들러 등록 (터미널 리사이즈)
     signal(SIGWINCH, handle_resize);
 
-    struct sockaddr_in server_addr;
     Message msg;
     pthread_t recv_tid;
 
@@ -186,14 +492,10 @@ int main() {
     init_ui();
 
     // 소켓 생성 및 서버 연결
-    sock = socket(AF_INET, SOCK_STREAM, 0);
-    server_addr.sin_family      = AF_INET;
-    server_addr.sin_port        = htons(SERVER_PORT);
-    server_addr.sin_addr.s_addr = inet_addr("127.0.0.1");
-
-    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+    sock = connect_server();
+    if (sock < 0) {
         endwin();
-        perror("connect failed");
+        fprintf(stderr, "connect failed: %s:%d\n", server_host, server_port);
         return 1;
     }
 
@@ -222,11 +524,20 @@ int main() {
     // 로그인 요청 전송
     msg.type = MSG_LOGIN;
     sprintf(msg.data, "%s %s", id, pw);
-    send(sock, &msg, sizeof(msg), 0);
+    send_all(sock, &msg, sizeof(msg));
     ra = read(sock, &msg, sizeof(msg));
     if (ra < 0) perror("read");
 
-    if (strcmp(msg.data, "LOGIN_FAIL") == 0) {
+    if (msg.type == MSG_ERROR && ra > 0) {
+        // 만석/접속 속도 제한으로 서버가 연결을 받지 않음
+        print_chat("Server refused connection (%s)", msg.data);
+        client_log("Connection refused (%s)", msg.data);
+        sleep(1);
+        endwin();
+        return 0;
+    }
+
+    if (msg.type != MSG_LOGIN_OK) {
         print_chat("Login Failed");
         client_log("Login Failed (%s)", id);
         sleep(1);
@@ -235,7 +546,8 @@ int main() {
     }
 
     strcpy(username, id);
-    print_chat("Login Success! Command: /upload, /download, /exit, /kick, /root, /list");
+    save_session_token(msg.data);
+    print_chat("Login Success! Command: /upload, /download, /files, /push, /watch, /join, /leave, /rooms, /w, /quota, /exit, /kick, /root, /list");
     client_log("Login Success (%s)", username);
 
     // 헤더 갱신 (로그인 후)
@@ -322,19 +634,60 @@ int main() {
         }
 
         /* ---------- List ---------- */
-        else if (strcmp(buf, "/list") == 0) {
+        else if (strcmp(buf, "/list") == 0 || strncmp(buf, "/list ", 6) == 0) {
+            // /list [커서] : 이름순 한 페이지 (다음 페이지 커서는 응답에 표시)
             Message req;
             memset(&req, 0, sizeof(req));
             req.type = MSG_LIST_REQEUST;
             strcpy(req.sender, username);
-            send(sock, &req, sizeof(req), 0);
+            if (buf[5] == ' ') snprintf(req.data, sizeof(req.data), "%s", buf + 6);
+            send_all(sock, &req, sizeof(req));
+        }
+
+        /* ---------- Presence ---------- */
+        else if (strcmp(buf, "/watch on") == 0 || strcmp(buf, "/watch off") == 0) {
+            // 접속/종료 알림 구독
+            Message req;
+            memset(&req, 0, sizeof(req));
+            req.type = MSG_PRESENCE_SUB;
+            strcpy(req.sender, username);
+            strcpy(req.data, buf[8] == 'n' ? "1" : "0");
+            send_all(sock, &req, sizeof(req));
+            print_chat("Presence alerts %s", buf[8] == 'n' ? "on" : "off");
+        }
+
+        /* ---------- Files ---------- */
+        else if (strcmp(buf, "/files") == 0 || strncmp(buf, "/files ", 7) == 0) {
+            char prefix[256] = "*";
+            int page = 1;
+
+            if (buf[6] == ' ') {
+                sscanf(buf + 7, "%255s %d", prefix, &page);
+            }
+
+            Message req;
+            memset(&req, 0, sizeof(req));
+            req.type = MSG_FILE_LIST_REQUEST;
+            strcpy(req.sender, username);
+            snprintf(req.data, sizeof(req.data), "%d %s", page, prefix);
+            send_all(sock, &req, sizeof(req));
+        }
+
+        /* ---------- Direct message ---------- */
+        else if (strncmp(buf, "/w ", 3) == 0) {
+            // 에코는 서버가 돌려주므로 여기서는 표시하지 않음
+            msg.type = MSG_CHAT;
+            strcpy(msg.sender, username);
+            strcpy(msg.data, buf);
+            send_all(sock, &msg, sizeof(msg));
+            client_log("DM: %s", buf + 3);
         }
 
         /* ---------- Exit ---------- */
         else if (strcmp(buf, "/exit") == 0) {
             msg.type = MSG_EXIT;
             strcpy(msg.sender, username);
-            send(sock, &msg, sizeof(msg), 0);
+            send_all(sock, &msg, sizeof(msg));
 
             print_chat("Client exit");
             client_log("Client exit");
@@ -347,7 +700,7 @@ int main() {
         msg.type = MSG_CHAT;
         strcpy(msg.sender, username);
         strcpy(msg.data, buf);
-        send(sock, &msg, sizeof(msg), 0);
+        send_all(sock, &msg, sizeof(msg));
         client_log("Chat: %s", buf);
 
         // ✅ 내가 보낸 메시지도 바로 채팅창에 표시 (오른쪽 정렬)
@@ -0,0 +1,68 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+#include <string.h>
+#include "protocol.h"
+
+// 델타 업로드용 블록 서명 (서버/클라이언트가 같은 계산을 해야 함)
+//  서명 하나 = 약한 합(rolling, 4바이트) + 강한 해시(FNV-1a 64, 8바이트)
+//  범위 하나 = 시작 블록(4바이트) + 블록 수(4바이트), 전부 호스트 바이트 순서
+#define DELTA_BLOCK_MIN     1024
+#define DELTA_BLOCK_MAX     16384
+#define DELTA_SIG_SIZE      12
+#define DELTA_SIGS_PER_MSG  (MAX_BUF / DELTA_SIG_SIZE)
+#define DELTA_RUN_SIZE      8
+#define DELTA_RUNS_PER_MSG  (MAX_BUF / DELTA_RUN_SIZE)
+
+/**
+ * 파일 크기에 맞는 블록 크기: √size 근처를 1KB 단위로 (서명 양과 일치 단위의 균형)
+ */
+static inline int delta_block_size(long size) {
+    long bs = DELTA_BLOCK_MIN;
+    while (bs < DELTA_BLOCK_MAX && bs * bs < size) bs += DELTA_BLOCK_MIN;
+    return (int)bs;
+}
+
+/**
+ * 약한 합 (rsync 방식: a = Σx, b = Σ(len-i)·x, 각각 16비트)
+ */
+static inline uint32_t delta_weak(const unsigned char *p, size_t len) {
+    uint32_t a = 0, b = 0;
+    for (size_t i = 0; i < len; i++) {
+        a += p[i];
+        b += (uint32_t)(len - i) * p[i];
+    }
+    return (a & 0xffff) | (b << 16);
+}
+
+/**
+ * 창을 한 바이트 밀기 (out 이 빠지고 in 이 들어옴)
+ */
+static inline uint32_t delta_roll(uint32_t weak, unsigned char out, unsigned char in, size_t len) {
+    uint32_t a = weak & 0xffff, b = weak >> 16;
+    a = (a - out + in) & 0xffff;
+    b = (b - (uint32_t)len * out + a) & 0xffff;
+    return a | (b << 16);
+}
+
+static inline uint64_t delta_strong(const unsigned char *p, size_t len) {
+    uint64_t h = 14695981039346656037ull;      // FNV-1a 64
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static inline void delta_put_sig(unsigned char *out, uint32_t weak, uint64_t strong) {
+    memcpy(out, &weak, 4);
+    memcpy(out + 4, &strong, 8);
+}
+
+static inline void delta_get_sig(const unsigned char *in, uint32_t *weak, uint64_t *strong) {
+    memcpy(weak, in, 4);
+    memcpy(strong, in + 4, 8);
+}
+
+#endif
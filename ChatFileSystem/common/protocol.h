@@ -13,22 +13,71 @@
 #define MSG_LOGIN_FAIL      3
 #define MSG_CHAT            4
 
+// 세션 재개: 로그인 성공 시 data = "LOGIN_OK <토큰>"
+// 끊긴 뒤 새 연결에서 MSG_RESUME(data = 토큰) → LOGIN_OK(새 토큰) / LOGIN_FAIL
+#define MSG_RESUME          26
+#define SESSION_TOKEN_LEN   32     // 16바이트 난수의 hex
+
 // 파일 요청
 #define MSG_FILE_UPLOAD     5
 #define MSG_FILE_DOWNLOAD   6
 
 // 파일 전송
-#define MSG_FILE_READY      7      // 서버: 업로드 준비 완료
+#define MSG_FILE_READY      7      // 서버: 업로드 준비 완료 (data_len = 초기 크레딧)
 #define MSG_FILE_DATA       8      // 파일 데이터 청크
 #define MSG_FILE_END        9      // 파일 전송 종료
+#define MSG_FILE_ACK        25     // 서버: 업로드 크레딧 추가 (data_len = 청크 수)
+
+// 델타 업로드 (rsync 방식): 서버에 있는 이전 버전의 블록 서명을 받아 바뀐 부분만 전송
+//  C→S MSG_FILE_SIG_REQUEST(data = 파일명)
+//  S→C MSG_FILE_SIG(data = "<파일명> <블록크기> <블록수> <세대>", data_len = 0)
+//      → MSG_FILE_SIG(data = 서명 배열, data_len = 바이트) 반복 (이전 버전이 없으면 헤더만)
+//      (푸시를 받는 중이면 MSG_ERROR "SIG_BUSY" → 클라이언트는 전체 업로드)
+//  C→S MSG_FILE_UPLOAD(data = "파일명 크기 ttl DELTA <세대> <블록크기>") → MSG_FILE_READY
+//      → MSG_FILE_DATA(새 데이터) / MSG_FILE_COPY(이전 버전 블록 범위) 를 순서대로 → MSG_FILE_END
+//  (서명/범위 형식은 delta.h)
+#define MSG_FILE_SIG_REQUEST 27
+#define MSG_FILE_SIG         28
+#define MSG_FILE_COPY        29     // 크레딧 1개 사용, data_len = 범위 배열 바이트
+
+// 푸시: 서버에 올린 파일을 여러 사용자에게 한 번에 (/push <파일> <#방|사용자...>)
+//  S→C MSG_FILE_PUSH(data = "<파일명> <크기> <보낸사람>") → MSG_FILE_DATA 반복 → MSG_FILE_END
+//      (중간에 실패하면 MSG_ERROR "PUSH_FAILED"), 받는 중에는 MSG_FILE_DOWNLOAD 가 PUSH_IN_PROGRESS 로 거절됨
+#define MSG_FILE_PUSH        30
+
+// 하트비트: 한동안 수신이 없으면 서버가 MSG_PING → 클라이언트는 MSG_PONG 으로 응답
+//  (다른 메시지를 보내도 살아있는 것으로 봄, 응답이 없으면 연결을 끊고 세션만 남김)
+#define MSG_PING             33
+#define MSG_PONG             34
+
+// 로컬 소켓(AF_UNIX) 전용: 열린 파일 fd 를 SCM_RIGHTS 로 넘겨서 업로드 (데이터는 서버가 직접 읽음)
+//  C→S MSG_FILE_UPLOAD_FD(data = "<파일명> <ttl>", fd 는 이 프레임과 같은 sendmsg 로)
+//  S→C 저장이 끝나면 같은 MSG_FILE_UPLOAD_FD(data = "<파일명> <크기>"), 실패하면 MSG_ERROR
+//      (다운로드의 MSG_FILE_END 와 섞이지 않게 요청과 같은 타입으로 응답)
+#define MSG_FILE_UPLOAD_FD   35
 
 // 종료 및 기타
 #define MSG_EXIT            10
 #define MSG_ERROR           11      // 파일 없음/오류 제어용
 
+// 접속자 목록 (data = "[커서] [개수]", 커서 = 이전 페이지의 마지막 이름)
+//  → MSG_LIST_RESPONSE(data = "<seq> <전체 수> <다음 커서|->\n이름\n...")
 #define MSG_LIST_REQEUST 20
 #define MSG_LIST_RESPONSE 21
 
+// 접속/종료 알림 구독 (data = "1" 켜기 / "0" 끄기)
+//  구독 중이면 MSG_PRESENCE(data = "<seq> +이름" / "<seq> -이름") 를 변경 때마다 받음
+//  목록 페이지의 seq 보다 큰 이벤트만 반영, seq 가 건너뛰거나 줄면 목록을 처음부터 다시
+#define MSG_PRESENCE_SUB        31
+#define MSG_PRESENCE            32
+
+// 저장소 파일 목록 (data = "page [prefix]")
+#define MSG_FILE_LIST_REQUEST   22
+#define MSG_FILE_LIST_RESPONSE  23
+
+// 귓속말 (data = "<받는사람> <본문>", sender = 보낸 사람)
+#define MSG_DIRECT              24
+
 // 공통 메시지 구조체
 typedef struct {
     int type;                      // 메시지 타입
@@ -0,0 +1,247 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "server_admit.h"
+#include "server_auth.h"
+#include "server_conn.h"
+#include "server_bucket.h"
+#include "server_trace.h"
+
+extern int client_sockets[];
+extern void server_log(const char *fmt, ...);
+
+#define MAX_CLIENTS   10
+#define IP_PROBE      8         // 해시 충돌 시 살펴보는 칸 수
+
+// IP 하나의 연결 속도 (오래 안 쓴 칸부터 재사용)
+typedef struct {
+    bool        used;
+    in_addr_t   ip;
+    double      last_seen;
+    TokenBucket bucket;
+} IpRate;
+
+static IpRate ip_table[ADMIT_IP_SLOTS];
+static int    backlog = ACCEPT_BACKLOG;
+
+// 로컬(UNIX) 리스너: 지운 파일 경로는 종료 시 정리
+static int    local_fd = -1;
+static char   local_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static unsigned long stat_accepted = 0;
+static unsigned long stat_full = 0;
+static unsigned long stat_limited = 0;
+static unsigned long stat_local = 0;
+
+
+static unsigned int hash_ip(in_addr_t ip) {
+    unsigned int h = 2166136261u;          // FNV-1a
+    for (int k = 0; k < 4; k++) {
+        h ^= (ip >> (k * 8)) & 0xff;
+        h *= 16777619u;
+    }
+    return h & (ADMIT_IP_SLOTS - 1);
+}
+
+/**
+ * 이 IP 의 새 연결을 받아도 되는지 (토큰 하나 사용)
+ */
+static bool ip_allow(in_addr_t ip) {
+    double now = now_seconds();
+    unsigned int h = hash_ip(ip);
+    IpRate *victim = NULL;
+
+    for (int k = 0; k < IP_PROBE; k++) {
+        IpRate *e = &ip_table[(h + k) & (ADMIT_IP_SLOTS - 1)];
+
+        if (e->used && e->ip == ip) {
+            e->last_seen = now;
+            return bucket_take(&e->bucket, 1);
+        }
+        if (!victim || !e->used || (victim->used && e->last_seen < victim->last_seen)) {
+            victim = e;
+        }
+    }
+
+    // 처음 보는 IP → 가장 오래 안 쓴 칸에 등록
+    victim->used = true;
+    victim->ip = ip;
+    victim->last_seen = now;
+    bucket_init(&victim->bucket, ADMIT_IP_RATE, ADMIT_IP_BURST);
+    return bucket_take(&victim->bucket, 1);
+}
+
+/**
+ * 받을 수 없는 연결에 이유만 보내고 닫기 (새 소켓이라 송신 버퍼는 비어 있음)
+ */
+static void reject(int fd, const char *reason) {
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_ERROR;
+    strcpy(msg.sender, "SERVER");
+    snprintf(msg.data, sizeof(msg.data), "%s", reason);
+
+    if (send(fd, &msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        server_log("reject send failed (socket %d, errno=%d)", fd, errno);
+    }
+    close(fd);
+}
+
+static int free_slot(void) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (client_sockets[i] == 0) return i;
+    }
+    return -1;
+}
+
+
+void admit_set_backlog(int n) {
+    backlog = n > 0 ? n : ACCEPT_BACKLOG;
+}
+
+int admit_backlog(void) {
+    return backlog;
+}
+
+/**
+ * 리스닝 소켓 준비: 논블로킹 (accept 를 EAGAIN 까지 반복) + 대기열 길이 적용
+ * (넘겨받은 소켓에 다시 listen 하면 대기열 길이만 바뀜)
+ */
+void admit_prepare_listener(int server_fd) {
+    int flags = fcntl(server_fd, F_GETFL, 0);
+    if (flags >= 0) fcntl(server_fd, F_SETFL, flags | O_NONBLOCK);
+
+    if (listen(server_fd, backlog) < 0) {
+        perror("listen failed");
+    }
+}
+
+/**
+ * 로컬 리스너 열기 (TCP 포트 bind 뒤에 호출 → 여기까지 온 서버는 혼자라서 남은 파일은 지워도 됨)
+ * 반환: 리스닝 소켓, 실패하면 -1 (TCP 만으로 계속)
+ */
+int admit_listen_local(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        server_log("local socket path too long: %s", path);
+        return -1;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        server_log("local socket unavailable: %s (errno=%d)", path, errno);
+        close(fd);
+        return -1;
+    }
+
+    admit_adopt_local(fd, path);
+    return fd;
+}
+
+/**
+ * 넘겨받은(또는 방금 연) 로컬 리스너 등록 (무중단 재시작이면 bind 없이 그대로)
+ */
+void admit_adopt_local(int fd, const char *path) {
+    local_fd = fd;
+    snprintf(local_path, sizeof(local_path), "%s", path);
+    admit_prepare_listener(fd);
+}
+
+int admit_local_fd(void) {
+    return local_fd;
+}
+
+/**
+ * SIGINT 종료 시 로컬 소켓 파일 정리 (인계하고 끝날 때는 새 서버가 쓰므로 호출 안 함)
+ */
+void admit_cleanup(void) {
+    if (local_fd >= 0) unlink(local_path);
+}
+
+/**
+ * 대기 중인 연결을 한 번에 accept (최대 ACCEPT_BATCH 개)
+ *  - 빈 슬롯이 없으면 SERVER_FULL, IP 별 속도를 넘으면 RATE_LIMITED 로 거절
+ *  - 로컬(UNIX) 연결은 IP 가 없으므로 속도 제한 없이 슬롯만 확인
+ * 반환: 슬롯에 등록한 연결 수
+ */
+int admit_accept(int server_fd) {
+    int admitted = 0;
+
+    for (int n = 0; n < ACCEPT_BATCH; n++) {
+        struct sockaddr_storage ss;
+        struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+        socklen_t addrlen = sizeof(ss);
+
+        trace_begin(TR_ACCEPT, -1, 0, 0);
+        int fd = accept4(server_fd, (struct sockaddr *)&ss, &addrlen, SOCK_CLOEXEC);
+        if (fd < 0) {
+            int err = errno;
+            trace_end(TR_ACCEPT, -1, 0, -err);
+            if (err == EINTR || err == ECONNABORTED) continue;
+            if (err != EAGAIN && err != EWOULDBLOCK) {
+                errno = err;
+                perror("accept failed");
+            }
+            break;
+        }
+
+        bool local = ss.ss_family == AF_UNIX;
+        const char *peer = local ? "local" : inet_ntoa(sin->sin_addr);
+
+        if (!local && !ip_allow(sin->sin_addr.s_addr)) {
+            if (stat_limited++ % 100 == 0) {
+                server_log("connection rate limited: %s", peer);
+            }
+            reject(fd, "RATE_LIMITED");
+            trace_end(TR_ACCEPT, fd, 0, -1);
+            continue;
+        }
+
+        int i = free_slot();
+        if (i < 0 || fd >= FD_SETSIZE) {
+            if (stat_full++ % 100 == 0) {
+                server_log("server full, rejecting %s", peer);
+            }
+            reject(fd, "SERVER_FULL");
+            trace_end(TR_ACCEPT, fd, 0, -1);
+            continue;
+        }
+
+        if (local) stat_local++;
+        else conn_tune_socket(fd);
+
+        printf("[SERVER] 새 연결: socket %d%s\n", fd, local ? " (local)" : "");
+        server_log("클라이언트 연결 (socket %d, %s)", fd, peer);
+
+        client_sockets[i] = fd;
+        set_client_index(fd, i);
+        conn_open(i);
+        stat_accepted++;
+        trace_end(TR_ACCEPT, fd, 0, i);
+        admitted++;
+    }
+
+    return admitted;
+}
+
+void admit_stats(char *buf, size_t bufsize) {
+    snprintf(buf, bufsize,
+             "Admission: %lu accepted (%lu local), %lu rejected (full), %lu rejected (rate), backlog %d",
+             stat_accepted, stat_local, stat_full, stat_limited, backlog);
+}
@@ -0,0 +1,29 @@
+#ifndef SERVER_ADMIT_H
+#define SERVER_ADMIT_H
+
+#include <stddef.h>
+
+// listen() 대기열 길이 기본값 (-b 로 변경)
+#define ACCEPT_BACKLOG   128
+// select 한 번 깨어날 때 accept 하는 최대 연결 수 (나머지는 다음 턴)
+#define ACCEPT_BATCH     64
+
+// IP 별 새 연결 속도 제한 (장애 후 재접속 폭주 대비)
+#define ADMIT_IP_RATE    5.0      // 초당
+#define ADMIT_IP_BURST   10.0
+#define ADMIT_IP_SLOTS   256      // 추적하는 IP 수 (2의 거듭제곱)
+
+// 같은 호스트의 봇/도구용 UNIX 소켓 (-L 로 변경, "-" 면 끔)
+#define LOCAL_SOCK_PATH  "./server/chat.sock"
+
+void admit_set_backlog(int backlog);
+int  admit_backlog(void);
+void admit_prepare_listener(int server_fd);
+int  admit_accept(int server_fd);
+int  admit_listen_local(const char *path);
+void admit_adopt_local(int fd, const char *path);
+int  admit_local_fd(void);
+void admit_cleanup(void);
+void admit_stats(char *buf, size_t bufsize);
+
+#endif
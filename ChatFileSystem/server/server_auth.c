@@ -1,63 +1,247 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#include <sys/select.h>
 #include "protocol.h"
+#include "server_auth.h"
+#include "server_passwd.h"
+#include "server_presence.h"
 
 
 extern int client_sockets[];
+extern void server_log(const char *fmt, ...);
 
 // 최대 10명 사용자 이름 저장
 char usernames[MAX_CLIENTS][MAX_NAME] = {0};
 
-// root 사용자 socket_fd 저장 (-1이면 없음)
+// socket_fd → client_sockets[] 인덱스 (select 를 쓰므로 fd < FD_SETSIZE)
+static int fd_index[FD_SETSIZE];
+static bool fd_index_ready = false;
+
+// username → 인덱스 해시 (버킷 체인, 체인 링크는 인덱스별 name_next[])
+#define NAME_BUCKETS 64           // 2의 거듭제곱
+static int name_bucket[NAME_BUCKETS];
+static int name_next[MAX_CLIENTS];
+
+static void init_index_tables(void) {
+    if (fd_index_ready) return;
+    for (int i = 0; i < FD_SETSIZE; i++) fd_index[i] = -1;
+    for (int b = 0; b < NAME_BUCKETS; b++) name_bucket[b] = -1;
+    for (int i = 0; i < MAX_CLIENTS; i++) name_next[i] = -1;
+    fd_index_ready = true;
+}
+
+static unsigned int hash_username(const char *s) {
+    unsigned int h = 2166136261u;          // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h & (NAME_BUCKETS - 1);
+}
+
+static void unlink_username(int idx) {
+    if (usernames[idx][0] == '\0') return;
+
+    int *link = &name_bucket[hash_username(usernames[idx])];
+    while (*link >= 0) {
+        if (*link == idx) {
+            *link = name_next[idx];
+            break;
+        }
+        link = &name_next[*link];
+    }
+    name_next[idx] = -1;
+}
+
+// root 사용자 socket_fd 저장 (-1이면 없음, ROOT_RESERVED = 재접속 대기 세션이 보유)
+#define ROOT_RESERVED -2
 static int root_fd = -1;
 
 
+// users.txt 읽기/다시 쓰기 (로그인 작업 스레드 여러 개가 동시에 부름)
+#define USERS_FILE     "./users.txt"
+#define USERS_TMP_FILE "./users.txt.tmp"
+static pthread_mutex_t users_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int hash_rounds = PASSWD_ROUNDS;
+
+void set_hash_rounds(int rounds) {
+    if (rounds >= 1000) hash_rounds = rounds;
+}
+
+int get_hash_rounds(void) {
+    return hash_rounds;
+}
+
 /**
- * users.txt 에서 ID/PW 인증
+ * id 의 저장된 비밀번호 (해시 또는 예전 평문) 찾기
  */
-bool check_login(const char *id, const char *pw) {
-
-    FILE *fp = fopen("./users.txt", "r");  // 실행 경로 무관하게
+static bool lookup_user(const char *id, char *stored, size_t size) {
+    FILE *fp = fopen(USERS_FILE, "r");  // 실행 경로 무관하게
     if (!fp) {
         perror("users.txt open failed");
         return false;
     }
 
-    char fid[32], fpw[32];
+    char fid[32], fpw[PASSWD_HASH_MAX];
+    bool found = false;
 
-    while (fscanf(fp, "%s %s", fid, fpw) == 2) {
-        if (strcmp(fid, id) == 0 && strcmp(fpw, pw) == 0) {
-            fclose(fp);
-            return true;
+    while (fscanf(fp, "%31s %127s", fid, fpw) == 2) {
+        if (strcmp(fid, id) == 0) {
+            snprintf(stored, size, "%s", fpw);
+            found = true;
+            break;
         }
     }
 
     fclose(fp);
-    return false;
+    return found;
 }
+
+/**
+ * id 의 비밀번호를 새 해시로 교체 (임시 파일에 쓰고 rename → 중간에 죽어도 원본 유지)
+ */
+static void update_user_hash(const char *id, const char *pw) {
+    char hash[PASSWD_HASH_MAX];
+    if (!passwd_hash(pw, hash_rounds, hash, sizeof(hash))) return;
+
+    pthread_mutex_lock(&users_mutex);
+
+    FILE *in = fopen(USERS_FILE, "r");
+    FILE *out = in ? fopen(USERS_TMP_FILE, "w") : NULL;
+    bool ok = in && out;
+
+    char fid[32], fpw[PASSWD_HASH_MAX];
+    while (ok && fscanf(in, "%31s %127s", fid, fpw) == 2) {
+        fprintf(out, "%s %s\n", fid, strcmp(fid, id) == 0 ? hash : fpw);
+    }
+
+    if (in) fclose(in);
+    if (out && fclose(out) != 0) ok = false;
+
+    if (ok && rename(USERS_TMP_FILE, USERS_FILE) == 0) {
+        server_log("password hash upgraded: %s", id);
+    } else {
+        server_log("password hash upgrade failed: %s", id);
+        unlink(USERS_TMP_FILE);
+    }
+
+    pthread_mutex_unlock(&users_mutex);
+}
+
+/**
+ * users.txt 에서 ID/PW 인증 (해시 계산에 수십 ms → 로그인 작업 스레드에서만 호출)
+ *  예전 평문 항목도 받아주고, 성공하면 그 자리에서 해시로 바꿔 저장
+ */
+bool check_login(const char *id, const char *pw) {
+    char stored[PASSWD_HASH_MAX];
+
+    if (!lookup_user(id, stored, sizeof(stored))) {
+        // 없는 ID 도 같은 시간이 걸리게 (ID 존재 여부 노출 방지)
+        char dummy[64];
+        snprintf(dummy, sizeof(dummy), "$6$rounds=%d$0123456789abcdef$", hash_rounds);
+        passwd_verify(pw, dummy);
+        return false;
+    }
+
+    bool ok;
+    if (strncmp(stored, "$6$", 3) == 0) {
+        ok = passwd_verify(pw, stored);
+    } else {
+        ok = strcmp(stored, pw) == 0;
+    }
+
+    if (ok && passwd_needs_rehash(stored, hash_rounds)) update_user_hash(id, pw);
+    explicit_bzero(stored, sizeof(stored));
+    return ok;
+}
+/**
+ * users.txt 에 있는 ID 인지 (/push 로 오프라인 사용자에게 안내를 남길 때)
+ */
+bool user_exists(const char *id) {
+    char stored[PASSWD_HASH_MAX];
+    bool found = lookup_user(id, stored, sizeof(stored));
+    explicit_bzero(stored, sizeof(stored));
+    return found;
+}
+
 /**
  * 로그인 성공한 유저 → socket_fd 에 username 저장
  */
 void register_user(int socket_fd, const char *username) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (client_sockets[i] == socket_fd) {
-            strncpy(usernames[i], username, MAX_NAME - 1);
-            break;
-        }
-    }
+    int i = get_client_index(socket_fd);
+    if (i < 0) return;
+
+    unlink_username(i);
+    presence_leave(usernames[i]);
+    strncpy(usernames[i], username, MAX_NAME - 1);
+    usernames[i][MAX_NAME - 1] = '\0';
+    presence_join(usernames[i]);
+
+    unsigned int b = hash_username(usernames[i]);
+    name_next[i] = name_bucket[b];
+    name_bucket[b] = i;
+}
+
+/**
+ * 접속 종료 시 username 해시/이름 정리
+ */
+void unregister_user(int idx) {
+    init_index_tables();
+    unlink_username(idx);
+    presence_leave(usernames[idx]);
+    presence_subscribe(idx, false);
+    usernames[idx][0] = '\0';
 }
+
 /**
  * 서버에서 현재 유저의 username 얻기
  */
 const char* get_username(int socket_fd) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (client_sockets[i] == socket_fd) {
-            return usernames[i];
+    int i = get_client_index(socket_fd);
+    return i >= 0 ? usernames[i] : NULL;
+}
+
+/**
+ * client_sockets[idx] 에 fd 를 넣거나(-1 = 해제) 뺄 때 호출
+ */
+void set_client_index(int socket_fd, int idx) {
+    init_index_tables();
+    if (socket_fd >= 0 && socket_fd < FD_SETSIZE) {
+        fd_index[socket_fd] = idx;
+    }
+}
+
+/**
+ * socket_fd → client_sockets[] 인덱스 (-1 = 없음), O(1)
+ */
+int get_client_index(int socket_fd) {
+    init_index_tables();
+    if (socket_fd <= 0 || socket_fd >= FD_SETSIZE) return -1;
+
+    int i = fd_index[socket_fd];
+    if (i >= 0 && client_sockets[i] == socket_fd) {
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * username → client_sockets[] 인덱스 (-1 = 접속 중 아님), 해시 조회
+ */
+int find_user_index(const char *username) {
+    init_index_tables();
+
+    for (int i = name_bucket[hash_username(username)]; i >= 0; i = name_next[i]) {
+        if (client_sockets[i] > 0 && strcmp(usernames[i], username) == 0) {
+            return i;
         }
     }
-    return NULL;
+    return -1;
 }
 
 /**
@@ -84,15 +268,58 @@ bool is_root(int socket_fd) {
  * "/root user2" 같은 커맨드 처리용 (원하면 server_chat에서 연동)
  */
 bool transfer_root(const char *target_username) {
+    int i = find_user_index(target_username);
+    if (i < 0) {
+        return false;
+    }
+
+    root_fd = client_sockets[i];
+    printf("[SERVER] 🔑 Root permission transferred to %s\n", target_username);
+    return true;
+}
+/**
+ * root 가 다음 접속자에게 넘어감 (except_fd 는 나가는 연결)
+ */
+static void pass_root_to_next(int except_fd) {
+    root_fd = -1;
+
     for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (strcmp(usernames[i], target_username) == 0) {
-            root_fd = client_sockets[i];
-            printf("[SERVER] 🔑 Root permission transferred to %s\n", target_username);
-            return true;
+        int sd = client_sockets[i];
+        if (sd > 0 && sd != except_fd && usernames[i][0] != '\0') {
+            root_fd = sd;
+            printf("[SERVER] 🔑 Root permission passed to %s\n", usernames[i]);
+            return;
         }
     }
-    return false;
 }
+
+/**
+ * 연결 종료 시 호출: socket_fd 가 root 였으면 true
+ *  reserve = true: 재접속을 위해 예약 (그동안 아무도 root 아님)
+ *  reserve = false: 다른 접속자에게 넘김
+ */
+bool release_root(int socket_fd, bool reserve) {
+    if (socket_fd <= 0 || root_fd != socket_fd) return false;
+
+    if (reserve) root_fd = ROOT_RESERVED;
+    else pass_root_to_next(socket_fd);
+    return true;
+}
+
+/**
+ * 세션 재개 시 예약된 root 되돌리기
+ */
+void restore_root(int socket_fd) {
+    if (root_fd == ROOT_RESERVED) root_fd = socket_fd;
+}
+
+/**
+ * 재접속 대기가 끝났을 때 예약 해제
+ */
+void drop_root_reservation(void) {
+    if (root_fd == ROOT_RESERVED) pass_root_to_next(-1);
+}
+
 bool can_kick(int requester_fd) {
     // 지금 구조에서는 root만 kick 가능하게
     return is_root(requester_fd);
@@ -6,7 +6,17 @@ bool can_kick(int requester_fd);
 bool is_root(int client_fd);
 bool transfer_root(const char *target_username);
 const char* get_username(int client_fd);
+int get_client_index(int client_fd);
+void set_client_index(int client_fd, int idx);
+int find_user_index(const char *username);
+void unregister_user(int idx);
 void register_user(int client_fd, const char *username);
 bool check_login(const char *username, const char *password);
+bool user_exists(const char *username);
+void set_hash_rounds(int rounds);
+int  get_hash_rounds(void);
+bool release_root(int client_fd, bool reserve);
+void restore_root(int client_fd);
+void drop_root_reservation(void);
 
 #endif
\ No newline at end of file
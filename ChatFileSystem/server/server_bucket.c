@@ -0,0 +1,66 @@
+#include <time.h>
+#include "server_bucket.h"
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void refill(TokenBucket *b) {
+    double now = now_seconds();
+
+    if (b->rate > 0) {
+        b->tokens += (now - b->last) * b->rate;
+        if (b->tokens > b->burst) b->tokens = b->burst;
+    }
+    b->last = now;
+}
+
+void bucket_init(TokenBucket *b, double rate, double burst) {
+    b->rate = rate;
+    b->burst = burst;
+    b->tokens = burst;
+    b->last = now_seconds();
+}
+
+/**
+ * 운영 중 속도 변경 (남은 토큰은 새 burst 로 잘라냄)
+ */
+void bucket_set_rate(TokenBucket *b, double rate, double burst) {
+    refill(b);
+    b->rate = rate;
+    b->burst = burst;
+    if (b->tokens > burst) b->tokens = burst;
+}
+
+/**
+ * 지금 꺼낼 수 있는 토큰 수 (무제한이면 매우 큰 값)
+ */
+double bucket_available(TokenBucket *b) {
+    if (b->rate <= 0) return 1e18;
+    refill(b);
+    return b->tokens;
+}
+
+bool bucket_take(TokenBucket *b, double n) {
+    if (b->rate <= 0) return true;
+
+    refill(b);
+    if (b->tokens < n) return false;
+
+    b->tokens -= n;
+    return true;
+}
+
+/**
+ * n 토큰이 모일 때까지 남은 시간 (ms, 0 = 지금 가능)
+ */
+int bucket_wait_ms(TokenBucket *b, double n) {
+    if (b->rate <= 0) return 0;
+
+    refill(b);
+    if (b->tokens >= n) return 0;
+
+    return (int)((n - b->tokens) / b->rate * 1000.0) + 1;
+}
@@ -0,0 +1,21 @@
+#ifndef SERVER_BUCKET_H
+#define SERVER_BUCKET_H
+
+#include <stdbool.h>
+
+// 토큰 버킷 (rate = 초당 토큰, 0이면 무제한)
+typedef struct {
+    double rate;
+    double burst;
+    double tokens;
+    double last;       // 마지막 충전 시각 (초, monotonic)
+} TokenBucket;
+
+double now_seconds(void);
+void   bucket_init(TokenBucket *b, double rate, double burst);
+void   bucket_set_rate(TokenBucket *b, double rate, double burst);
+double bucket_available(TokenBucket *b);
+bool   bucket_take(TokenBucket *b, double n);
+int    bucket_wait_ms(TokenBucket *b, double n);
+
+#endif
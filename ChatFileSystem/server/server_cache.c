@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "server_cache.h"
+
+#define CACHE_BUCKETS 256         // 2의 거듭제곱
+
+// 메인 루프 스레드에서만 사용 (mutex 없음)
+static CacheEntry *buckets[CACHE_BUCKETS];
+static CacheEntry *lru_head = NULL;
+static CacheEntry *lru_tail = NULL;
+static long        cached_bytes = 0;     // 캐시된 항목 + 채우는 중인 항목
+static int         cached_files = 0;
+
+// 크기 조정용 통계
+static unsigned long stat_hits = 0;
+static unsigned long stat_misses = 0;
+static unsigned long stat_inserts = 0;
+static unsigned long stat_evictions = 0;
+static unsigned long stat_invalidations = 0;
+
+
+static unsigned int hash_name(const char *s) {
+    unsigned int h = 2166136261u;          // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h & (CACHE_BUCKETS - 1);
+}
+
+static CacheEntry* find_entry(const char *name) {
+    for (CacheEntry *e = buckets[hash_name(name)]; e; e = e->hnext) {
+        if (strcmp(e->name, name) == 0) return e;
+    }
+    return NULL;
+}
+
+static void free_entry(CacheEntry *e) {
+    cached_bytes -= e->size;
+    free(e->data);
+    free(e);
+}
+
+static void lru_remove(CacheEntry *e) {
+    if (e->prev) e->prev->next = e->next;
+    else lru_head = e->next;
+    if (e->next) e->next->prev = e->prev;
+    else lru_tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(CacheEntry *e) {
+    e->prev = NULL;
+    e->next = lru_head;
+    if (lru_head) lru_head->prev = e;
+    lru_head = e;
+    if (!lru_tail) lru_tail = e;
+}
+
+/**
+ * 해시/LRU 에서 빼기 (전송 중이면 마지막 cache_release 때 해제)
+ */
+static void unlink_entry(CacheEntry *e) {
+    CacheEntry **link = &buckets[hash_name(e->name)];
+    while (*link && *link != e) link = &(*link)->hnext;
+    if (*link) *link = e->hnext;
+
+    lru_remove(e);
+    e->linked = false;
+    cached_files--;
+
+    if (e->refs == 0) free_entry(e);
+}
+
+/**
+ * size 바이트가 들어갈 때까지 오래된 항목부터 내보냄 (전송 중인 항목은 건너뜀)
+ */
+static bool make_room(long size) {
+    CacheEntry *e = lru_tail;
+
+    while (cached_bytes + size > CACHE_MAX_BYTES && e) {
+        CacheEntry *prev = e->prev;
+        if (e->refs == 0) {
+            unlink_entry(e);
+            stat_evictions++;
+        }
+        e = prev;
+    }
+
+    return cached_bytes + size <= CACHE_MAX_BYTES;
+}
+
+
+/**
+ * 캐시 조회 (세대가 다르면 오래된 내용이므로 버림)
+ * 반환: 고정된(pinned) 항목, 다 쓰면 cache_release / 없으면 NULL
+ */
+CacheEntry* cache_get(const char *name, unsigned long gen) {
+    CacheEntry *e = find_entry(name);
+
+    if (e && e->gen != gen) {
+        unlink_entry(e);
+        stat_invalidations++;
+        e = NULL;
+    }
+
+    if (!e) {
+        stat_misses++;
+        return NULL;
+    }
+
+    lru_remove(e);
+    lru_push_front(e);
+    e->refs++;
+    stat_hits++;
+    return e;
+}
+
+/**
+ * 캐시 미스 후 첫 다운로드가 파일을 읽으면서 채울 항목 준비
+ * 반환: 채울 버퍼 (크기 초과/메모리 부족이면 NULL → 캐시 없이 전송)
+ */
+CacheEntry* cache_fill_begin(const char *name, unsigned long gen, long size) {
+    if (size <= 0 || size > CACHE_MAX_FILE) return NULL;
+    if (!make_room(size)) return NULL;
+
+    CacheEntry *e = calloc(1, sizeof(CacheEntry));
+    if (!e) return NULL;
+
+    e->data = malloc(size);
+    if (!e->data) {
+        free(e);
+        return NULL;
+    }
+
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    e->gen = gen;
+    e->size = size;
+    e->refs = 1;
+    cached_bytes += size;
+    return e;
+}
+
+/**
+ * 다 채운 항목을 캐시에 등록하고 채우기용 고정 해제
+ */
+void cache_fill_commit(CacheEntry *e) {
+    CacheEntry *old = find_entry(e->name);
+    if (old) unlink_entry(old);
+
+    unsigned int b = hash_name(e->name);
+    e->hnext = buckets[b];
+    buckets[b] = e;
+    lru_push_front(e);
+    e->linked = true;
+    cached_files++;
+    stat_inserts++;
+
+    cache_release(e);
+}
+
+void cache_release(CacheEntry *e) {
+    if (!e || --e->refs > 0) return;
+    if (!e->linked) free_entry(e);
+}
+
+/**
+ * 재업로드/삭제 시 호출
+ */
+void cache_invalidate(const char *name) {
+    CacheEntry *e = find_entry(name);
+    if (e) {
+        unlink_entry(e);
+        stat_invalidations++;
+    }
+}
+
+void cache_stats(char *buf, size_t bufsize) {
+    unsigned long total = stat_hits + stat_misses;
+
+    snprintf(buf, bufsize,
+             "Cache: %d files, %.1f / %ld MB, hits %lu, misses %lu (hit rate %.1f%%), "
+             "inserts %lu, evictions %lu, invalidations %lu",
+             cached_files, cached_bytes / 1048576.0, CACHE_MAX_BYTES / 1048576,
+             stat_hits, stat_misses, total ? 100.0 * stat_hits / total : 0.0,
+             stat_inserts, stat_evictions, stat_invalidations);
+}
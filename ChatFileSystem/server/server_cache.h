@@ -0,0 +1,30 @@
+#ifndef SERVER_CACHE_H
+#define SERVER_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// 전체 캐시 메모리 상한 / 캐시에 올릴 파일의 최대 크기
+#define CACHE_MAX_BYTES (64L * 1024 * 1024)
+#define CACHE_MAX_FILE  (8L * 1024 * 1024)
+
+// 다운로드가 잦은 파일의 내용 (refs > 0 인 동안은 밀려나지 않음)
+typedef struct CacheEntry {
+    char               name[256];
+    unsigned long      gen;        // 카탈로그 세대 (재업로드되면 달라짐)
+    long               size;
+    char              *data;
+    int                refs;       // 전송 중인 다운로드 + 채우는 중
+    bool               linked;     // 해시/LRU 에 들어있는지
+    struct CacheEntry *prev, *next;   // LRU (head = 최근)
+    struct CacheEntry *hnext;
+} CacheEntry;
+
+CacheEntry* cache_get(const char *name, unsigned long gen);
+CacheEntry* cache_fill_begin(const char *name, unsigned long gen, long size);
+void cache_fill_commit(CacheEntry *e);
+void cache_release(CacheEntry *e);
+void cache_invalidate(const char *name);
+void cache_stats(char *buf, size_t bufsize);
+
+#endif
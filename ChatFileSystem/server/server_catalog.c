@@ -0,0 +1,481 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include "protocol.h"
+#include "server_catalog.h"
+#include "server_conn.h"
+#include "server_peer.h"
+
+extern void server_log(const char *fmt, ...);
+
+// 소유자/TTL은 파일의 xattr 로 보관 → 재시작 시 디렉토리 스캔만으로 복원
+#define XATTR_OWNER  "user.cfs.owner"
+#define XATTR_EXPIRE "user.cfs.expire"
+
+// 이름순으로 정렬된 배열 (prefix 검색 = 이진 탐색 + 연속 구간)
+static CatalogEntry *entries = NULL;
+static int entry_count = 0;
+static int entry_cap = 0;
+static char storage_dir[256];
+static unsigned long next_gen = 0;
+
+// TTL 삭제 스레드와 공유하므로 mutex 보호
+static pthread_mutex_t catalog_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// 바뀐 파일 이름 (서버 간 중계가 켜졌을 때만, 메인 루프가 catalog_drain_changes 로 가져감)
+#define CHANGE_MAX 256
+static bool changes_on = false;
+static bool changes_lost = false;         // 큐가 넘침 → 받는 쪽이 전체를 다시 봐야 함
+static char changes[CHANGE_MAX][256];
+static int  change_count = 0;
+
+#define USAGE_BUCKETS 64          // 2의 거듭제곱
+
+// 소유자별 사용량 (항목 추가/삭제 때마다 갱신 → 조회는 O(1))
+typedef struct Usage {
+    char          owner[MAX_NAME];
+    long          used;           // 카탈로그에 있는 파일 크기 합
+    long          reserved;       // 진행 중인 업로드가 알린 크기 합
+    struct Usage *next;
+} Usage;
+
+static Usage *usage_buckets[USAGE_BUCKETS];
+static long   total_used = 0;
+static long   total_reserved = 0;
+static long   quota_user = QUOTA_USER_BYTES;
+static long   quota_global = QUOTA_GLOBAL_BYTES;
+
+
+static unsigned int hash_owner(const char *s) {
+    unsigned int h = 2166136261u;          // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h & (USAGE_BUCKETS - 1);
+}
+
+/**
+ * 소유자 사용량 항목 (없으면 생성, mutex 잡은 상태에서 호출)
+ */
+static Usage* usage_of(const char *owner) {
+    unsigned int b = hash_owner(owner);
+    for (Usage *u = usage_buckets[b]; u; u = u->next) {
+        if (strcmp(u->owner, owner) == 0) return u;
+    }
+
+    Usage *u = calloc(1, sizeof(Usage));
+    if (!u) return NULL;
+    snprintf(u->owner, sizeof(u->owner), "%s", owner);
+    u->next = usage_buckets[b];
+    usage_buckets[b] = u;
+    return u;
+}
+
+static void usage_add(const CatalogEntry *e, long sign) {
+    Usage *u = usage_of(e->owner);
+    if (u) u->used += sign * e->size;
+    total_used += sign * e->size;
+}
+
+/**
+ * name 이상인 첫 위치 (lower bound)
+ */
+static int lower_bound(const char *name) {
+    int lo = 0, hi = entry_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(entries[mid].name, name) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int find_index(const char *name) {
+    int pos = lower_bound(name);
+    if (pos < entry_count && strcmp(entries[pos].name, name) == 0) {
+        return pos;
+    }
+    return -1;
+}
+
+/**
+ * 바뀐 이름을 변경 큐에 추가 (추적 중일 때만, 넘치면 놓쳤다고 표시)
+ */
+static void note_change_locked(const char *name) {
+    if (!changes_on) return;
+    if (change_count == CHANGE_MAX) {
+        changes_lost = true;
+        return;
+    }
+    snprintf(changes[change_count++], sizeof(changes[0]), "%s", name);
+}
+
+/**
+ * 정렬 위치에 삽입하거나 기존 항목 갱신 (mutex 잡은 상태에서 호출)
+ */
+static void upsert_locked(const CatalogEntry *e) {
+    note_change_locked(e->name);
+
+    int pos = lower_bound(e->name);
+    if (pos < entry_count && strcmp(entries[pos].name, e->name) == 0) {
+        usage_add(&entries[pos], -1);      // 덮어쓰기: 이전 소유자 몫 반환
+        entries[pos] = *e;
+        usage_add(e, +1);
+        return;
+    }
+
+    if (entry_count == entry_cap) {
+        int new_cap = entry_cap ? entry_cap * 2 : 64;
+        CatalogEntry *p = realloc(entries, sizeof(CatalogEntry) * new_cap);
+        if (!p) {
+            server_log("catalog: realloc failed (%d entries)", new_cap);
+            return;
+        }
+        entries = p;
+        entry_cap = new_cap;
+    }
+
+    memmove(&entries[pos + 1], &entries[pos],
+            sizeof(CatalogEntry) * (entry_count - pos));
+    entries[pos] = *e;
+    entry_count++;
+    usage_add(e, +1);
+}
+
+static void remove_at_locked(int pos) {
+    note_change_locked(entries[pos].name);
+    usage_add(&entries[pos], -1);
+    memmove(&entries[pos], &entries[pos + 1],
+            sizeof(CatalogEntry) * (entry_count - pos - 1));
+    entry_count--;
+}
+
+
+/**
+ * 서버 시작 시 저장소 디렉토리를 한 번 스캔해서 카탈로그 구성
+ */
+void catalog_init(const char *dir) {
+    snprintf(storage_dir, sizeof(storage_dir), "%s", dir);
+
+    DIR *dp = opendir(dir);
+    if (!dp) {
+        server_log("catalog: opendir(%s) failed", dir);
+        return;
+    }
+
+    pthread_mutex_lock(&catalog_mutex);
+
+    struct dirent *de;
+    while ((de = readdir(dp)) != NULL) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s%s", dir, de->d_name);
+
+        if (de->d_name[0] == '.') {
+            // 숨김/임시 파일 제외 (지난 실행에서 끝나지 못한 업로드는 정리)
+            size_t len = strlen(de->d_name);
+            size_t slen = strlen(UPLOAD_TMP_SUFFIX);
+            if (len > slen && strcmp(de->d_name + len - slen, UPLOAD_TMP_SUFFIX) == 0) {
+                unlink(path);
+            }
+            continue;
+        }
+
+        struct stat st;
+        if (stat(path, &st) < 0 || !S_ISREG(st.st_mode)) continue;
+
+        CatalogEntry e;
+        memset(&e, 0, sizeof(e));
+        snprintf(e.name, sizeof(e.name), "%s", de->d_name);
+        e.size  = st.st_size;
+        e.mtime = st.st_mtime;
+
+        ssize_t n = getxattr(path, XATTR_OWNER, e.owner, sizeof(e.owner) - 1);
+        if (n <= 0) strcpy(e.owner, "-");
+
+        char expire_buf[32] = {0};
+        if (getxattr(path, XATTR_EXPIRE, expire_buf, sizeof(expire_buf) - 1) > 0) {
+            e.expire_at = (time_t)atol(expire_buf);
+        }
+
+        e.gen = ++next_gen;
+        upsert_locked(&e);
+    }
+
+    pthread_mutex_unlock(&catalog_mutex);
+    closedir(dp);
+
+    server_log("catalog: %d files (%ld bytes) indexed from %s", entry_count, total_used, dir);
+}
+
+
+/**
+ * 업로드 완료 시 등록/갱신 (소유자/TTL은 xattr 로도 기록)
+ */
+void catalog_put(const char *name, long size, time_t mtime,
+                 const char *owner, time_t expire_at) {
+    CatalogEntry e;
+    memset(&e, 0, sizeof(e));
+    snprintf(e.name, sizeof(e.name), "%s", name);
+    snprintf(e.owner, sizeof(e.owner), "%s", owner ? owner : "-");
+    e.size = size;
+    e.mtime = mtime;
+    e.expire_at = expire_at;
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s%s", storage_dir, name);
+
+    setxattr(path, XATTR_OWNER, e.owner, strlen(e.owner), 0);
+    if (expire_at > 0) {
+        char expire_buf[32];
+        snprintf(expire_buf, sizeof(expire_buf), "%ld", (long)expire_at);
+        setxattr(path, XATTR_EXPIRE, expire_buf, strlen(expire_buf), 0);
+    } else {
+        removexattr(path, XATTR_EXPIRE);
+    }
+
+    pthread_mutex_lock(&catalog_mutex);
+    e.gen = ++next_gen;
+    upsert_locked(&e);
+    pthread_mutex_unlock(&catalog_mutex);
+}
+
+bool catalog_remove(const char *name) {
+    pthread_mutex_lock(&catalog_mutex);
+    int pos = find_index(name);
+    if (pos >= 0) remove_at_locked(pos);
+    pthread_mutex_unlock(&catalog_mutex);
+    return pos >= 0;
+}
+
+/**
+ * TTL 삭제용: 그 사이 재업로드되어 만료시각이 바뀌었으면 지우지 않음
+ */
+bool catalog_remove_if_expire(const char *name, time_t expire_at) {
+    bool removed = false;
+
+    pthread_mutex_lock(&catalog_mutex);
+    int pos = find_index(name);
+    if (pos >= 0 && entries[pos].expire_at == expire_at) {
+        remove_at_locked(pos);
+        removed = true;
+    }
+    pthread_mutex_unlock(&catalog_mutex);
+    return removed;
+}
+
+bool catalog_lookup(const char *name, CatalogEntry *out) {
+    pthread_mutex_lock(&catalog_mutex);
+    int pos = find_index(name);
+    if (pos >= 0 && out) *out = entries[pos];
+    pthread_mutex_unlock(&catalog_mutex);
+    return pos >= 0;
+}
+
+void catalog_mark_download(const char *name) {
+    pthread_mutex_lock(&catalog_mutex);
+    int pos = find_index(name);
+    if (pos >= 0) entries[pos].downloads++;
+    pthread_mutex_unlock(&catalog_mutex);
+}
+
+int catalog_count(void) {
+    pthread_mutex_lock(&catalog_mutex);
+    int n = entry_count;
+    pthread_mutex_unlock(&catalog_mutex);
+    return n;
+}
+
+/**
+ * 전체 순회 (fn 안에서 catalog_* 를 다시 호출하면 안 됨)
+ */
+void catalog_foreach(void (*fn)(const CatalogEntry *e, void *arg), void *arg) {
+    pthread_mutex_lock(&catalog_mutex);
+    for (int i = 0; i < entry_count; i++) {
+        fn(&entries[i], arg);
+    }
+    pthread_mutex_unlock(&catalog_mutex);
+}
+
+
+/**
+ * 변경 추적 켜기 (켜기 전 변경은 받는 쪽이 전체 목록으로 받음)
+ */
+void catalog_track_changes(bool on) {
+    pthread_mutex_lock(&catalog_mutex);
+    changes_on = on;
+    change_count = 0;
+    changes_lost = false;
+    pthread_mutex_unlock(&catalog_mutex);
+}
+
+/**
+ * 쌓인 변경 이름마다 fn (mutex 밖에서 호출 → fn 에서 catalog_lookup 가능)
+ * 넘쳐서 놓친 변경이 있으면 fn(NULL) 한 번
+ */
+void catalog_drain_changes(void (*fn)(const char *name, void *arg), void *arg) {
+    static char batch[CHANGE_MAX][256];
+
+    pthread_mutex_lock(&catalog_mutex);
+    int n = change_count;
+    bool lost = changes_lost;
+    memcpy(batch, changes, sizeof(changes[0]) * n);
+    change_count = 0;
+    changes_lost = false;
+    pthread_mutex_unlock(&catalog_mutex);
+
+    if (lost) {
+        fn(NULL, arg);
+        return;
+    }
+    for (int i = 0; i < n; i++) fn(batch[i], arg);
+}
+
+
+/**
+ * 파일 목록 요청 처리 (메모리에서만 응답, 파일시스템 접근 없음)
+ * 요청 data = "page [prefix]" (prefix 가 '@' 로 시작하면 다른 서버에 있는 파일)
+ */
+void send_file_list(int client_fd, Message *req) {
+    int page = 1;
+    char prefix[256] = "";
+
+    sscanf(req->data, "%d %255s", &page, prefix);
+    if (page < 1) page = 1;
+    if (strcmp(prefix, "*") == 0) prefix[0] = '\0';
+
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_FILE_LIST_RESPONSE;
+    strcpy(msg.sender, "SERVER");
+
+    if (prefix[0] == '@') {
+        msg.data_len = peer_file_page(page, prefix + 1, msg.data, MAX_BUF);
+        queue_message(client_fd, &msg);
+        return;
+    }
+
+    size_t prefix_len = strlen(prefix);
+    time_t now = time(NULL);
+
+    pthread_mutex_lock(&catalog_mutex);
+
+    // prefix 구간 [first, last)
+    int first = lower_bound(prefix);
+    int last = first;
+    while (last < entry_count &&
+           strncmp(entries[last].name, prefix, prefix_len) == 0) {
+        last++;
+    }
+
+    int total = last - first;
+    int pages = (total + CATALOG_PAGE_SIZE - 1) / CATALOG_PAGE_SIZE;
+    if (pages == 0) pages = 1;
+    if (page > pages) page = pages;
+
+    size_t off = snprintf(msg.data, MAX_BUF, "[Files] page %d/%d (%d files)\n",
+                          page, pages, total);
+
+    int start = first + (page - 1) * CATALOG_PAGE_SIZE;
+    for (int i = start; i < last && i < start + CATALOG_PAGE_SIZE; i++) {
+        char ttl[32] = "-";
+        if (entries[i].expire_at > 0) {
+            long left = (long)(entries[i].expire_at - now);
+            snprintf(ttl, sizeof(ttl), "%ldm", left > 0 ? (left + 59) / 60 : 0);
+        }
+
+        int n = snprintf(msg.data + off, MAX_BUF - off,
+                         "- %.64s (%ld B, %s, ttl %s)\n",
+                         entries[i].name, entries[i].size, entries[i].owner, ttl);
+        if (n < 0 || off + n >= MAX_BUF) break;
+        off += n;
+    }
+
+    pthread_mutex_unlock(&catalog_mutex);
+
+    int remote = peer_file_count();
+    if (remote > 0 && off < MAX_BUF) {
+        int n = snprintf(msg.data + off, MAX_BUF - off, "(+%d on other servers: /files @%s)\n",
+                         remote, prefix);
+        if (n > 0 && off + n < MAX_BUF) off += n;
+    }
+
+    msg.data_len = (int)off;
+
+    queue_message(client_fd, &msg);
+}
+
+
+/* ===================== 용량 한도 ===================== */
+
+/**
+ * 업로드 시작 시 알린 크기만큼 미리 예약 (바이트가 오가기 전에 거절)
+ * 같은 이름을 덮어쓰면 기존 파일 크기만큼은 반환될 것으로 계산
+ * 반환: QUOTA_OK / QUOTA_USER / QUOTA_GLOBAL
+ */
+int catalog_reserve(const char *owner, const char *name, long size) {
+    int result = QUOTA_OK;
+
+    pthread_mutex_lock(&catalog_mutex);
+
+    Usage *u = usage_of(owner);
+    int pos = find_index(name);
+    long replaced = pos >= 0 ? entries[pos].size : 0;
+    long replaced_own = (pos >= 0 && strcmp(entries[pos].owner, owner) == 0) ? replaced : 0;
+
+    if (!u) {
+        result = QUOTA_USER;
+    } else if (quota_user > 0 &&
+               u->used + u->reserved + size - replaced_own > quota_user) {
+        result = QUOTA_USER;
+    } else if (quota_global > 0 &&
+               total_used + total_reserved + size - replaced > quota_global) {
+        result = QUOTA_GLOBAL;
+    } else {
+        u->reserved += size;
+        total_reserved += size;
+    }
+
+    pthread_mutex_unlock(&catalog_mutex);
+    return result;
+}
+
+/**
+ * 업로드가 끝나거나 폐기될 때 예약 해제 (완료면 catalog_put 이 사용량에 반영)
+ */
+void catalog_unreserve(const char *owner, long size) {
+    pthread_mutex_lock(&catalog_mutex);
+    Usage *u = usage_of(owner);
+    if (u) u->reserved -= size;
+    total_reserved -= size;
+    pthread_mutex_unlock(&catalog_mutex);
+}
+
+void catalog_usage(const char *owner, long *user_used, long *total) {
+    pthread_mutex_lock(&catalog_mutex);
+    Usage *u = owner ? usage_of(owner) : NULL;
+    if (user_used) *user_used = u ? u->used : 0;
+    if (total) *total = total_used;
+    pthread_mutex_unlock(&catalog_mutex);
+}
+
+void catalog_get_quota(long *user_bytes, long *global_bytes) {
+    pthread_mutex_lock(&catalog_mutex);
+    *user_bytes = quota_user;
+    *global_bytes = quota_global;
+    pthread_mutex_unlock(&catalog_mutex);
+}
+
+void catalog_set_quota(long user_bytes, long global_bytes) {
+    pthread_mutex_lock(&catalog_mutex);
+    quota_user = user_bytes > 0 ? user_bytes : 0;
+    quota_global = global_bytes > 0 ? global_bytes : 0;
+    pthread_mutex_unlock(&catalog_mutex);
+
+    server_log("Storage quota changed: user=%ld B, global=%ld B", user_bytes, global_bytes);
+}
@@ -0,0 +1,54 @@
+#ifndef SERVER_CATALOG_H
+#define SERVER_CATALOG_H
+
+#include <stdbool.h>
+#include <time.h>
+#include "protocol.h"
+
+// 저장소 파일 한 개에 대한 메타데이터
+typedef struct {
+    char   name[256];
+    long   size;
+    time_t mtime;
+    char   owner[MAX_NAME];
+    time_t expire_at;          // 0이면 TTL 없음
+    long   downloads;          // 다운로드 횟수
+    unsigned long gen;         // 등록/재업로드마다 새로 부여 (캐시 무효화용)
+} CatalogEntry;
+
+#define CATALOG_PAGE_SIZE 10
+
+// 기본 저장 용량 한도 (bytes, 0이면 무제한) → root 가 /quota 로 변경
+#define QUOTA_USER_BYTES   (100L * 1024 * 1024)
+#define QUOTA_GLOBAL_BYTES (1024L * 1024 * 1024)
+
+// catalog_reserve 결과
+#define QUOTA_OK      0
+#define QUOTA_USER   -1
+#define QUOTA_GLOBAL -2
+
+// 업로드 중인 임시 파일 (".<연결>.<이름>.part", 완료 시 rename)
+#define UPLOAD_TMP_SUFFIX ".part"
+
+void catalog_init(const char *dir);
+void catalog_put(const char *name, long size, time_t mtime,
+                 const char *owner, time_t expire_at);
+bool catalog_remove(const char *name);
+bool catalog_remove_if_expire(const char *name, time_t expire_at);
+bool catalog_lookup(const char *name, CatalogEntry *out);
+void catalog_mark_download(const char *name);
+int  catalog_count(void);
+void catalog_foreach(void (*fn)(const CatalogEntry *e, void *arg), void *arg);
+void send_file_list(int client_fd, Message *msg);
+
+// 서버 간 중계용: 등록/삭제된 이름을 모아뒀다가 한 번에 가져감 (fn(NULL) = 놓친 변경 있음)
+void catalog_track_changes(bool on);
+void catalog_drain_changes(void (*fn)(const char *name, void *arg), void *arg);
+
+int  catalog_reserve(const char *owner, const char *name, long size);
+void catalog_unreserve(const char *owner, long size);
+void catalog_usage(const char *owner, long *user_used, long *total_used);
+void catalog_get_quota(long *user_bytes, long *global_bytes);
+void catalog_set_quota(long user_bytes, long global_bytes);
+
+#endif
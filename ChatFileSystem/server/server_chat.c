@@ -8,11 +8,27 @@
 #include "protocol.h"
 #include "server_auth.h"   // is_root, can_kick, transfer_root, get_username 등
 #include "server_user_list.h"  // disconnect_client 등
+#include "server_room.h"       // room_join, room_broadcast 등
+#include "server_conn.h"       // queue_message 등 (송신 큐)
+#include "server_session.h"    // 재접속 대기 세션에 메시지 보관
+#include "server_trace.h"      // /trace 덤프
+#include "server_history.h"    // 채팅 기록 + /search
+#include "server_bucket.h"     // 채팅 속도 제한
+#include "server_peer.h"       // 다른 서버로 방 채팅 중계, /peers
 
 extern int client_sockets[];
 extern char usernames[][MAX_NAME];
 extern void server_log(const char *fmt, ...);
 extern void disconnect_client(int idx);   // server_main / user_list 쪽에서 구현됨
+extern void get_upload_limits(long *user_bps, long *global_bps);
+extern void set_upload_limits(long user_bps, long global_bps);
+extern void catalog_usage(const char *owner, long *user_used, long *total_used);
+extern void catalog_get_quota(long *user_bytes, long *global_bytes);
+extern void catalog_set_quota(long user_bytes, long global_bytes);
+extern void cache_stats(char *buf, size_t bufsize);
+extern void admit_stats(char *buf, size_t bufsize);
+extern void heartbeat_stats(char *buf, size_t bufsize);
+extern void handle_file_push(int sender_fd, const char *args);
 
 #define MAX_CLIENTS 10
 
@@ -29,54 +45,444 @@ void send_text(int client_fd, const char *sender, const char *text) {
     strncpy(msg.sender, sender, sizeof(msg.sender) - 1);
     msg.sender[sizeof(msg.sender) - 1] = '\0';
 
-    strncpy(msg.data, text, sizeof(msg.data) - 1);
-    msg.data[sizeof(msg.data) - 1] = '\0';
+    snprintf(msg.data, sizeof(msg.data), "%s", text);
 
-    send(client_fd, &msg, sizeof(msg), 0);
+    queue_message(client_fd, &msg);
 }
 
 
 /**
  *  전체 사용자에게 메시지 전송 (sender 제외)
+ *  프레임은 한 번만 만들고 각 송신 큐가 공유
  */
 void broadcast(int sender_fd, Message *msg, int max_clients) {
+    OutFrame *f = frame_new(msg);
+
     for (int i = 0; i < max_clients; i++) {
         int sd = client_sockets[i];
 
         if (sd > 0 && sd != sender_fd) {
-            int sent = send(sd, msg, sizeof(Message), 0);
+            queue_frame(i, f);
+        }
+    }
+
+    session_capture(f, NULL, NULL);
+    frame_release(f);
+}
+
+
+/* ===================== 채팅 속도 제한 ===================== */
+
+// 사용자별 / 방별 초당 메시지 수 (0 = 무제한, root 가 /chatrate 로 변경)
+//  한도를 넘은 줄은 바로 버리지 않고 한 메시지로 합쳐 두었다가 토큰이 생기면 전송,
+//  합칠 자리도 없으면 버리고 보낸 사람에게만 알림
+#define CHAT_USER_RATE    5.0
+#define CHAT_ROOM_RATE    20.0
+#define CHAT_BURST_SEC    2.0       // burst = rate × 이 값
+#define CHAT_MERGE_MAX    (MAX_BUF - ROOM_NAME_LEN - 2)   // 방 이름 앞머리 자리 남김
+
+// 사용자별 버킷 + 통계 (같은 ID 의 연결들이 공유, 접속자가 없는 칸부터 재사용)
+typedef struct {
+    bool          in_use;
+    char          name[MAX_NAME];
+    TokenBucket   bucket;
+    unsigned long merged;         // 합쳐서 늦게 보낸 줄 수
+    unsigned long rejected;       // 버린 줄 수
+} ChatUser;
+
+// 연결별 합쳐둔 줄 (보낸 연결이 끊기면 세대가 달라져 버림)
+typedef struct {
+    int      len;                 // 0 = 없음
+    int      lines;
+    int      dropped;             // 합칠 자리가 없어 버린 줄 (전송할 때 알려줌)
+    int      room;
+    unsigned gen;
+    bool     warned;              // 이번 제한 구간에 안내를 보냈는지
+    char     text[CHAT_MERGE_MAX];
+} ChatPending;
+
+static ChatUser    chat_users[MAX_CLIENTS];
+static ChatPending chat_pending[MAX_CLIENTS];
+static TokenBucket room_buckets[MAX_ROOMS];
+static char        room_bucket_name[MAX_ROOMS][ROOM_NAME_LEN];  // 방 칸이 재사용되면 새로
+static double      chat_user_rate = CHAT_USER_RATE;
+static double      chat_room_rate = CHAT_ROOM_RATE;
+static unsigned long chat_merged = 0, chat_rejected = 0;
+
+static ChatUser* chat_user(const char *name) {
+    int reuse = -1;
+
+    for (int k = 0; k < MAX_CLIENTS; k++) {
+        if (chat_users[k].in_use && strcmp(chat_users[k].name, name) == 0) return &chat_users[k];
+        if (reuse < 0 && (!chat_users[k].in_use || find_user_index(chat_users[k].name) < 0)) {
+            reuse = k;
+        }
+    }
+    if (reuse < 0) reuse = 0;    // 연결 수만큼 칸이 있으므로 실제로는 오지 않음
+
+    ChatUser *u = &chat_users[reuse];
+    memset(u, 0, sizeof(*u));
+    u->in_use = true;
+    snprintf(u->name, sizeof(u->name), "%s", name);
+    bucket_init(&u->bucket, chat_user_rate, chat_user_rate * CHAT_BURST_SEC);
+    return u;
+}
+
+static TokenBucket* room_bucket(int r) {
+    if (strcmp(room_bucket_name[r], room_name(r)) != 0) {
+        snprintf(room_bucket_name[r], sizeof(room_bucket_name[r]), "%s", room_name(r));
+        bucket_init(&room_buckets[r], chat_room_rate, chat_room_rate * CHAT_BURST_SEC);
+    }
+    return &room_buckets[r];
+}
+
+/**
+ * 사용자와 방 양쪽에 토큰이 있을 때만 둘 다에서 하나씩 (한쪽만 빼면 토큰이 샘)
+ */
+static bool chat_take(ChatUser *u, int r) {
+    TokenBucket *rb = room_bucket(r);
+    if (bucket_available(&u->bucket) < 1 || bucket_available(rb) < 1) return false;
+
+    bucket_take(&u->bucket, 1);
+    bucket_take(rb, 1);
+    return true;
+}
+
+/**
+ * 방 멤버에게 전송 (검색 기록 → lobby 가 아니면 "#방이름" 앞머리)
+ */
+static void deliver_room_chat(int sender_fd, int r, Message *msg) {
+    // 검색용 기록 (방 이름을 붙이기 전 원문)
+    history_append(room_name(r), get_username(sender_fd), msg->data);
+    peer_relay_chat(room_name(r), get_username(sender_fd), msg->data);
+
+    if (strcmp(room_name(r), DEFAULT_ROOM) != 0) {
+        char text[MAX_BUF + ROOM_NAME_LEN + 2];
+        snprintf(text, sizeof(text), "#%s %s", room_name(r), msg->data);
+        snprintf(msg->data, sizeof(msg->data), "%.*s", MAX_BUF - 1, text);
+    }
+
+    room_broadcast(r, sender_fd, msg);
+}
+
+/**
+ * 다른 서버 사용자의 방 채팅 (server_peer 에서 호출) → 이 서버에 그 방이 있으면 멤버 전원에게
+ */
+void deliver_peer_chat(const char *room, const char *sender, const char *text) {
+    int r = room_find(room);
+    if (r < 0) return;
+
+    history_append(room, sender, text);
+
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_CHAT;
+    snprintf(msg.sender, sizeof(msg.sender), "%s", sender);
+    if (strcmp(room, DEFAULT_ROOM) != 0) {
+        snprintf(msg.data, sizeof(msg.data), "#%s %.*s", room, MAX_BUF - ROOM_NAME_LEN - 3, text);
+    } else {
+        snprintf(msg.data, sizeof(msg.data), "%s", text);
+    }
+    msg.data_len = (int)strlen(msg.data);
+
+    room_broadcast(r, -1, &msg);
+}
+
+/**
+ * 한도를 넘은 줄: 합쳐둘 수 있으면 뒤에 붙이고, 아니면 버림 (둘 다 보낸 사람에게 한 번만 안내)
+ */
+static void chat_defer(int idx, int sender_fd, ChatUser *u, int r, const char *text) {
+    ChatPending *p = &chat_pending[idx];
+    if (p->len > 0 && p->gen != conn_generation(idx)) p->len = 0;
+
+    int add = (int)strnlen(text, MAX_BUF);
+    bool fits = (p->len == 0 || p->room == r) &&
+                p->len + (p->len > 0) + add < (int)sizeof(p->text);
+
+    if (fits) {
+        if (p->len == 0) {
+            p->room = r;
+            p->lines = 0;
+            p->gen = conn_generation(idx);
+        } else {
+            p->text[p->len++] = '\n';
+        }
+        memcpy(p->text + p->len, text, add);
+        p->len += add;
+        p->text[p->len] = '\0';
+        p->lines++;
+        u->merged++;
+        chat_merged++;
+    } else {
+        p->dropped++;
+        u->rejected++;
+        chat_rejected++;
+    }
+
+    if (!p->warned) {
+        char buf[192];
+        snprintf(buf, sizeof(buf),
+                 "Slow down: chat is limited to %.0f messages/s. Extra lines are merged and "
+                 "sent shortly; lines that do not fit are dropped.", chat_user_rate);
+        send_text(sender_fd, "SERVER", buf);
+        p->warned = true;
+        server_log("chat throttled: %s in #%s", u->name, room_name(r));
+    }
+}
 
-            if (sent < 0) {
-                server_log("Fail Send: socket %d", sd);
-                close(sd);
-                client_sockets[i] = 0;
+/**
+ * 메인 루프 매 턴: 합쳐둔 줄을 토큰이 생긴 만큼 전송
+ * 반환: 다음 전송 가능 시각까지 ms, 남은 게 없으면 -1
+ */
+int chat_limit_tick(void) {
+    int wait_ms = -1;
+
+    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
+        ChatPending *p = &chat_pending[idx];
+        if (p->len == 0) {
+            // 제한 구간이 끝나면 다음에 다시 안내
+            if (p->warned && client_sockets[idx] > 0) {
+                const char *name = get_username(client_sockets[idx]);
+                if (name && bucket_available(&chat_user(name)->bucket) >= 1) p->warned = false;
             }
+            continue;
+        }
+
+        int sd = client_sockets[idx];
+        const char *name = sd > 0 ? get_username(sd) : NULL;
+
+        // 그 사이 끊겼거나 방을 나갔으면 버림
+        if (!name || p->gen != conn_generation(idx) || !room_is_member(p->room, idx)) {
+            p->len = 0;
+            p->dropped = 0;
+            p->warned = false;
+            continue;
         }
+
+        ChatUser *u = chat_user(name);
+        if (chat_take(u, p->room)) {
+            Message msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.type = MSG_CHAT;
+            snprintf(msg.sender, sizeof(msg.sender), "%s", name);
+            memcpy(msg.data, p->text, p->len + 1);
+
+            server_log("chat merged: %s sent %d lines as one message", name, p->lines);
+            p->len = 0;
+            deliver_room_chat(sd, p->room, &msg);
+
+            if (p->dropped > 0) {
+                char buf[96];
+                snprintf(buf, sizeof(buf), "Chat limit: %d line(s) were dropped.", p->dropped);
+                send_text(sd, "SERVER", buf);
+                p->dropped = 0;
+            }
+            continue;
+        }
+
+        int ms = bucket_wait_ms(&u->bucket, 1);
+        int mr = bucket_wait_ms(room_bucket(p->room), 1);
+        if (mr > ms) ms = mr;
+        if (ms < 1) ms = 1;
+        if (wait_ms < 0 || ms < wait_ms) wait_ms = ms;
     }
+
+    return wait_ms;
 }
 
+/**
+ * /chatrate 출력: 한도 + 지금 접속 중인 사용자 중 제한된 적 있는 사람
+ */
+static void chat_limit_stats(char *buf, size_t bufsize) {
+    size_t len = (size_t)snprintf(buf, bufsize,
+        "Chat limit: user %.1f msg/s, room %.1f msg/s (0 = unlimited) | %lu merged, %lu dropped",
+        chat_user_rate, chat_room_rate, chat_merged, chat_rejected);
+
+    for (int k = 0; k < MAX_CLIENTS && len < bufsize; k++) {
+        ChatUser *u = &chat_users[k];
+        if (!u->in_use || (u->merged == 0 && u->rejected == 0)) continue;
+        len += snprintf(buf + len, bufsize - len, "\n- %s: %lu merged, %lu dropped%s",
+                        u->name, u->merged, u->rejected,
+                        find_user_index(u->name) >= 0 ? "" : " (offline)");
+    }
+}
+
+static void chat_limit_set(double user_rate, double room_rate) {
+    chat_user_rate = user_rate;
+    chat_room_rate = room_rate;
+
+    for (int k = 0; k < MAX_CLIENTS; k++) {
+        if (chat_users[k].in_use) {
+            bucket_set_rate(&chat_users[k].bucket, user_rate, user_rate * CHAT_BURST_SEC);
+        }
+    }
+    for (int r = 0; r < MAX_ROOMS; r++) {
+        if (room_bucket_name[r][0]) {
+            bucket_set_rate(&room_buckets[r], room_rate, room_rate * CHAT_BURST_SEC);
+        }
+    }
+    server_log("Chat limits changed: user=%.1f/s, room=%.1f/s", user_rate, room_rate);
+}
 
-/* ===================== root 권한 명령 ===================== */
 
 /**
- * username → client_sockets[] 인덱스 찾기
+ *  일반 채팅: 보낸 사람의 현재 방 멤버에게만 전달
+ *  lobby 가 아닌 방은 본문 앞에 "#방이름" 을 붙여 구분
+ *  사용자/방 한도를 넘으면 합쳐두었다가 chat_limit_tick 에서 전송
  */
-static int find_client_index_by_username(const char *name) {
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (client_sockets[i] > 0 &&
-            strcmp(usernames[i], name) == 0) {
-            return i;
+void send_room_chat(int sender_fd, Message *msg) {
+    int idx = get_client_index(sender_fd);
+    int r = room_current(idx);
+    const char *name = get_username(sender_fd);
+
+    // 로그인 전이면 방에 있어도 거절 (기록/다른 서버로 이름 없이 나가지 않게)
+    if (r < 0 || !name || name[0] == '\0') {
+        send_text(sender_fd, "SERVER", "Login first to chat.");
+        return;
+    }
+
+    ChatUser *u = chat_user(get_username(sender_fd));
+
+    // 먼저 합쳐둔 줄이 있으면 순서가 바뀌지 않게 그 뒤에 붙임
+    ChatPending *p = &chat_pending[idx];
+    bool backlog = p->len > 0 && p->gen == conn_generation(idx);
+
+    if (backlog || !chat_take(u, r)) {
+        chat_defer(idx, sender_fd, u, r, msg->data);
+        return;
+    }
+
+    deliver_room_chat(sender_fd, r, msg);
+}
+
+
+/**
+ *  귓속말: /w <user> <text>
+ *  수신자는 username 해시로 바로 찾고, 그 연결과 보낸 사람에게만 전송
+ *  두 사본 모두 data = "<받는사람> <본문>", sender = 보낸 사람
+ */
+static void handle_direct_message(int sender_fd, const char *sender_name,
+                                  const char *args) {
+    char target[MAX_NAME];
+    int consumed = 0;
+
+    if (sender_name[0] == '\0') {
+        send_text(sender_fd, "SERVER", "Login first to chat.");
+        return;
+    }
+
+    if (sscanf(args, "%19s %n", target, &consumed) != 1 || args[consumed] == '\0') {
+        send_text(sender_fd, "SERVER", "Usage: /w <user> <text>");
+        return;
+    }
+
+    // 귓속말도 같은 사용자 한도 (합치지 않고 바로 거절)
+    ChatUser *u = chat_user(sender_name);
+    if (!bucket_take(&u->bucket, 1)) {
+        u->rejected++;
+        chat_rejected++;
+        send_text(sender_fd, "SERVER", "Slow down: message not sent.");
+        return;
+    }
+
+    int idx = find_user_index(target);
+    bool parked = idx < 0 && session_is_parked(target);
+    if (idx < 0 && !parked) {
+        send_text(sender_fd, "SERVER", "No such user online.");
+        return;
+    }
+
+    Message dm;
+    memset(&dm, 0, sizeof(dm));
+    dm.type = MSG_DIRECT;
+    strncpy(dm.sender, sender_name, sizeof(dm.sender) - 1);
+    snprintf(dm.data, sizeof(dm.data), "%s %.*s",
+             target, MAX_BUF - MAX_NAME - 2, args + consumed);
+
+    // 수신자 연결 큐에만 넣고, 같은 프레임을 보낸 사람에게 에코
+    // (재접속 대기 중이면 세션에 보관했다가 재개 시 전달)
+    OutFrame *f = frame_new(&dm);
+    if (parked) {
+        session_capture(f, NULL, target);
+    } else {
+        queue_frame(idx, f);
+    }
+    if (parked || client_sockets[idx] != sender_fd) {
+        queue_frame(get_client_index(sender_fd), f);
+    }
+    frame_release(f);
+
+    server_log("DM: %s -> %s", sender_name, target);
+}
+
+
+/* ===================== 방 명령 (모든 사용자) ===================== */
+
+/**
+ * /join /leave /rooms 처리
+ * 반환: 처리했으면 true
+ */
+static bool handle_room_command(int sender_fd, const char *text) {
+    int idx = get_client_index(sender_fd);
+    char buf[MAX_BUF];
+
+    if (strncmp(text, "/join ", 6) == 0) {
+        const char *user = get_username(sender_fd);
+        if (!user || user[0] == '\0') {
+            send_text(sender_fd, "SERVER", "Login first to chat.");
+            return true;
+        }
+
+        const char *name = text + 6;
+        int r = room_join(idx, name);
+
+        if (r == -2) {
+            send_text(sender_fd, "SERVER", "Too many rooms.");
+        } else if (r < 0) {
+            send_text(sender_fd, "SERVER", "Invalid room name (a-z, 0-9, -, _).");
+        } else {
+            snprintf(buf, sizeof(buf), "Joined #%s (now chatting here).", name);
+            send_text(sender_fd, "SERVER", buf);
+            server_log("%s joined #%s", get_username(sender_fd), name);
+        }
+        return true;
+    }
+
+    if (strcmp(text, "/leave") == 0 || strncmp(text, "/leave ", 7) == 0) {
+        int cur = room_current(idx);
+        const char *name = (text[6] == ' ') ? text + 7 : room_name(cur);
+        if (!name) name = "";
+
+        int rc = room_leave(idx, name);
+        if (rc == -2) {
+            send_text(sender_fd, "SERVER", "You cannot leave #" DEFAULT_ROOM ".");
+        } else if (rc < 0) {
+            send_text(sender_fd, "SERVER", "You are not in that room.");
+        } else {
+            snprintf(buf, sizeof(buf), "Left #%s (now chatting in #%s).",
+                     name, room_name(room_current(idx)));
+            send_text(sender_fd, "SERVER", buf);
         }
+        return true;
+    }
+
+    if (strcmp(text, "/rooms") == 0) {
+        build_room_list(idx, buf, sizeof(buf));
+        send_text(sender_fd, "SERVER", buf);
+        return true;
     }
-    return -1;
+
+    return false;
 }
 
 
+/* ===================== root 권한 명령 ===================== */
+
 /**
  * root가 특정 유저 강퇴
  */
 static bool kick_user_by_name(const char *target_username) {
-    int idx = find_client_index_by_username(target_username);
+    int idx = find_user_index(target_username);
     if (idx < 0) {
         return false;
     }
@@ -92,6 +498,23 @@ static bool kick_user_by_name(const char *target_username) {
 }
 
 
+/**
+ * 저장 용량 사용량/한도 안내 (MB 단위, 0 = 무제한)
+ */
+static void send_quota(int sender_fd, const char *sender_name) {
+    long user_used, total_used, user_quota, global_quota;
+    catalog_usage(sender_name, &user_used, &total_used);
+    catalog_get_quota(&user_quota, &global_quota);
+
+    char buf[160];
+    snprintf(buf, sizeof(buf),
+             "Storage: you %.1f / %ld MB, server %.1f / %ld MB (0 = unlimited)",
+             user_used / 1048576.0, user_quota / 1048576,
+             total_used / 1048576.0, global_quota / 1048576);
+    send_text(sender_fd, "SERVER", buf);
+}
+
+
 /**
  * 슬래시(/) 명령 처리: /kick /root 등
  */
@@ -100,6 +523,51 @@ static void handle_command(int sender_fd,
                            const char *text,
                            int max_clients) {
 
+    // 로그인 전 연결은 명령 불가 (/search 로 방 기록을 읽는 것 등)
+    const char *name = get_username(sender_fd);
+    if (!name || name[0] == '\0') {
+        send_text(sender_fd, "SERVER", "Login first to chat.");
+        return;
+    }
+
+    if (strncmp(text, "/w ", 3) == 0) {
+        handle_direct_message(sender_fd, sender_name, text + 3);
+        return;
+    }
+
+    if (handle_room_command(sender_fd, text)) {
+        return;
+    }
+
+    // /search [-p page] <words> [from:user] : 로그인한 누구나 방 채팅 기록 검색 (최신순)
+    if (strcmp(text, "/search") == 0 || strncmp(text, "/search ", 8) == 0) {
+        const char *q = text[7] ? text + 8 : "";
+        int page = 1, used = 0;
+        if (sscanf(q, "-p %d %n", &page, &used) == 1 && used > 0) q += used;
+
+        char buf[MAX_BUF];
+        if (history_search(q, page, buf, sizeof(buf)) < 0) {
+            size_t n = strlen(buf);
+            buf[n++] = '\n';
+            history_stats(buf + n, sizeof(buf) - n);
+        }
+        send_text(sender_fd, "SERVER", buf);
+        return;
+    }
+
+    // /push <file> <#room|user...> : 서버의 파일을 여러 사용자에게 한 번에 전송
+    if (strcmp(text, "/push") == 0 || strncmp(text, "/push ", 6) == 0) {
+        handle_file_push(sender_fd, text[5] ? text + 6 : "");
+        return;
+    }
+
+    // /quota : 누구나 자기 사용량 조회, 인자를 주면 root 만 한도 변경
+    if (strcmp(text, "/quota") == 0 ||
+        (strncmp(text, "/quota ", 7) == 0 && !can_kick(sender_fd))) {
+        send_quota(sender_fd, sender_name);
+        return;
+    }
+
     if (!can_kick(sender_fd)) {
         send_text(sender_fd, "SERVER",
                   "\nPermission denied: root only command.");
@@ -149,6 +617,87 @@ static void handle_command(int sender_fd,
                       "Failed to transfer root: user not found.");
         }
     }
+    else if (strcmp(text, "/bw") == 0 || strncmp(text, "/bw ", 4) == 0) {
+        // /bw <user_kbps> <global_kbps>  (0 = 무제한), 인자 없으면 조회
+        long user_kbps, global_kbps;
+        if (text[3] == ' ' &&
+            sscanf(text + 4, "%ld %ld", &user_kbps, &global_kbps) == 2) {
+            set_upload_limits(user_kbps * 1024, global_kbps * 1024);
+        }
+
+        long user_bps, global_bps;
+        get_upload_limits(&user_bps, &global_bps);
+
+        char buf[128];
+        snprintf(buf, sizeof(buf), "Upload limit: user %ld KB/s, global %ld KB/s (0 = unlimited)",
+                 user_bps / 1024, global_bps / 1024);
+        send_text(sender_fd, "SERVER", buf);
+    }
+    else if (strcmp(text, "/cache") == 0) {
+        // 다운로드 캐시 적중률 (캐시 크기 조정용)
+        char buf[256];
+        cache_stats(buf, sizeof(buf));
+        send_text(sender_fd, "SERVER", buf);
+    }
+    else if (strcmp(text, "/sendq") == 0) {
+        // 느린 연결 때문에 버린 채팅/끊은 연결 수
+        char buf[128];
+        conn_stats(buf, sizeof(buf));
+        send_text(sender_fd, "SERVER", buf);
+    }
+    else if (strcmp(text, "/admit") == 0) {
+        // 접속 거절 통계 (만석 / IP 별 속도 초과)
+        char buf[160];
+        admit_stats(buf, sizeof(buf));
+        send_text(sender_fd, "SERVER", buf);
+    }
+    else if (strcmp(text, "/peers") == 0) {
+        // 서버 간 링크 / 연결된 다른 서버
+        char buf[MAX_BUF];
+        peer_stats(buf, sizeof(buf));
+        send_text(sender_fd, "SERVER", buf);
+    }
+    else if (strcmp(text, "/chatrate") == 0 || strncmp(text, "/chatrate ", 10) == 0) {
+        // /chatrate <user_per_sec> <room_per_sec>  (0 = 무제한), 인자 없으면 조회
+        double user_rate, room_rate;
+        if (text[9] == ' ' && sscanf(text + 10, "%lf %lf", &user_rate, &room_rate) == 2 &&
+            user_rate >= 0 && room_rate >= 0) {
+            chat_limit_set(user_rate, room_rate);
+        }
+
+        char buf[MAX_BUF];
+        chat_limit_stats(buf, sizeof(buf));
+        send_text(sender_fd, "SERVER", buf);
+    }
+    else if (strcmp(text, "/heartbeat") == 0) {
+        // PING 설정 + 응답 없음/유휴로 정리한 연결 수
+        char buf[256];
+        heartbeat_stats(buf, sizeof(buf));
+        send_text(sender_fd, "SERVER", buf);
+    }
+    else if (strcmp(text, "/trace") == 0 || strncmp(text, "/trace ", 7) == 0) {
+        // /trace : 지금까지의 구간 기록을 Chrome trace JSON 으로, /trace on|off : 기록 켜기/끄기
+        char buf[320];
+        if (strcmp(text, "/trace on") == 0 || strcmp(text, "/trace off") == 0) {
+            trace_set_enabled(text[8] == 'n');
+            snprintf(buf, sizeof(buf), "Tracing %s.", trace_enabled() ? "enabled" : "disabled");
+        } else {
+            char path[256];
+            int n = trace_dump(path, sizeof(path));
+            if (n < 0) snprintf(buf, sizeof(buf), "Trace dump failed.");
+            else snprintf(buf, sizeof(buf), "Trace: %d events written to %s", n, path);
+            server_log("trace dump by root: %d events", n);
+        }
+        send_text(sender_fd, "SERVER", buf);
+    }
+    else if (strncmp(text, "/quota ", 7) == 0) {
+        // /quota <user_mb> <global_mb>  (0 = 무제한)
+        long user_mb, global_mb;
+        if (sscanf(text + 7, "%ld %ld", &user_mb, &global_mb) == 2) {
+            catalog_set_quota(user_mb * 1024 * 1024, global_mb * 1024 * 1024);
+        }
+        send_quota(sender_fd, sender_name);
+    }
     else {
         send_text(sender_fd, "SERVER", "Unknown command.");
     }
@@ -0,0 +1,590 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "protocol.h"
+#include "server_conn.h"
+#include "server_bucket.h"
+#include "server_io.h"
+#include "server_trace.h"
+#include "server_heartbeat.h"
+
+extern int client_sockets[];
+extern void server_log(const char *fmt, ...);
+extern void drop_client(int idx);
+extern int get_client_index(int socket_fd);
+extern void handle_client_message(int idx, Message *msg);
+extern unsigned file_transfer_id(int idx);
+
+#define FLUSH_IOV_MAX   64     // sendmsg 한 번에 묶는 프레임 수
+#define FRAME_POOL_MAX  256    // 재사용할 프레임 최대 개수
+#define INBUF_FRAMES    8      // recv 한 번에 받을 수 있는 최대 프레임 수
+
+// 연결별 송신 큐 (OutFrame 포인터 링 버퍼)
+typedef struct {
+    OutFrame **frames;
+    int        cap;
+    int        head;
+    int        count;
+    size_t     head_off;       // frames[head] 중 이미 보낸 바이트
+    size_t     pending_bytes;
+    double     first_queued;   // 큐가 비어있다가 처음 채워진 시각
+    bool       blocked;        // 소켓 버퍼가 가득 차서 EAGAIN
+    bool       shedding;       // HIGH 를 넘어 일반 채팅을 버리는 중
+    double     shed_since;
+    long       skipped;        // 버린 채팅 수 (LOW 아래로 내려가면 요약 전송)
+    bool       evict;          // MAX 초과 → 다음 턴에 연결 끊음
+} OutQueue;
+
+// 진행 중인 송신 요청 (I/O 엔진이 완료할 때까지 iovec/프레임 참조 유지)
+typedef struct {
+    bool          busy;
+    int           idx;
+    unsigned      gen;
+    int           nframes;
+    int           fd;
+    unsigned      trace_id;        // trace 용 요청/전송 ID
+    unsigned      xfer;
+    OutFrame     *frames[FLUSH_IOV_MAX];
+    struct iovec  iov[FLUSH_IOV_MAX];
+    struct msghdr mh;
+} SendReq;
+
+// 수신 버퍼 (프레임이 다 모이면 handle_client_message 로 전달)
+//  recvmsg 로 받으므로 UNIX 소켓의 SCM_RIGHTS fd 도 같이 들어옴 → fds 에 도착 순으로 보관
+typedef struct {
+    char     buf[sizeof(Message) * INBUF_FRAMES];
+    size_t   len;
+    bool     busy;             // recv 진행 중
+    int      idx;
+    unsigned gen;
+    struct iovec  iov;
+    struct msghdr mh;
+    union {
+        char           raw[CMSG_SPACE(sizeof(int) * CONN_MAX_FDS)];
+        struct cmsghdr align;
+    } ctrl;
+    int      fds[CONN_MAX_FDS];
+    int      nfds;
+} InBuf;
+
+static OutQueue outq[MAX_CLIENTS];
+static SendReq  sendreq[MAX_CLIENTS];
+static InBuf    inbuf[MAX_CLIENTS];
+
+// 슬롯이 재사용될 때마다 증가 → 늦게 도착한 완료는 무시
+static unsigned conn_gen[MAX_CLIENTS];
+
+static OutFrame *frame_pool[FRAME_POOL_MAX];
+static int       frame_pool_count = 0;
+
+static int  flush_delay_us = FLUSH_DELAY_US;
+static long load_frames = 0;   // 마지막으로 모두 flush 된 뒤 쌓인 프레임 수
+
+static unsigned long stat_skipped = 0;     // 느린 연결에서 버린 채팅 수
+static unsigned long stat_evicted = 0;     // 느린 연결로 끊은 수
+
+
+/* ===================== 프레임 ===================== */
+
+/**
+ * 프레임 생성 (refs = 1, 호출자가 다 쓰면 frame_release)
+ */
+OutFrame* frame_new(const Message *msg) {
+    OutFrame *f = frame_pool_count > 0 ? frame_pool[--frame_pool_count]
+                                       : malloc(sizeof(OutFrame));
+    if (!f) return NULL;
+
+    f->refs = 1;
+    f->msg = *msg;
+    return f;
+}
+
+void frame_release(OutFrame *f) {
+    if (!f || --f->refs > 0) return;
+
+    if (frame_pool_count < FRAME_POOL_MAX) {
+        frame_pool[frame_pool_count++] = f;
+    } else {
+        free(f);
+    }
+}
+
+
+/* ===================== 송신 큐 ===================== */
+
+void conn_set_flush_delay(int usec) {
+    flush_delay_us = usec > 0 ? usec : 0;
+}
+
+/**
+ * 새 연결 소켓 설정: Nagle 은 끄고 묶음 전송은 직접 (MSG_MORE) 제어
+ */
+void conn_tune_socket(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static bool grow_queue(OutQueue *q) {
+    int new_cap = q->cap ? q->cap * 2 : 16;
+    OutFrame **p = malloc(sizeof(OutFrame *) * new_cap);
+    if (!p) return false;
+
+    for (int k = 0; k < q->count; k++) {
+        p[k] = q->frames[(q->head + k) % q->cap];
+    }
+    free(q->frames);
+
+    q->frames = p;
+    q->cap = new_cap;
+    q->head = 0;
+    return true;
+}
+
+// 큐가 밀렸을 때 버려도 되는 프레임: 사용자 채팅 (서버 안내/귓속말/파일 프레임은 유지)
+static bool frame_droppable(const OutFrame *f) {
+    return f->msg.type == MSG_CHAT && strcmp(f->msg.sender, "SERVER") != 0;
+}
+
+/**
+ * idx 연결의 송신 큐 끝에 프레임 추가 (참조만 늘림, 복사 없음)
+ * 느린 연결은 일반 채팅을 버리고, 상한을 넘으면 다음 턴에 끊도록 표시
+ * (broadcast 도중일 수 있으므로 여기서 바로 끊지 않음)
+ */
+void queue_frame(int idx, OutFrame *f) {
+    if (idx < 0 || idx >= MAX_CLIENTS || !f) return;
+
+    OutQueue *q = &outq[idx];
+    if (q->evict) return;
+
+    if (!q->shedding && q->pending_bytes + sizeof(Message) > SENDQ_HIGH_BYTES) {
+        q->shedding = true;
+        q->shed_since = now_seconds();
+        server_log("slow consumer: socket %d (%zu bytes queued)",
+                   client_sockets[idx], q->pending_bytes);
+    }
+
+    if (q->shedding && frame_droppable(f)) {
+        q->skipped++;
+        stat_skipped++;
+        return;
+    }
+
+    if (q->pending_bytes + sizeof(Message) > SENDQ_MAX_BYTES) {
+        q->evict = true;
+        return;
+    }
+
+    if (q->count == q->cap && !grow_queue(q)) {
+        server_log("queue_frame: out of memory (client %d)", idx);
+        return;
+    }
+
+    if (q->count == 0) q->first_queued = now_seconds();
+
+    q->frames[(q->head + q->count) % q->cap] = f;
+    q->count++;
+    q->pending_bytes += sizeof(Message);
+    f->refs++;
+    load_frames++;
+}
+
+/**
+ * fd 로 메시지 한 개 보내기 (이번 턴이 끝날 때 묶어서 flush)
+ */
+void queue_message(int fd, const Message *msg) {
+    int idx = get_client_index(fd);
+    if (idx < 0) {
+        // 아직 슬롯이 없는 연결 (예: 만석 거절)은 바로 전송
+        if (send(fd, msg, sizeof(Message), MSG_NOSIGNAL) < 0) perror("send");
+        return;
+    }
+
+    OutFrame *f = frame_new(msg);
+    queue_frame(idx, f);
+    frame_release(f);
+}
+
+bool conn_has_pending(int idx) {
+    return outq[idx].count > 0;
+}
+
+bool conn_write_blocked(int idx) {
+    return outq[idx].count > 0 && outq[idx].blocked;
+}
+
+size_t conn_pending_bytes(int idx) {
+    return outq[idx].pending_bytes;
+}
+
+/**
+ * 큐가 LOW 아래로 빠지면 채팅 버리기를 멈추고 몇 개 버렸는지 알림
+ */
+static void end_shedding(int idx) {
+    OutQueue *q = &outq[idx];
+    q->shedding = false;
+    if (q->skipped == 0) return;
+
+    Message note;
+    memset(&note, 0, sizeof(note));
+    note.type = MSG_CHAT;
+    strcpy(note.sender, "SERVER");
+    snprintf(note.data, sizeof(note.data),
+             "%ld messages were skipped because your connection was too slow.", q->skipped);
+    q->skipped = 0;
+
+    OutFrame *f = frame_new(&note);
+    queue_frame(idx, f);
+    frame_release(f);
+}
+
+static void consume(OutQueue *q, size_t sent) {
+    q->pending_bytes -= sent;
+
+    while (sent > 0) {
+        size_t left = sizeof(Message) - q->head_off;
+
+        if (sent < left) {
+            q->head_off += sent;
+            return;
+        }
+
+        sent -= left;
+        frame_release(q->frames[q->head]);
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+        q->head_off = 0;
+    }
+}
+
+static void on_send_done(void *ctx, int res) {
+    SendReq *req = ctx;
+    int idx = req->idx;
+
+    trace_async_end(TR_SOCK_SEND, req->trace_id, req->fd, req->xfer, res);
+
+    for (int k = 0; k < req->nframes; k++) {
+        frame_release(req->frames[k]);
+    }
+    req->busy = false;
+
+    if (req->gen != conn_gen[idx]) return;     // 그 사이 연결이 바뀜
+
+    if (res < 0) {
+        if (res == -EAGAIN || res == -EWOULDBLOCK || res == -EINTR) {
+            outq[idx].blocked = true;          // 쓰기 가능해지면 재시도
+            return;
+        }
+        server_log("Fail Send: socket %d", client_sockets[idx]);
+        drop_client(idx);
+        return;
+    }
+
+    consume(&outq[idx], (size_t)res);
+    if (outq[idx].shedding && outq[idx].pending_bytes <= SENDQ_LOW_BYTES) end_shedding(idx);
+}
+
+/**
+ * 큐에 쌓인 프레임을 sendmsg 한 번으로 전송 (연결당 동시에 하나만)
+ * 프레임이 한 묶음보다 많으면 MSG_MORE 로 코르크 → 나머지는 완료 후 다음 턴에
+ * 반환: 0 = 정상, -1 = 연결 없음
+ */
+int conn_flush(int idx) {
+    OutQueue *q = &outq[idx];
+    SendReq *req = &sendreq[idx];
+    int fd = client_sockets[idx];
+    if (fd <= 0) return -1;
+
+    q->blocked = false;
+    if (q->count == 0 || req->busy) return 0;
+
+    int n = 0;
+    for (int k = 0; k < q->count && n < FLUSH_IOV_MAX; k++) {
+        OutFrame *f = q->frames[(q->head + k) % q->cap];
+        size_t off = (k == 0) ? q->head_off : 0;
+
+        f->refs++;
+        req->frames[n] = f;
+        req->iov[n].iov_base = (char *)&f->msg + off;
+        req->iov[n].iov_len = sizeof(Message) - off;
+        n++;
+    }
+
+    memset(&req->mh, 0, sizeof(req->mh));
+    req->mh.msg_iov = req->iov;
+    req->mh.msg_iovlen = n;
+    req->nframes = n;
+    req->idx = idx;
+    req->gen = conn_gen[idx];
+    req->busy = true;
+
+    int flags = MSG_NOSIGNAL;
+    if (n < q->count) flags |= MSG_MORE;
+
+    req->fd = fd;
+    req->xfer = file_transfer_id(idx);
+    req->trace_id = trace_next_id();
+    trace_async_begin(TR_SOCK_SEND, req->trace_id, fd, req->xfer);
+
+    io_sendmsg(fd, &req->mh, flags, on_send_done, req);
+    return 0;
+}
+
+/**
+ * 이벤트 루프 한 턴의 끝에서 호출
+ *  - 평소: 쌓인 프레임을 연결마다 한 번에 flush
+ *  - 부하 상태: 프레임이 2개 이상인 큐는 flush_delay_us 까지 더 모았다가 flush
+ *    (한 개짜리 대화형 메시지는 항상 즉시)
+ * 반환: 미뤄둔 큐가 있으면 다음 flush 까지 남은 us, 없으면 -1
+ */
+long conn_flush_all(void) {
+    double now = now_seconds();
+    bool under_load = flush_delay_us > 0 && load_frames >= COALESCE_LOAD_FRAMES;
+    long wait_us = -1;
+    long stall_us = -1;
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        OutQueue *q = &outq[i];
+
+        // 상한 초과 / HIGH 위에서 오래 멈춘 연결은 끊음 (세션은 재접속 대기로)
+        if (q->evict || (q->shedding && now - q->shed_since >= SENDQ_STALL_SEC)) {
+            if (client_sockets[i] > 0) {
+                server_log("evicting slow consumer: socket %d (%zu bytes queued, %ld skipped)",
+                           client_sockets[i], q->pending_bytes, q->skipped);
+                stat_evicted++;
+                drop_client(i);
+            }
+            q->evict = false;
+            q->shedding = false;
+            continue;
+        }
+        if (q->shedding) {
+            long us = (long)((q->shed_since + SENDQ_STALL_SEC - now) * 1e6) + 1;
+            if (stall_us < 0 || us < stall_us) stall_us = us;
+        }
+
+        if (q->count == 0 || q->blocked) continue;
+
+        if (under_load && q->count > 1) {
+            double due = q->first_queued + flush_delay_us / 1e6;
+            if (now < due) {
+                long us = (long)((due - now) * 1e6) + 1;
+                if (wait_us < 0 || us < wait_us) wait_us = us;
+                continue;
+            }
+        }
+
+        conn_flush(i);
+    }
+
+    if (wait_us < 0) load_frames = 0;
+    if (stall_us >= 0 && (wait_us < 0 || stall_us < wait_us)) wait_us = stall_us;
+    return wait_us;
+}
+
+/**
+ * 아직 한 바이트도 안 보낸 프레임 순회 (세션 보관용)
+ */
+void conn_foreach_pending(int idx, void (*fn)(OutFrame *f, void *arg), void *arg) {
+    OutQueue *q = &outq[idx];
+
+    for (int k = 0; k < q->count; k++) {
+        if (k == 0 && q->head_off > 0) continue;
+        fn(q->frames[(q->head + k) % q->cap], arg);
+    }
+}
+
+/* ===================== 수신 ===================== */
+
+static void close_fds(InBuf *in) {
+    for (int i = 0; i < in->nfds; i++) close(in->fds[i]);
+    in->nfds = 0;
+}
+
+/**
+ * 받은 SCM_RIGHTS fd 를 대기열에 넣기 (닫힌 연결의 완료이거나 자리가 없으면 바로 닫음)
+ */
+static void collect_fds(InBuf *in, bool keep) {
+    if (in->mh.msg_flags & MSG_CTRUNC) {
+        server_log("recvmsg: control data truncated (socket %d)", client_sockets[in->idx]);
+    }
+
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&in->mh); c; c = CMSG_NXTHDR(&in->mh, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+
+        int n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (int i = 0; i < n; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (keep && in->nfds < CONN_MAX_FDS) in->fds[in->nfds++] = fd;
+            else close(fd);
+        }
+    }
+}
+
+static void on_recv_done(void *ctx, int res) {
+    InBuf *in = ctx;
+    int idx = in->idx;
+
+    in->busy = false;
+    if (res > 0 && in->mh.msg_controllen > 0) collect_fds(in, in->gen == conn_gen[idx]);
+    if (in->gen != conn_gen[idx]) return;      // 닫힌 연결의 늦은 완료
+
+    if (res == -EAGAIN || res == -EWOULDBLOCK || res == -EINTR || res == -ECANCELED) return;
+
+    if (res <= 0) {
+        // 연결 종료/오류
+        int sd = client_sockets[idx];
+        printf("[SERVER] Client %d disconnected\n", sd);
+        server_log("클라이언트 비정상 종료 (socket %d)", sd);
+        drop_client(idx);
+        return;
+    }
+
+    in->len += res;
+
+    // 완성된 프레임만 순서대로 처리 (처리 중 연결이 끊기면 중단)
+    size_t off = 0;
+    unsigned gen = in->gen;
+
+    while (in->len - off >= sizeof(Message)) {
+        Message msg;
+        memcpy(&msg, in->buf + off, sizeof(Message));
+        off += sizeof(Message);
+
+        handle_client_message(idx, &msg);
+        if (conn_gen[idx] != gen) return;
+    }
+
+    memmove(in->buf, in->buf + off, in->len - off);
+    in->len -= off;
+}
+
+/**
+ * 수신 요청 등록
+ *  POSIX: select 가 읽기 가능하다고 알려준 연결에 대해 호출
+ *  io_uring: 매 턴 대기 중인 recv 가 없는 연결에 대해 호출
+ */
+void conn_read(int idx) {
+    InBuf *in = &inbuf[idx];
+    int fd = client_sockets[idx];
+
+    if (fd <= 0 || in->busy || in->len >= sizeof(in->buf)) return;
+
+    in->busy = true;
+    in->idx = idx;
+    in->gen = conn_gen[idx];
+
+    in->iov.iov_base = in->buf + in->len;
+    in->iov.iov_len = sizeof(in->buf) - in->len;
+    memset(&in->mh, 0, sizeof(in->mh));
+    in->mh.msg_iov = &in->iov;
+    in->mh.msg_iovlen = 1;
+    in->mh.msg_control = in->ctrl.raw;
+    in->mh.msg_controllen = sizeof(in->ctrl.raw);
+    io_recvmsg(fd, &in->mh, MSG_CMSG_CLOEXEC, on_recv_done, in);
+}
+
+/**
+ * 이 연결로 넘어온 fd 중 가장 오래된 것 가져가기 (소유권도 같이 넘어감)
+ * 반환: fd, 없으면 -1
+ */
+int conn_take_fd(int idx) {
+    InBuf *in = &inbuf[idx];
+    if (in->nfds == 0) return -1;
+
+    int fd = in->fds[0];
+    in->nfds--;
+    memmove(in->fds, in->fds + 1, in->nfds * sizeof(int));
+    return fd;
+}
+
+/**
+ * 슬롯의 현재 연결 세대 (비동기 작업이 끝났을 때 같은 연결인지 확인용)
+ */
+unsigned conn_generation(int idx) {
+    return conn_gen[idx];
+}
+
+bool conn_recv_busy(int idx) {
+    return inbuf[idx].busy;
+}
+
+/**
+ * 걸어둔 recv 취소 (io_uring, 완료되면 conn_recv_busy 가 false)
+ */
+void conn_cancel_read(int idx) {
+    if (inbuf[idx].busy) io_cancel(&inbuf[idx]);
+}
+
+/**
+ * 보낼 것도, 진행 중인 송신도 없는 상태인지
+ */
+bool conn_idle(int idx) {
+    return outq[idx].count == 0 && !sendreq[idx].busy;
+}
+
+/**
+ * 아직 프레임이 다 안 모인 수신 바이트 꺼내기/넣기 (무중단 재시작 시 인계)
+ * out 은 sizeof(Message) 바이트 이상
+ */
+size_t conn_save_inbuf(int idx, char *out) {
+    size_t len = inbuf[idx].len;
+    if (len > sizeof(Message)) len = sizeof(Message);
+    memcpy(out, inbuf[idx].buf, len);
+    return len;
+}
+
+void conn_restore_inbuf(int idx, const char *data, size_t len) {
+    if (len > sizeof(Message)) len = sizeof(Message);
+    memcpy(inbuf[idx].buf, data, len);
+    inbuf[idx].len = len;
+}
+
+/**
+ * 새 연결이 슬롯을 차지할 때 호출
+ */
+void conn_open(int idx) {
+    conn_gen[idx]++;
+    inbuf[idx].len = 0;
+    close_fds(&inbuf[idx]);
+    outq[idx].blocked = false;
+    heartbeat_open(idx);
+}
+
+/**
+ * 연결 종료 시 큐 비우기
+ */
+void conn_reset(int idx) {
+    OutQueue *q = &outq[idx];
+
+    conn_gen[idx]++;               // 진행 중인 송수신 완료는 이후 무시
+    inbuf[idx].len = 0;
+    close_fds(&inbuf[idx]);        // 쓰지 않고 끊긴 fd
+    heartbeat_close(idx);
+
+    while (q->count > 0) {
+        frame_release(q->frames[q->head]);
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+    }
+
+    q->head = 0;
+    q->head_off = 0;
+    q->pending_bytes = 0;
+    q->blocked = false;
+    q->shedding = false;
+    q->skipped = 0;
+    q->evict = false;
+}
+
+void conn_stats(char *buf, size_t bufsize) {
+    snprintf(buf, bufsize, "Send queues: %lu chat messages skipped, %lu slow clients evicted",
+             stat_skipped, stat_evicted);
+}
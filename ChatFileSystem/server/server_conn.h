@@ -0,0 +1,55 @@
+#ifndef SERVER_CONN_H
+#define SERVER_CONN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "protocol.h"
+
+// 한 번 인코딩해서 여러 연결의 송신 큐가 같이 참조하는 프레임
+typedef struct {
+    int     refs;
+    Message msg;
+} OutFrame;
+
+// 기본 마이크로 지연 (부하가 있을 때만 적용, 0이면 매 턴 즉시 flush)
+#define FLUSH_DELAY_US       200
+// 한 턴에 이만큼 이상 프레임이 쌓이면 "부하 상태"로 보고 지연 허용
+#define COALESCE_LOAD_FRAMES 32
+
+// 연결별 송신 큐 상한 (안 읽는 클라이언트 때문에 메모리가 늘지 않게)
+//  HIGH 를 넘으면 일반 채팅은 버리고 개수만 셈 → LOW 아래로 빠지면 요약 한 줄 전송
+//  HIGH 위에 SENDQ_STALL_SEC 넘게 머물거나 MAX 를 넘으면 연결 끊음
+#define SENDQ_HIGH_BYTES  (256 * 1024)
+#define SENDQ_LOW_BYTES   (128 * 1024)
+#define SENDQ_MAX_BYTES   (1024 * 1024)
+#define SENDQ_STALL_SEC   30
+
+// UNIX 소켓으로 받아 두었다가 MSG_FILE_UPLOAD_FD 가 가져가는 fd 수 (넘치면 닫음)
+#define CONN_MAX_FDS      4
+
+OutFrame* frame_new(const Message *msg);
+void   frame_release(OutFrame *f);
+
+void   conn_set_flush_delay(int usec);
+void   conn_tune_socket(int fd);
+void   queue_frame(int idx, OutFrame *f);
+void   queue_message(int fd, const Message *msg);
+bool   conn_has_pending(int idx);
+bool   conn_write_blocked(int idx);
+size_t conn_pending_bytes(int idx);
+int    conn_flush(int idx);
+long   conn_flush_all(void);
+void   conn_reset(int idx);
+void   conn_open(int idx);
+void   conn_read(int idx);
+bool   conn_recv_busy(int idx);
+int    conn_take_fd(int idx);
+unsigned conn_generation(int idx);
+void   conn_cancel_read(int idx);
+bool   conn_idle(int idx);
+size_t conn_save_inbuf(int idx, char *out);
+void   conn_restore_inbuf(int idx, const char *data, size_t len);
+void   conn_stats(char *buf, size_t bufsize);
+void   conn_foreach_pending(int idx, void (*fn)(OutFrame *f, void *arg), void *arg);
+
+#endif
@@ -1,31 +1,58 @@
+#define _GNU_SOURCE     // fallocate
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include "protocol.h"
+#include "delta.h"
+#include "server_auth.h"
+#include "server_catalog.h"
+#include "server_bucket.h"
+#include "server_conn.h"
+#include "server_io.h"
+#include "server_cache.h"
+#include "server_upgrade.h"
+#include "server_trace.h"
+#include "server_room.h"
+#include "server_session.h"
 
 extern void server_log(const char *fmt, ...);
+extern int client_sockets[];
 
 // 서버 파일 저장 디렉토리
 #define STORAGE_DIR "./server/server_storage/"
 
 // 삭제 타이머 스레드에 넘길 인자 구조체
 typedef struct {
+    char filename[256];
     char filepath[512];
     int ttl_seconds;
+    time_t expire_at;        // 카탈로그의 만료시각과 같을 때만 삭제
 } DeleteTaskArgs;
 
 // 일정 시간 후 파일 삭제하는 스레드 함수
 static void* delete_file_after_delay(void *arg) {
     DeleteTaskArgs *task = (DeleteTaskArgs *)arg;
+    trace_thread_name("ttl timer");
 
     server_log("Timer started for file %s (ttl=%d sec)",
                task->filepath, task->ttl_seconds);
 
     sleep(task->ttl_seconds);
 
+    // 그 사이 같은 이름으로 재업로드됐다면 새 파일은 건드리지 않음
+    if (!catalog_remove_if_expire(task->filename, task->expire_at)) {
+        server_log("Timed-delete: %s was replaced, skip", task->filepath);
+        free(task);
+        return NULL;
+    }
+
     int ret = unlink(task->filepath);
     if (ret == 0) {
         server_log("Timed-delete: removed file %s", task->filepath);
@@ -38,184 +65,1678 @@ static void* delete_file_after_delay(void *arg) {
     return NULL;
 }
 
-ssize_t w;
+/**
+ * expire_at 시각에 파일을 지우는 타이머 스레드 생성
+ */
+static void schedule_delete(const char *filename, time_t expire_at) {
+    DeleteTaskArgs *task = malloc(sizeof(DeleteTaskArgs));
+    if (!task) {
+        server_log("malloc failed for DeleteTaskArgs");
+        return;
+    }
+
+    memset(task, 0, sizeof(*task));
+    snprintf(task->filename, sizeof(task->filename), "%s", filename);
+    snprintf(task->filepath, sizeof(task->filepath),
+             "%s%s", STORAGE_DIR, filename);
+    task->expire_at = expire_at;
+
+    long left = (long)(expire_at - time(NULL));
+    task->ttl_seconds = left > 0 ? (int)left : 0;
+
+    pthread_t tid;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+    int rc = pthread_create(&tid, &attr, delete_file_after_delay, task);
+    pthread_attr_destroy(&attr);
+
+    if (rc != 0) {
+        server_log("Failed to create delete timer thread for %s (rc=%d)", filename, rc);
+        free(task);
+    } else {
+        server_log("Delete timer thread created for %s", filename);
+    }
+}
+
+static void restore_timer_cb(const CatalogEntry *e, void *arg) {
+    (void)arg;
+    if (e->expire_at > 0) {
+        schedule_delete(e->name, e->expire_at);
+    }
+}
+
+/**
+ * 서버 시작 시 카탈로그 구성 + 남아있는 TTL 타이머 복원
+ */
+void init_file_storage(void) {
+    catalog_init(STORAGE_DIR);
+    catalog_foreach(restore_timer_cb, NULL);
+}
+
+/* ===================== 업로드 흐름 제어 ===================== */
+
+// 클라이언트가 ACK 없이 보낼 수 있는 최대 청크 수
+#define UPLOAD_WINDOW 16
+
+// 기본 대역폭 제한 (bytes/sec, 0이면 무제한) → root 가 /bw 로 변경
+#define UPLOAD_USER_BPS   0
+#define UPLOAD_GLOBAL_BPS 0
+
+// 청크를 모아서 한 번에 쓰는 크기 (페이지 정렬 버퍼, 파일 오프셋도 이 단위로 정렬)
+#define UPLOAD_STAGE_SIZE (64 * 1024)
+#define UPLOAD_STAGE_ALIGN 4096
+
+struct UploadState;
+
+// 비동기 쓰기 요청 (완료될 때까지 모은 청크 데이터를 보관)
+typedef struct WriteReq {
+    struct UploadState *st;
+    int                 len;
+    off_t               dst;       // 델타 복사: 쓸 위치
+    unsigned            trace_id;
+    struct WriteReq    *next;
+    char               *data;      // UPLOAD_STAGE_SIZE, 페이지 정렬
+} WriteReq;
+
+// 델타 업로드: 이전 버전에서 새 파일로 옮길 구간 (메시지 순서대로 위치가 정해짐)
+typedef struct CopyRun {
+    off_t           src;
+    off_t           dst;
+    long            len;
+    struct CopyRun *next;
+} CopyRun;
+
+// 업로드 하나의 상태 (연결 슬롯이 떠나도 진행 중인 쓰기가 끝날 때까지 유지)
+// 데이터는 임시 파일에 쓰고 완료 시 rename → 받는 중인 파일이 목록/다운로드에 노출되지 않음
+typedef struct UploadState {
+    unsigned xfer;        // 전송 ID (trace 용)
+    int   client_fd;
+    int   fd;
+    char  filename[256];
+    char  tmppath[512];
+    char  owner[MAX_NAME];
+    long  filesize;       // 클라이언트가 알린 크기
+    long  allocated;      // fallocate 로 미리 잡은 크기
+    long  received;
+    int   ttl_seconds;
+    int   credits;        // 클라이언트가 아직 보낼 수 있는 청크 수
+    int   bw;             // user_bw[] 인덱스
+    int   refs;           // 슬롯 1 + 진행 중인 쓰기 수
+    int   done;           // 0 = 진행 중, 1 = 완료, -1 = 폐기
+    bool  write_error;
+    WriteReq *stage;      // 채우는 중인 쓰기 버퍼
+    long  stage_off;      // stage 가 쓰일 파일 오프셋
+    int   base_fd;        // 델타 업로드의 이전 버전 (-1 = 일반 업로드)
+    long  base_size;
+    int   block_size;
+    CopyRun *runs, *runs_tail;    // 아직 시작 안 한 복사 (있는 동안 참조 1)
+    long  copy_queued;    // runs 의 남은 바이트
+    int   copy_inflight;
+    long  copied;         // 이전 버전에서 가져온 바이트 (통계)
+    struct UploadState *copy_next;   // copying 목록
+    int   reply_idx;      // fd 업로드: 끝나면 결과를 알릴 연결 (-1 = 일반 업로드)
+    unsigned reply_gen;
+} UploadState;
+
+// 사용자별 대역폭 버킷 (같은 사용자의 여러 연결이 공유)
+typedef struct {
+    int         in_use;
+    int         refs;     // 이 버킷을 쓰는 진행 중 업로드 수
+    char        name[MAX_NAME];
+    TokenBucket bucket;
+} UserBandwidth;
+
+static UploadState  *uploads[MAX_CLIENTS];   // 연결(client_sockets[] 인덱스)별
+static UploadState  *fd_uploads[MAX_CLIENTS];   // 연결별 진행 중인 fd 업로드 (끊겨도 복사는 계속)
+static int           live_transfers = 0;     // 아직 해제 안 된 업로드/다운로드 (쓰기/읽기 진행 중 포함)
+static unsigned      next_xfer = 0;          // 업로드/다운로드 공통 전송 ID
+static UploadState  *copying = NULL;         // 복사할 구간이 남은 델타 업로드
+static WriteReq      *write_pool = NULL;
+static UserBandwidth user_bw[MAX_CLIENTS];
+static TokenBucket   global_bw;
+static bool          global_bw_ready = false;
+static long          user_bps_limit = UPLOAD_USER_BPS;
+static long          global_bps_limit = UPLOAD_GLOBAL_BPS;
+static int           grant_cursor = 0;     // 라운드로빈 시작 위치
+
+static double burst_for(long bps) {
+    // 최소한 한 윈도우는 한 번에 허용해야 진행이 멈추지 않음
+    double burst = bps / 4.0;
+    if (burst < (double)UPLOAD_WINDOW * MAX_BUF) burst = (double)UPLOAD_WINDOW * MAX_BUF;
+    return burst;
+}
+
+static void init_global_bw(void) {
+    if (global_bw_ready) return;
+    bucket_init(&global_bw, global_bps_limit, burst_for(global_bps_limit));
+    global_bw_ready = true;
+}
+
+static int acquire_user_bw(const char *name) {
+    int free_slot = -1;
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (user_bw[i].in_use && strcmp(user_bw[i].name, name) == 0) {
+            user_bw[i].refs++;
+            return i;
+        }
+        if (!user_bw[i].in_use && free_slot < 0) free_slot = i;
+    }
+
+    // 연결 수만큼 슬롯이 있으므로 항상 빈 슬롯이 있음
+    UserBandwidth *u = &user_bw[free_slot];
+    memset(u, 0, sizeof(*u));
+    u->in_use = 1;
+    u->refs = 1;
+    snprintf(u->name, sizeof(u->name), "%s", name);
+    bucket_init(&u->bucket, user_bps_limit, burst_for(user_bps_limit));
+    return free_slot;
+}
+
+static void release_user_bw(int i) {
+    if (i >= 0 && --user_bw[i].refs <= 0) {
+        user_bw[i].in_use = 0;
+    }
+}
+
+static void send_control(int client_fd, int type, const char *text, int data_len) {
+    Message m;
+    memset(&m, 0, sizeof(m));
+    m.type = type;
+    strcpy(m.sender, "SERVER");
+    snprintf(m.data, sizeof(m.data), "%s", text);
+    m.data_len = data_len;
+
+    queue_message(client_fd, &m);
+}
+
+/**
+ * 윈도우가 절반 이하로 줄었으면 토큰이 허용하는 만큼 크레딧 추가
+ * 반환: 새로 준 크레딧 수
+ */
+static int grant_credits(int idx) {
+    UploadState *st = uploads[idx];
+    if (st->credits > UPLOAD_WINDOW / 2) return 0;
+
+    int want = UPLOAD_WINDOW - st->credits;
+    double avail = bucket_available(&user_bw[st->bw].bucket);
+    double g = bucket_available(&global_bw);
+    if (g < avail) avail = g;
+
+    // 전체 한도가 병목일 때 한 연결이 토큰을 독식하지 않도록 반 윈도우씩
+    int n = (avail / MAX_BUF >= want) ? want : (int)(avail / MAX_BUF);
+    if (global_bps_limit > 0 && n > UPLOAD_WINDOW / 2) n = UPLOAD_WINDOW / 2;
+    if (n <= 0) return 0;
+
+    bucket_take(&user_bw[st->bw].bucket, (double)n * MAX_BUF);
+    bucket_take(&global_bw, (double)n * MAX_BUF);
+    st->credits += n;
+    return n;
+}
+
+static WriteReq* write_req_get(void) {
+    WriteReq *req = write_pool;
+    if (req) {
+        write_pool = req->next;
+        return req;
+    }
+
+    req = malloc(sizeof(WriteReq));
+    if (!req) return NULL;
+    if (posix_memalign((void **)&req->data, UPLOAD_STAGE_ALIGN, UPLOAD_STAGE_SIZE) != 0) {
+        free(req);
+        return NULL;
+    }
+    return req;
+}
+
+static void write_req_put(WriteReq *req) {
+    req->next = write_pool;
+    write_pool = req;
+}
+
+/**
+ * fd 업로드 결과를 요청한 연결에 알림 (그 사이 끊겼으면 생략)
+ */
+static void reply_fd_upload(UploadState *st, bool ok) {
+    int idx = st->reply_idx;
+    if (idx < 0) return;
+
+    if (fd_uploads[idx] == st) fd_uploads[idx] = NULL;
+    if (client_sockets[idx] <= 0 || conn_generation(idx) != st->reply_gen) return;
+
+    if (ok) {
+        char text[300];
+        snprintf(text, sizeof(text), "%s %ld", st->filename, st->received);
+        send_control(client_sockets[idx], MSG_FILE_UPLOAD_FD, text, 0);
+    } else {
+        send_control(client_sockets[idx], MSG_ERROR, "UPLOAD_FAILED", 0);
+    }
+}
+
+/**
+ * 마지막 참조가 풀릴 때 (모든 쓰기 완료 후) 파일 닫고 결과 반영
+ */
+static void release_upload(UploadState *st) {
+    if (--st->refs > 0) return;
+
+    if (st->stage) write_req_put(st->stage);
+    if (st->base_fd >= 0) close(st->base_fd);
+    catalog_unreserve(st->owner, st->filesize);
+
+    bool ok = st->done == 1 && !st->write_error;
+
+    // 알린 크기보다 적게 받았으면 미리 잡아둔 뒷부분 잘라내기
+    if (ok && st->allocated > st->received && ftruncate(st->fd, st->received) < 0) {
+        server_log("ftruncate failed: %s (errno=%d)", st->tmppath, errno);
+        ok = false;
+    }
+    close(st->fd);
+
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s%s", STORAGE_DIR, st->filename);
+
+    if (ok && rename(st->tmppath, filepath) < 0) {
+        server_log("rename failed: %s -> %s (errno=%d)", st->tmppath, filepath, errno);
+        ok = false;
+    }
+
+    if (!ok) {
+        // 중간에 끊긴 업로드는 임시 파일만 지움 (같은 이름의 기존 파일은 그대로)
+        unlink(st->tmppath);
+        server_log("File Upload aborted %s (%ld/%ld bytes)",
+                   st->filename, st->received, st->filesize);
+        reply_fd_upload(st, false);
+        free(st);
+        live_transfers--;
+        return;
+    }
+
+    if (st->reply_idx >= 0) {
+        server_log("File Upload success %s (%ld bytes copied from client fd)",
+                   st->filename, st->received);
+    } else if (st->base_fd >= 0) {
+        server_log("File Upload success %s (%ld bytes, %ld reused from previous version)",
+                   st->filename, st->received, st->copied);
+    } else {
+        server_log("File Upload success %s (%ld bytes send)", st->filename, st->received);
+    }
+
+    // 카탈로그 갱신 (소유자는 로그인된 이름 기준) + 캐시된 이전 내용 폐기
+    time_t expire_at = st->ttl_seconds > 0 ? time(NULL) + st->ttl_seconds : 0;
+    cache_invalidate(st->filename);
+    catalog_put(st->filename, st->received, time(NULL), st->owner, expire_at);
+
+    // 🔥 TTL 자동 삭제 스레드
+    if (st->ttl_seconds > 0) {
+        schedule_delete(st->filename, expire_at);
+    }
+
+    reply_fd_upload(st, true);
+    free(st);
+    live_transfers--;
+}
+
+static void on_write_done(void *ctx, int res) {
+    WriteReq *req = ctx;
+    UploadState *st = req->st;
+
+    trace_async_end(TR_DISK_WRITE, req->trace_id, st->client_fd, st->xfer, res);
+    if (res != req->len) {
+        server_log("File write failed: %s (res=%d)", st->filename, res);
+        st->write_error = true;
+    }
+
+    write_req_put(req);
+    release_upload(st);
+}
+
+/**
+ * 모아둔 버퍼를 정렬된 오프셋에 한 번에 기록 (완료는 on_write_done)
+ */
+static void flush_stage(UploadState *st) {
+    WriteReq *req = st->stage;
+    if (!req) return;
+
+    st->stage = NULL;
+    if (req->len == 0) {
+        write_req_put(req);
+        return;
+    }
+
+    req->st = st;
+    st->refs++;
+    req->trace_id = trace_next_id();
+    trace_async_begin(TR_DISK_WRITE, req->trace_id, st->client_fd, st->xfer);
+    io_write(st->fd, req->data, req->len, st->stage_off, on_write_done, req);
+    st->stage_off += req->len;
+}
+
+/* ----- 델타 업로드: 이전 버전 구간 복사 (읽기 → 쓰기, 업로드당 COPY_INFLIGHT 개씩) ----- */
+
+// 업로드 하나가 동시에 진행하는 복사 청크 수 (청크 = UPLOAD_STAGE_SIZE)
+#define COPY_INFLIGHT       4
+// 이만큼 밀려 있으면 소켓을 읽지 않음 (COPY 메시지 하나가 큰 구간을 가리킬 수 있음)
+#define COPY_BACKLOG_BYTES  (8L * 1024 * 1024)
+
+static void on_copy_write(void *ctx, int res) {
+    WriteReq *req = ctx;
+    req->st->copy_inflight--;
+    on_write_done(ctx, res);
+}
+
+static void on_copy_read(void *ctx, int res) {
+    WriteReq *req = ctx;
+    UploadState *st = req->st;
+
+    trace_async_end(TR_DISK_READ, req->trace_id, st->client_fd, st->xfer, res);
+
+    if (res != req->len) {
+        server_log("Delta base read failed: %s (res=%d)", st->filename, res);
+        st->write_error = true;
+        st->copy_inflight--;
+        write_req_put(req);
+        release_upload(st);
+        return;
+    }
+
+    req->trace_id = trace_next_id();
+    trace_async_begin(TR_DISK_WRITE, req->trace_id, st->client_fd, st->xfer);
+    io_write(st->fd, req->data, req->len, req->dst, on_copy_write, req);
+}
+
+static void drop_runs(UploadState *st) {
+    while (st->runs) {
+        CopyRun *r = st->runs;
+        st->runs = r->next;
+        free(r);
+    }
+    st->runs_tail = NULL;
+    st->copy_queued = 0;
+}
+
+/**
+ * 밀린 복사 구간을 청크로 나눠 시작 (메인 루프 매 턴)
+ * 반환: 아직 바로 시작할 수 있는 복사가 남았으면 true
+ */
+static bool pump_copies(void) {
+    bool more = false;
+    UploadState **pp = &copying;
+
+    while (*pp) {
+        UploadState *st = *pp;
+
+        if (st->done < 0 || st->write_error) drop_runs(st);   // 중단된 업로드
+
+        while (st->runs && st->copy_inflight < COPY_INFLIGHT) {
+            WriteReq *req = write_req_get();
+            if (!req) {
+                st->write_error = true;
+                drop_runs(st);
+                break;
+            }
+
+            CopyRun *r = st->runs;
+            long n = r->len < UPLOAD_STAGE_SIZE ? r->len : UPLOAD_STAGE_SIZE;
+
+            req->st = st;
+            req->len = (int)n;
+            req->dst = r->dst;
+            st->refs++;
+            st->copy_inflight++;
+            req->trace_id = trace_next_id();
+            trace_async_begin(TR_DISK_READ, req->trace_id, st->client_fd, st->xfer);
+            io_read(st->base_fd, req->data, n, r->src, on_copy_read, req);
+
+            r->src += n;
+            r->dst += n;
+            r->len -= n;
+            st->copy_queued -= n;
+            if (r->len == 0) {
+                st->runs = r->next;
+                if (!st->runs) st->runs_tail = NULL;
+                free(r);
+            }
+        }
+
+        if (!st->runs) {
+            // 남은 구간이 없으면 목록에서 빼고 목록이 잡고 있던 참조 해제
+            *pp = st->copy_next;
+            release_upload(st);
+            continue;
+        }
+
+        if (st->copy_inflight < COPY_INFLIGHT) more = true;
+        pp = &st->copy_next;
+    }
+
+    return more;
+}
+
+static void finish_upload(int idx, bool completed) {
+    UploadState *st = uploads[idx];
+    if (!st) return;
+
+    uploads[idx] = NULL;
+    release_user_bw(st->bw);
+    if (completed) flush_stage(st);
+    st->done = completed ? 1 : -1;
+    release_upload(st);
+}
+
 
 /**
  * 파일 업로드 처리
- * MSG_FILE_UPLOAD → MSG_FILE_READY → MSG_FILE_DATA 반복 → MSG_FILE_END
+ * MSG_FILE_UPLOAD → MSG_FILE_READY(data_len = 초기 크레딧)
+ *   → MSG_FILE_DATA 반복 (크레딧 1개당 1청크, MSG_FILE_ACK 로 추가 크레딧)
+ *   → MSG_FILE_END
+ * 청크는 메인 루프에서 한 번에 하나씩 처리되므로 다른 사용자를 막지 않음
  */
 void handle_file_upload(int client_fd, Message *msg) {
     char filename[256];
     long filesize;
     int ttl_seconds = 0;     // 0이면 자동 삭제 없음
+    char mode[8] = "";
+    unsigned long base_gen = 0;
+    int block_size = 0;
 
-    // MSG_FILE_UPLOAD의 data = "filename filesize ttl"
-    int parsed = sscanf(msg->data, "%s %ld %d", filename, &filesize, &ttl_seconds);
-    if (parsed < 2) {
+    int idx = get_client_index(client_fd);
+    if (idx < 0) return;
+
+    // MSG_FILE_UPLOAD의 data = "filename filesize ttl [DELTA gen block_size]"
+    int parsed = sscanf(msg->data, "%255s %ld %d %7s %lu %d", filename, &filesize,
+                        &ttl_seconds, mode, &base_gen, &block_size);
+    bool delta = parsed == 6 && strcmp(mode, "DELTA") == 0;
+    if (parsed < 2 || filesize < 0 ||
+        (delta && (block_size < DELTA_BLOCK_MIN || block_size > DELTA_BLOCK_MAX))) {
         // 형식 잘못된 경우
-        Message err;
-        memset(&err, 0, sizeof(err));
-        err.type = MSG_ERROR;
-        strcpy(err.sender, "SERVER");
-        strcpy(err.data, "BAD_FILE_UPLOAD_FORMAT");
-        write(client_fd, &err, sizeof(err));
+        send_control(client_fd, MSG_ERROR, "BAD_FILE_UPLOAD_FORMAT", 0);
         return;
     }
 
-    server_log("File upload request: %s (%ld bytes)", filename, filesize);
+    // 무중단 재시작 준비 중에는 새 전송을 받지 않음 (새 서버에서 다시 시도)
+    if (upgrade_draining()) {
+        send_control(client_fd, MSG_ERROR, "SERVER_UPGRADING", 0);
+        return;
+    }
 
-    // 저장 경로 구성
-    char filepath[512];
-    sprintf(filepath, "%s%s", STORAGE_DIR, filename);
+    // 같은 연결에서 이전 업로드가 끝나지 않았으면 폐기
+    finish_upload(idx, false);
 
-    FILE *fp = fopen(filepath, "wb");
-    if (!fp) {
-        server_log("Fail File creating: %s", filepath);
+    server_log("File upload request: %s (%ld bytes%s)", filename, filesize,
+               delta ? ", delta" : "");
+
+    // 델타: 서명을 받은 그 버전이 아직 그대로일 때만 (바뀌었으면 클라이언트가 전체 업로드)
+    int base_fd = -1;
+    long base_size = 0;
+    if (delta) {
+        char basepath[512];
+        CatalogEntry base;
+        struct stat sb;
+        snprintf(basepath, sizeof(basepath), "%s%s", STORAGE_DIR, filename);
+
+        if (catalog_lookup(filename, &base) && base.gen == base_gen) {
+            base_fd = open(basepath, O_RDONLY);
+        }
+        if (base_fd >= 0 && fstat(base_fd, &sb) == 0) {
+            base_size = sb.st_size;
+        } else {
+            if (base_fd >= 0) close(base_fd);
+            send_control(client_fd, MSG_ERROR, "DELTA_BASE_CHANGED", 0);
+            return;
+        }
+    }
 
-        Message err;
-        memset(&err, 0, sizeof(err));
-        err.type = MSG_ERROR;
-        strcpy(err.sender, "SERVER");
-        strcpy(err.data, "FILE_OPEN_FAIL");
+    const char *owner = get_username(client_fd);
+    if (!owner || owner[0] == '\0') owner = msg->sender;
 
-        w = write(client_fd, &err, sizeof(err));
-        if (w < 0) perror("write");
+    // 알린 크기로 용량 한도 확인 → 넘으면 데이터를 받기 전에 거절
+    int quota = catalog_reserve(owner, filename, filesize);
+    if (quota != QUOTA_OK) {
+        server_log("Upload rejected by quota: %s (%ld bytes, %s)", filename, filesize,
+                   quota == QUOTA_USER ? "user" : "global");
+        send_control(client_fd, MSG_ERROR,
+                     quota == QUOTA_USER ? "QUOTA_EXCEEDED" : "STORAGE_FULL", 0);
+        if (base_fd >= 0) close(base_fd);
         return;
     }
 
-    // 🔹 1) READY 전송
-    Message ready;
-    memset(&ready, 0, sizeof(ready));
-    ready.type = MSG_FILE_READY;
-    strcpy(ready.sender, "SERVER");
+    // 임시 파일 경로 (숨김 파일이라 카탈로그 스캔에서 제외, 연결별로 구분)
+    char tmppath[512];
+    snprintf(tmppath, sizeof(tmppath), "%s.%d.%s%s",
+             STORAGE_DIR, idx, filename, UPLOAD_TMP_SUFFIX);
 
-    w = write(client_fd, &ready, sizeof(ready));
-    if (w < 0) perror("write");
+    int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        server_log("Fail File creating: %s", tmppath);
+        catalog_unreserve(owner, filesize);
+        send_control(client_fd, MSG_ERROR, "FILE_OPEN_FAIL", 0);
+        if (base_fd >= 0) close(base_fd);
+        return;
+    }
 
-    long received = 0;
+    // 알린 크기만큼 미리 할당 → 연속된 extent, 쓰는 동안 블록 할당/메타데이터 갱신 없음
+    long allocated = 0;
+    if (filesize > 0) {
+        if (fallocate(fd, 0, 0, filesize) == 0) {
+            allocated = filesize;
+        } else if (errno == ENOSPC || errno == EFBIG) {
+            server_log("No space for upload: %s (%ld bytes)", filename, filesize);
+            close(fd);
+            unlink(tmppath);
+            catalog_unreserve(owner, filesize);
+            send_control(client_fd, MSG_ERROR, "NO_SPACE", 0);
+            if (base_fd >= 0) close(base_fd);
+            return;
+        } else {
+            // 지원하지 않는 파일시스템이면 그냥 순차 기록
+            server_log("fallocate unsupported for %s (errno=%d)", tmppath, errno);
+        }
+    }
 
-    // 🔹 2) 파일 청크 수신
-    while (1) {
-        Message chunk;
-        int len = read(client_fd, &chunk, sizeof(chunk));
-        if (len <= 0) break;
+    init_global_bw();
 
-        if (chunk.type == MSG_FILE_END) {
-            server_log("Sending File Upload exit signal: %s", filename);
-            break;
+    UploadState *st = calloc(1, sizeof(UploadState));
+    if (!st) {
+        close(fd);
+        unlink(tmppath);
+        catalog_unreserve(owner, filesize);
+        send_control(client_fd, MSG_ERROR, "FILE_OPEN_FAIL", 0);
+        if (base_fd >= 0) close(base_fd);
+        return;
+    }
+
+    st->xfer = ++next_xfer;
+    st->client_fd = client_fd;
+    st->fd = fd;
+    st->refs = 1;
+    st->filesize = filesize;
+    st->allocated = allocated;
+    st->ttl_seconds = ttl_seconds;
+    st->base_fd = base_fd;
+    st->base_size = base_size;
+    st->block_size = block_size;
+    st->reply_idx = -1;
+    snprintf(st->filename, sizeof(st->filename), "%s", filename);
+    snprintf(st->tmppath, sizeof(st->tmppath), "%s", tmppath);
+    snprintf(st->owner, sizeof(st->owner), "%s", owner);
+    st->bw = acquire_user_bw(st->owner);
+    uploads[idx] = st;
+    live_transfers++;
+
+    // 🔹 1) READY 전송 (토큰이 없으면 크레딧 0 → 이후 ACK 로 지급)
+    grant_credits(idx);
+    send_control(client_fd, MSG_FILE_READY, filename, st->credits);
+}
+
+/**
+ * 🔹 2) 파일 청크 수신 (메인 루프에서 청크 하나마다 호출)
+ * UPLOAD_STAGE_SIZE 만큼 모이면 쓰기는 I/O 엔진에 맡기고 바로 반환
+ */
+void handle_file_data(int client_fd, Message *msg) {
+    int idx = get_client_index(client_fd);
+    if (idx < 0 || !uploads[idx]) {
+        server_log("Unexpected MSG_FILE_DATA (socket %d)", client_fd);
+        return;
+    }
+
+    UploadState *st = uploads[idx];
+
+    int len = msg->data_len;
+    if (len < 0) len = 0;
+    if (len > MAX_BUF) len = MAX_BUF;
+
+    st->credits--;
+    if (len == 0) return;
+
+    // 알린 크기를 넘는 데이터는 받지 않음 (용량 예약은 알린 크기 기준)
+    if (st->received + len > st->filesize) {
+        server_log("Upload exceeds announced size: %s", st->filename);
+        finish_upload(idx, false);
+        send_control(client_fd, MSG_ERROR, "UPLOAD_SIZE_EXCEEDED", 0);
+        return;
+    }
+
+    st->received += len;
+
+    // 청크는 버퍼에 모으고 다음 UPLOAD_STAGE_SIZE 경계까지 차면 한 번에 기록
+    // (경계를 넘는 나머지는 새 버퍼로 → 이후 쓰기도 경계 단위로 정렬 유지)
+    const char *src = msg->data;
+    while (len > 0) {
+        if (!st->stage) {
+            st->stage = write_req_get();
+            if (!st->stage) {
+                st->write_error = true;
+                return;
+            }
+            st->stage->len = 0;
         }
 
-        if (chunk.type == MSG_FILE_DATA) {
-            fwrite(chunk.data, 1, chunk.data_len, fp);
-            received += chunk.data_len;
+        int room = UPLOAD_STAGE_SIZE - (int)(st->stage_off % UPLOAD_STAGE_SIZE) - st->stage->len;
+        int n = len < room ? len : room;
+        memcpy(st->stage->data + st->stage->len, src, n);
+        st->stage->len += n;
+        src += n;
+        len -= n;
+
+        if (n == room) flush_stage(st);
+    }
+}
+
+/**
+ * 델타 업로드: 이전 버전의 블록 범위를 새 파일의 현재 위치에 이어붙임
+ * (실제 복사는 pump_copies 가 나눠서, 여기서는 위치만 정하고 대기열에)
+ */
+void handle_file_copy(int client_fd, Message *msg) {
+    int idx = get_client_index(client_fd);
+    if (idx < 0 || !uploads[idx] || uploads[idx]->base_fd < 0) {
+        server_log("Unexpected MSG_FILE_COPY (socket %d)", client_fd);
+        return;
+    }
+
+    UploadState *st = uploads[idx];
+    st->credits--;
+
+    int nruns = msg->data_len / DELTA_RUN_SIZE;
+    if (nruns < 0 || nruns > DELTA_RUNS_PER_MSG) nruns = 0;
+
+    // 앞서 모아둔 새 데이터를 먼저 내보내야 복사 위치가 정해짐
+    flush_stage(st);
+
+    for (int k = 0; k < nruns; k++) {
+        uint32_t block, count;
+        memcpy(&block, msg->data + k * DELTA_RUN_SIZE, 4);
+        memcpy(&count, msg->data + k * DELTA_RUN_SIZE + 4, 4);
+
+        off_t src = (off_t)block * st->block_size;
+        long len = (long)count * st->block_size;
+        if (src + len > st->base_size) len = st->base_size - src;   // 마지막 블록은 짧을 수 있음
+
+        if (count == 0 || len <= 0 || st->received + len > st->filesize) {
+            server_log("Bad delta range for %s (block %u x %u)", st->filename, block, count);
+            finish_upload(idx, false);
+            send_control(client_fd, MSG_ERROR, "UPLOAD_SIZE_EXCEEDED", 0);
+            return;
+        }
+
+        CopyRun *r = malloc(sizeof(CopyRun));
+        if (!r) {
+            st->write_error = true;
+            return;
         }
+        r->src = src;
+        r->dst = st->stage_off;
+        r->len = len;
+        r->next = NULL;
+
+        // 남은 구간이 없던 업로드면 복사 목록에 올리고 참조 하나 (목록 ⇔ runs 있음)
+        if (!st->runs) {
+            st->runs = r;
+            st->refs++;
+            st->copy_next = copying;
+            copying = st;
+        } else {
+            st->runs_tail->next = r;
+        }
+        st->runs_tail = r;
+
+        st->copy_queued += len;
+        st->copied += len;
+        st->received += len;
+        st->stage_off += len;
     }
+}
+
+/**
+ * 로컬(UNIX 소켓) 업로드: 클라이언트가 SCM_RIGHTS 로 넘긴 fd 에서 서버가 직접 읽음
+ * MSG_FILE_UPLOAD_FD(data = "filename ttl") → 복사가 끝나면 MSG_FILE_UPLOAD_FD / MSG_ERROR
+ * 파일 전체를 델타 복사 구간 하나로 보고 pump_copies 로 나눠 읽기/쓰기 (청크 프레임 없음)
+ * 같은 호스트의 복사라 대역폭 제한은 적용하지 않음, 연결당 하나씩
+ */
+void handle_file_upload_fd(int client_fd, Message *msg) {
+    char filename[256];
+    int ttl_seconds = 0;
 
-    fclose(fp);
+    int idx = get_client_index(client_fd);
+    if (idx < 0) return;
 
-    server_log("File Upload success %s (%ld bytes send)", filename, received);
+    // 프레임과 같이 온 fd 는 어떤 경우든 여기서 가져감 (거절하면 닫음)
+    int src = conn_take_fd(idx);
 
-    // 🔥 TTL 자동 삭제 스레드
-    if (ttl_seconds > 0) {
-        DeleteTaskArgs *task = malloc(sizeof(DeleteTaskArgs));
-        if (task) {
-            memset(task, 0, sizeof(*task));
-            snprintf(task->filepath, sizeof(task->filepath),
-                     "%s%s", STORAGE_DIR, filename);
-            task->ttl_seconds = ttl_seconds;
-
-            pthread_t tid;
-            pthread_attr_t attr;
-
-            pthread_attr_init(&attr);
-            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
-
-            int rc = pthread_create(&tid, &attr, delete_file_after_delay, task);
-            pthread_attr_destroy(&attr);
-
-            if (rc != 0) {
-                server_log("Failed to create delete timer thread for %s (rc=%d)", filename, rc);
-                free(task);
+    if (sscanf(msg->data, "%255s %d", filename, &ttl_seconds) < 1) {
+        send_control(client_fd, MSG_ERROR, "BAD_FILE_UPLOAD_FORMAT", 0);
+        if (src >= 0) close(src);
+        return;
+    }
+
+    const char *owner = get_username(client_fd);
+    if (!owner || owner[0] == '\0') {
+        send_control(client_fd, MSG_ERROR, "NOT_LOGGED_IN", 0);
+        if (src >= 0) close(src);
+        return;
+    }
+
+    if (src < 0) {
+        send_control(client_fd, MSG_ERROR, "NO_FD", 0);
+        return;
+    }
+
+    // 읽을 수 있는 일반 파일만 (파이프/소켓은 크기를 미리 알 수 없음)
+    struct stat sb;
+    int acc = fcntl(src, F_GETFL);
+    if (fstat(src, &sb) < 0 || !S_ISREG(sb.st_mode) || acc < 0 || (acc & O_ACCMODE) == O_WRONLY) {
+        send_control(client_fd, MSG_ERROR, "BAD_FD", 0);
+        close(src);
+        return;
+    }
+
+    if (upgrade_draining()) {
+        send_control(client_fd, MSG_ERROR, "SERVER_UPGRADING", 0);
+        close(src);
+        return;
+    }
+
+    if (fd_uploads[idx] && fd_uploads[idx]->reply_gen == conn_generation(idx)) {
+        send_control(client_fd, MSG_ERROR, "UPLOAD_IN_PROGRESS", 0);
+        close(src);
+        return;
+    }
+
+    long filesize = sb.st_size;
+    server_log("File upload request: %s (%ld bytes, local fd)", filename, filesize);
+
+    int quota = catalog_reserve(owner, filename, filesize);
+    if (quota != QUOTA_OK) {
+        server_log("Upload rejected by quota: %s (%ld bytes, %s)", filename, filesize,
+                   quota == QUOTA_USER ? "user" : "global");
+        send_control(client_fd, MSG_ERROR,
+                     quota == QUOTA_USER ? "QUOTA_EXCEEDED" : "STORAGE_FULL", 0);
+        close(src);
+        return;
+    }
+
+    // 연결이 끊겨도 복사는 계속되므로 슬롯 번호 대신 전송 ID 로 임시 파일 구분
+    unsigned xfer = ++next_xfer;
+    char tmppath[512];
+    snprintf(tmppath, sizeof(tmppath), "%s.fd%u.%s%s",
+             STORAGE_DIR, xfer, filename, UPLOAD_TMP_SUFFIX);
+
+    UploadState *st = NULL;
+    CopyRun *r = NULL;
+    int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        st = calloc(1, sizeof(UploadState));
+        r = calloc(1, sizeof(CopyRun));
+    }
+    if (!st || !r) {
+        server_log("Fail File creating: %s", tmppath);
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmppath);
+        }
+        free(st);
+        free(r);
+        catalog_unreserve(owner, filesize);
+        send_control(client_fd, MSG_ERROR, "FILE_OPEN_FAIL", 0);
+        close(src);
+        return;
+    }
+
+    long allocated = 0;
+    if (filesize > 0) {
+        if (fallocate(fd, 0, 0, filesize) == 0) {
+            allocated = filesize;
+        } else if (errno == ENOSPC || errno == EFBIG) {
+            server_log("No space for upload: %s (%ld bytes)", filename, filesize);
+            close(fd);
+            unlink(tmppath);
+            free(st);
+            free(r);
+            catalog_unreserve(owner, filesize);
+            send_control(client_fd, MSG_ERROR, "NO_SPACE", 0);
+            close(src);
+            return;
+        }
+    }
+
+    st->xfer = xfer;
+    st->client_fd = client_fd;
+    st->fd = fd;
+    st->refs = 1;
+    st->bw = -1;
+    st->filesize = filesize;
+    st->allocated = allocated;
+    st->ttl_seconds = ttl_seconds;
+    st->base_fd = src;
+    st->base_size = filesize;
+    st->reply_idx = idx;
+    st->reply_gen = conn_generation(idx);
+    snprintf(st->filename, sizeof(st->filename), "%s", filename);
+    snprintf(st->tmppath, sizeof(st->tmppath), "%s", tmppath);
+    snprintf(st->owner, sizeof(st->owner), "%s", owner);
+    fd_uploads[idx] = st;
+    live_transfers++;
+
+    // 받을 데이터가 더 없으므로 처음부터 완료 상태, 복사가 끝나면 release_upload 에서 반영
+    st->received = st->stage_off = filesize;
+    st->done = 1;
+
+    if (filesize > 0) {
+        r->len = filesize;
+        st->runs = st->runs_tail = r;
+        st->copy_queued = filesize;
+        st->copied = filesize;
+        st->refs++;
+        st->copy_next = copying;
+        copying = st;
+    } else {
+        free(r);
+    }
+
+    release_upload(st);
+}
+
+/**
+ * 🔹 3) 업로드 종료
+ */
+void handle_file_end(int client_fd, Message *msg) {
+    int idx = get_client_index(client_fd);
+    if (idx < 0 || !uploads[idx]) {
+        server_log("Unexpected MSG_FILE_END (socket %d)", client_fd);
+        return;
+    }
+
+    server_log("Sending File Upload exit signal: %s", uploads[idx]->filename);
+    finish_upload(idx, true);
+}
+
+
+/**
+ * 크레딧을 다 쓴 업로드 연결은 읽지 않음 → TCP 레벨에서 송신자가 멈춤
+ */
+bool file_transfer_can_read(int idx) {
+    UploadState *st = uploads[idx];
+    return !(st && (st->credits <= 0 || st->copy_queued > COPY_BACKLOG_BYTES));
+}
+
+/**
+ * 메인 루프 매 턴마다 호출: 라운드로빈으로 크레딧 지급
+ * 반환: 토큰을 기다리는 업로드가 있으면 다음 확인까지 ms, 없으면 -1
+ */
+int file_transfer_tick(void) {
+    int wait_ms = -1;
+
+    for (int k = 0; k < MAX_CLIENTS; k++) {
+        int idx = (grant_cursor + k) % MAX_CLIENTS;
+        UploadState *st = uploads[idx];
+        if (!st) continue;
+
+        int n = grant_credits(idx);
+        if (n > 0) {
+            send_control(st->client_fd, MSG_FILE_ACK, st->filename, n);
+        }
+
+        if (st->credits <= 0) {
+            int wu = bucket_wait_ms(&user_bw[st->bw].bucket, MAX_BUF);
+            int wg = bucket_wait_ms(&global_bw, MAX_BUF);
+            int wt = wu > wg ? wu : wg;
+            if (wt < 1) wt = 1;
+            if (wait_ms < 0 || wt < wait_ms) wait_ms = wt;
+        }
+    }
+
+    grant_cursor = (grant_cursor + 1) % MAX_CLIENTS;
+    return wait_ms;
+}
+
+/**
+ * root 용: 업로드 대역폭 제한 조회/변경 (bytes/sec, 0 = 무제한)
+ */
+void get_upload_limits(long *user_bps, long *global_bps) {
+    *user_bps = user_bps_limit;
+    *global_bps = global_bps_limit;
+}
+
+void set_upload_limits(long user_bps, long global_bps) {
+    init_global_bw();
+
+    user_bps_limit = user_bps > 0 ? user_bps : 0;
+    global_bps_limit = global_bps > 0 ? global_bps : 0;
+
+    bucket_set_rate(&global_bw, global_bps_limit, burst_for(global_bps_limit));
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (user_bw[i].in_use) {
+            bucket_set_rate(&user_bw[i].bucket, user_bps_limit, burst_for(user_bps_limit));
+        }
+    }
+
+    server_log("Upload limits changed: user=%ld B/s, global=%ld B/s",
+               user_bps_limit, global_bps_limit);
+}
+
+
+/* ===================== 다운로드 ===================== */
+
+// 한 턴에 한 연결당 큐에 넣는 최대 청크 수 (다른 연결과 번갈아 처리)
+#define DOWNLOAD_CHUNKS_PER_TURN 16
+// 송신 큐가 이 크기 이하일 때만 다음 청크를 읽음 (메모리 상한)
+#define DOWNLOAD_QUEUE_LIMIT     (64 * 1024)
+
+// 파일을 한 번에 읽는 크기 (청크 여러 개 분량)
+#define DOWNLOAD_READ_SIZE       (16 * 1024)
+
+// 다운로드 하나의 상태 (읽기가 진행 중이면 끝날 때까지 유지)
+typedef struct {
+    unsigned xfer;
+    unsigned read_id;     // 진행 중인 읽기 (trace 용)
+    int   client_fd;
+    int   fd;
+    char  filename[256];
+    long  size;           // 카탈로그 크기
+    long  sent;           // 큐에 넣은 바이트
+    off_t read_off;       // 다음 읽기 위치
+    int   refs;           // 슬롯 1 + 진행 중인 읽기
+    bool  reading;
+    bool  eof;
+    char *data;           // 보낼 데이터 (buf 또는 캐시 항목)
+    long  buf_len;
+    long  buf_pos;
+    CacheEntry *cached;   // 캐시에서 보내는 중 (fd 없음)
+    CacheEntry *fill;     // 읽으면서 캐시를 채우는 중
+    int   sig_block;      // 델타 서명 전송 중이면 블록 크기 (데이터 대신 서명을 보냄)
+    long  read_len;       // 한 번에 읽는 크기 (서명 모드는 블록 크기의 배수)
+    char  buf[DOWNLOAD_READ_SIZE];
+} DownloadState;
+
+static DownloadState *downloads[MAX_CLIENTS];
+
+// 푸시: 한 파일을 여러 수신자에게 한 번에 (읽기 한 번 + 인코딩한 프레임을 수신자들이 공유)
+//  가장 느린 수신자의 송신 큐에 맞춰 진행, 중간에 끊긴 수신자만 빠짐
+typedef struct {
+    DownloadState *src;                  // 읽기/캐시 쪽은 다운로드와 같은 상태를 그대로 사용
+    char  from[MAX_NAME];
+    bool  member[MAX_CLIENTS];           // client_sockets[] 인덱스
+    int   count;
+    int   total;                         // 시작할 때 수신자 수 (로그용)
+} PushState;
+
+static PushState *pushes[MAX_CLIENTS];   // 진행 중인 푸시 (수신자가 1명 이상이라 연결 수를 넘지 않음)
+static PushState *push_of[MAX_CLIENTS];  // 수신자 → 받고 있는 푸시
+
+static void release_download(DownloadState *st) {
+    if (--st->refs > 0) return;
+    if (st->fd >= 0) close(st->fd);
+    cache_release(st->cached);
+    cache_release(st->fill);      // 다 못 채운 항목은 버림
+    free(st);
+    live_transfers--;
+}
+
+static void finish_download(int idx, bool completed) {
+    DownloadState *st = downloads[idx];
+    if (!st) return;
+
+    downloads[idx] = NULL;
+
+    // 서명 전송은 클라이언트가 블록 수로 끝을 앎
+    if (st->sig_block) {
+        if (!completed) server_log("Delta signatures aborted %s", st->filename);
+        release_download(st);
+        return;
+    }
+
+    if (!completed) {
+        server_log("File Download aborted %s (%ld bytes sent)", st->filename, st->sent);
+        release_download(st);
+        return;
+    }
+
+    catalog_mark_download(st->filename);
+
+    // 🔹 3) 파일 전송 완료 메시지
+    Message end;
+    memset(&end, 0, sizeof(end));
+    end.type = MSG_FILE_END;
+    strcpy(end.sender, "SERVER");
+    snprintf(end.data, sizeof(end.data), "%s", st->filename);
+    end.data_len = 0;
+
+    queue_message(st->client_fd, &end);
+
+    server_log("Success File Download: %s", st->filename);
+    release_download(st);
+}
+
+static void on_read_done(void *ctx, int res) {
+    DownloadState *st = ctx;
+
+    trace_async_end(TR_DISK_READ, st->read_id, st->client_fd, st->xfer, res);
+    st->reading = false;
+    if (res > 0) {
+        // 캐시 채우기 (카탈로그 크기보다 커지면 포기)
+        if (st->fill) {
+            if (st->read_off + res <= st->fill->size) {
+                memcpy(st->fill->data + st->read_off, st->buf, res);
             } else {
-                server_log("Delete timer thread created for %s", filename);
+                cache_release(st->fill);
+                st->fill = NULL;
             }
+        }
 
-        } else {
-            server_log("malloc failed for DeleteTaskArgs");
+        st->buf_len = res;
+        st->buf_pos = 0;
+        st->read_off += res;
+    } else {
+        if (res < 0) server_log("File read failed: %s (res=%d)", st->filename, res);
+        st->eof = true;
+
+        // 끝까지 정상적으로 읽었으면 다음 다운로드부터 메모리에서 전송
+        if (st->fill && res == 0 && st->read_off == st->fill->size) {
+            cache_fill_commit(st->fill);
+            st->fill = NULL;
         }
     }
+
+    release_download(st);
 }
 
 
+/**
+ * 저장된 파일을 보낼 준비 (캐시에 있으면 메모리, 없으면 fd + 읽으면서 캐시 채우기)
+ * 반환: 카탈로그/디스크에 없거나 메모리가 없으면 NULL
+ */
+static DownloadState* open_download(const char *filename, int client_fd) {
+    char filepath[512];
+    snprintf(filepath, sizeof(filepath), "%s%s", STORAGE_DIR, filename);
+
+    // 카탈로그에 없으면 open 없이 바로 NOFILE (TTL 로 지워졌으면 캐시도 정리)
+    CatalogEntry entry;
+    CacheEntry *cached = NULL;
+    int fd = -1;
+
+    if (catalog_lookup(filename, &entry)) {
+        // 최근에 받아간 파일이면 디스크를 거치지 않고 메모리에서
+        cached = cache_get(filename, entry.gen);
+        if (!cached) {
+            fd = open(filepath, O_RDONLY);
+            if (fd < 0) catalog_remove(filename);   // 외부에서 지워진 경우 정리
+        }
+    } else {
+        cache_invalidate(filename);
+    }
+
+    if (!cached && fd < 0) {
+        server_log("There are no file in directory: %s", filename);
+        return NULL;
+    }
+
+    DownloadState *st = calloc(1, sizeof(DownloadState));
+    if (!st) {
+        if (fd >= 0) close(fd);
+        cache_release(cached);
+        return NULL;
+    }
+
+    st->xfer = ++next_xfer;
+    st->client_fd = client_fd;
+    st->fd = fd;
+    st->refs = 1;
+    st->size = entry.size;
+    snprintf(st->filename, sizeof(st->filename), "%s", filename);
+
+    if (cached) {
+        st->cached = cached;
+        st->data = cached->data;
+        st->buf_len = cached->size;
+        st->eof = true;
+    } else {
+        st->data = st->buf;
+        st->read_len = sizeof(st->buf);
+        st->fill = cache_fill_begin(filename, entry.gen, entry.size);
+    }
+    live_transfers++;
+    return st;
+}
+
+/**
+ * 다음 구간 읽기 요청 (완료되면 on_read_done → 다음 턴에 이어서 전송)
+ */
+static void start_read(DownloadState *st) {
+    st->reading = true;
+    st->refs++;
+    st->read_id = trace_next_id();
+    trace_async_begin(TR_DISK_READ, st->read_id, st->client_fd, st->xfer);
+    io_read(st->fd, st->buf, st->read_len, st->read_off, on_read_done, st);
+}
+
 /**
  * 파일 다운로드 처리
  * MSG_FILE_DOWNLOAD → MSG_FILE_READY → MSG_FILE_DATA 반복 → MSG_FILE_END
+ * 청크는 file_transfer_pump() 가 송신 큐 여유만큼 조금씩 채움
  */
 void handle_file_download(int client_fd, Message *msg) {
     char filename[256];
-    strcpy(filename, msg->data);
+    snprintf(filename, sizeof(filename), "%.255s", msg->data);
+
+    int idx = get_client_index(client_fd);
+    if (idx < 0) return;
 
     server_log("File Download Request: %s", filename);
 
+    if (upgrade_draining()) {
+        send_control(client_fd, MSG_ERROR, "SERVER_UPGRADING", 0);
+        return;
+    }
+
+    // 푸시를 받는 중이면 데이터가 섞이므로 끝난 뒤에
+    if (push_of[idx]) {
+        send_control(client_fd, MSG_ERROR, "PUSH_IN_PROGRESS", 0);
+        return;
+    }
+
+    DownloadState *st = open_download(filename, client_fd);
+    if (!st) {
+        send_control(client_fd, MSG_ERROR, "NOFILE", 0);
+        return;
+    }
+
+    // 같은 연결의 이전 다운로드가 남아있으면 중단
+    finish_download(idx, false);
+    downloads[idx] = st;
+
+    // 🔹 1) 파일 다운로드 준비됨 알림
+    send_control(client_fd, MSG_FILE_READY, "", 0);
+}
+
+/**
+ * 델타 업로드 1단계: 저장된 버전의 블록 서명 전송
+ * MSG_FILE_SIG_REQUEST → MSG_FILE_SIG(헤더) → MSG_FILE_SIG(서명) 반복
+ * 서명은 다운로드와 같은 흐름으로 (비동기 읽기 + 송신 큐 여유만큼) file_transfer_pump 가 채움
+ */
+void handle_file_sig_request(int client_fd, Message *msg) {
+    char filename[256];
+    snprintf(filename, sizeof(filename), "%.255s", msg->data);
+
+    int idx = get_client_index(client_fd);
+    if (idx < 0) return;
+
+    if (upgrade_draining()) {
+        send_control(client_fd, MSG_ERROR, "SERVER_UPGRADING", 0);
+        return;
+    }
+
+    // 서명도 다운로드 슬롯으로 보내므로 푸시를 받는 중이면 거절 (클라이언트는 전체 업로드)
+    if (push_of[idx]) {
+        send_control(client_fd, MSG_ERROR, "SIG_BUSY", 0);
+        return;
+    }
+
     char filepath[512];
-    sprintf(filepath, "%s%s", STORAGE_DIR, filename);
+    snprintf(filepath, sizeof(filepath), "%s%s", STORAGE_DIR, filename);
 
-    FILE *fp = fopen(filepath, "rb");
-    if (!fp) {
-        server_log("There are no file in directory: %s", filename);
+    CatalogEntry entry;
+    struct stat sb;
+    int fd = -1;
+    if (catalog_lookup(filename, &entry)) fd = open(filepath, O_RDONLY);
+    if (fd >= 0 && fstat(fd, &sb) < 0) {
+        close(fd);
+        fd = -1;
+    }
 
-        Message err;
-        memset(&err, 0, sizeof(err));
-        err.type = MSG_ERROR;
-        strcpy(err.sender, "SERVER");
-        strcpy(err.data, "NOFILE");
+    // 이전 버전이 없으면 블록 0개 → 클라이언트는 일반 업로드
+    long size = fd >= 0 ? (long)sb.st_size : 0;
+    int bs = delta_block_size(size);
+    long nblocks = (size + bs - 1) / bs;
 
-        w = write(client_fd, &err, sizeof(err));
-        if (w < 0) perror("write");
+    char header[MAX_BUF];
+    snprintf(header, sizeof(header), "%s %d %ld %lu", filename, bs, nblocks,
+             fd >= 0 ? entry.gen : 0UL);
+    send_control(client_fd, MSG_FILE_SIG, header, 0);
 
+    if (nblocks == 0) {
+        if (fd >= 0) close(fd);
         return;
     }
 
-    // 🔹 1) 파일 다운로드 준비됨 알림
-    Message ready;
-    memset(&ready, 0, sizeof(ready));
-    ready.type = MSG_FILE_READY;
-    strcpy(ready.sender, "SERVER");
+    finish_download(idx, false);
+
+    DownloadState *st = calloc(1, sizeof(DownloadState));
+    if (!st) {
+        close(fd);
+        send_control(client_fd, MSG_ERROR, "SIG_FAIL", 0);
+        return;
+    }
+
+    st->xfer = ++next_xfer;
+    st->client_fd = client_fd;
+    st->fd = fd;
+    st->refs = 1;
+    st->sig_block = bs;
+    st->read_len = (sizeof(st->buf) / bs) * bs;
+    st->data = st->buf;
+    snprintf(st->filename, sizeof(st->filename), "%s", filename);
+    downloads[idx] = st;
+    live_transfers++;
+
+    server_log("Delta signatures: %s (%ld blocks of %d bytes)", filename, nblocks, bs);
+}
+
+/* ===================== 푸시 (한 번 읽어 여러 명에게) ===================== */
+
+// 오프라인 수신자에게 로그인할 때 알려줄 안내 (가득 차면 오래된 것부터 버림)
+#define PUSH_NOTICE_MAX 64
+
+typedef struct {
+    char user[MAX_NAME];
+    char text[MAX_BUF];
+} PushNotice;
+
+static PushNotice notices[PUSH_NOTICE_MAX];
+static int        notice_count = 0;
+
+static void add_notice(const char *user, const char *text) {
+    if (notice_count == PUSH_NOTICE_MAX) {
+        memmove(&notices[0], &notices[1], sizeof(PushNotice) * (PUSH_NOTICE_MAX - 1));
+        notice_count--;
+    }
+    snprintf(notices[notice_count].user, sizeof(notices[0].user), "%s", user);
+    snprintf(notices[notice_count].text, sizeof(notices[0].text), "%s", text);
+    notice_count++;
+}
+
+/**
+ * 로그인한 사용자에게 밀린 푸시 안내 전달 (finish_login 에서 호출)
+ */
+void push_deliver_notices(int client_fd, const char *username) {
+    int kept = 0;
+    for (int k = 0; k < notice_count; k++) {
+        if (strcmp(notices[k].user, username) == 0) {
+            send_control(client_fd, MSG_CHAT, notices[k].text, 0);
+        } else {
+            notices[kept++] = notices[k];
+        }
+    }
+    notice_count = kept;
+}
+
+static void push_remove(PushState *p, int idx) {
+    if (!p->member[idx]) return;
+    p->member[idx] = false;
+    p->count--;
+    push_of[idx] = NULL;
+}
+
+/**
+ * 받는 중인 수신자로 추가, 다른 파일을 받는 중이면 안내만 보내고 false
+ */
+static bool push_add(PushState *p, int idx, const char *busy_text) {
+    if (p->member[idx]) return true;
+
+    if (push_of[idx] || downloads[idx]) {
+        send_control(client_sockets[idx], MSG_CHAT, busy_text, 0);
+        return false;
+    }
+
+    p->member[idx] = true;
+    p->count++;
+    push_of[idx] = p;
+    return true;
+}
+
+static void finish_push(PushState *p, bool completed) {
+    DownloadState *src = p->src;
+    int delivered = p->count;
+
+    // 남은 수신자에게 종료(또는 실패) 프레임 하나를 같이 보냄
+    Message m;
+    memset(&m, 0, sizeof(m));
+    strcpy(m.sender, "SERVER");
+    if (completed) {
+        m.type = MSG_FILE_END;
+        snprintf(m.data, sizeof(m.data), "%s", src->filename);
+    } else {
+        m.type = MSG_ERROR;
+        strcpy(m.data, "PUSH_FAILED");
+    }
+
+    OutFrame *f = frame_new(&m);
+    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
+        if (!p->member[idx]) continue;
+        queue_frame(idx, f);
+        push_remove(p, idx);
+    }
+    frame_release(f);
+
+    for (int k = 0; k < MAX_CLIENTS; k++) {
+        if (pushes[k] == p) pushes[k] = NULL;
+    }
+
+    if (completed) catalog_mark_download(src->filename);
+    server_log("Push %s: %s from %s (%ld bytes, %d/%d recipients)",
+               completed ? "complete" : "aborted", src->filename, p->from,
+               src->sent, delivered, p->total);
+
+    // 보낸 사람이 아직 접속 중이면 결과 알림
+    int sidx = find_user_index(p->from);
+    if (sidx >= 0) {
+        char text[MAX_BUF];
+        snprintf(text, sizeof(text), "Push %s: %s delivered to %d of %d user(s).",
+                 completed ? "finished" : "stopped", src->filename, completed ? delivered : 0,
+                 p->total);
+        send_control(client_sockets[sidx], MSG_CHAT, text, 0);
+    }
+
+    release_download(src);
+    free(p);
+}
+
+// 수신자 송신 큐 중 가장 많이 밀린 양
+static size_t push_backlog(const PushState *p) {
+    size_t most = 0;
+    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
+        if (p->member[idx] && conn_pending_bytes(idx) > most) most = conn_pending_bytes(idx);
+    }
+    return most;
+}
 
-    w = write(client_fd, &ready, sizeof(ready));
-    if (w < 0) perror("write");
+/**
+ * 푸시 하나 진행: 청크마다 프레임 하나를 만들어 모든 수신자 큐에 넣음
+ * 반환: 아직 바로 보낼 수 있는 데이터가 남았으면 true
+ */
+static bool pump_push(PushState *p) {
+    DownloadState *st = p->src;
 
-    // 🔹 2) 파일 청크 전송
-    char buffer[MAX_BUF];
-    int n;
+    for (int k = 0; k < DOWNLOAD_CHUNKS_PER_TURN; k++) {
+        // 가장 느린 수신자의 큐가 빠질 때까지 대기
+        if (push_backlog(p) > DOWNLOAD_QUEUE_LIMIT) return false;
 
-    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
-        server_log("SEND DATA: %d bytes", n);
+        if (st->buf_pos >= st->buf_len) {
+            if (st->eof) {
+                finish_push(p, st->sent == st->size);
+                return false;
+            }
+            if (!st->reading) start_read(st);
+            return false;
+        }
 
         Message chunk;
         memset(&chunk, 0, sizeof(chunk));
+
+        int n = st->buf_len - st->buf_pos > MAX_BUF ? MAX_BUF
+                                                    : (int)(st->buf_len - st->buf_pos);
+        memcpy(chunk.data, st->data + st->buf_pos, n);
         chunk.type = MSG_FILE_DATA;
         strcpy(chunk.sender, "SERVER");
-
-        memcpy(chunk.data, buffer, n);
         chunk.data_len = n;
 
-        w = write(client_fd, &chunk, sizeof(chunk));
-        if (w < 0) perror("write");
+        OutFrame *f = frame_new(&chunk);
+        if (!f) return false;          // 다음 턴에 다시
+
+        for (int idx = 0; idx < MAX_CLIENTS; idx++) {
+            if (p->member[idx]) queue_frame(idx, f);
+        }
+        frame_release(f);
+
+        st->buf_pos += n;
+        st->sent += n;
     }
 
-    fclose(fp);
+    return !st->reading && push_backlog(p) <= DOWNLOAD_QUEUE_LIMIT;
+}
 
-    // 🔹 3) 파일 전송 완료 메시지
-    Message end;
-    memset(&end, 0, sizeof(end));
-    end.type = MSG_FILE_END;
-    strcpy(end.sender, "SERVER");
-    strcpy(end.data, filename);
-    end.data_len = 0;
+/**
+ * /push <file> <#room|room|user...>
+ * 접속 중인 수신자 → MSG_FILE_PUSH("<파일명> <크기> <보낸사람>") → MSG_FILE_DATA 반복 → MSG_FILE_END
+ * 재접속 대기 중이거나 오프라인인 수신자는 다음 접속 때 /download 안내를 받음
+ */
+void handle_file_push(int sender_fd, const char *args) {
+    const char *from = get_username(sender_fd);
+    int sidx = get_client_index(sender_fd);
+    if (!from || from[0] == '\0' || sidx < 0) {
+        send_control(sender_fd, MSG_CHAT, "Login first to push.", 0);
+        return;
+    }
+
+    char filename[256];
+    int used = 0;
+    if (sscanf(args, "%255s %n", filename, &used) != 1 || args[used] == '\0') {
+        send_control(sender_fd, MSG_CHAT, "Usage: /push <file> <#room|user...>", 0);
+        return;
+    }
+    const char *targets = args + used;
+
+    if (upgrade_draining()) {
+        send_control(sender_fd, MSG_CHAT, "Server is upgrading, try again shortly.", 0);
+        return;
+    }
+
+    // 대상이 한 단어고 '#' 이 붙었거나 (사용자가 아닌) 방 이름이면 그 방 멤버 전원
+    int room = -1;
+    char first[ROOM_NAME_LEN + 1];
+    int first_len = 0;
+    if (sscanf(targets, "%32s %n", first, &first_len) == 1 && targets[first_len] == '\0') {
+        const char *rname = first[0] == '#' ? first + 1 : first;
+        room = room_find(rname);
+        if (first[0] != '#' && (find_user_index(first) >= 0 || user_exists(first))) room = -1;
+        if (room < 0 && first[0] == '#') {
+            send_control(sender_fd, MSG_CHAT, "No such room.", 0);
+            return;
+        }
+    }
+
+    DownloadState *src = open_download(filename, sender_fd);
+    PushState *p = src ? calloc(1, sizeof(PushState)) : NULL;
+    if (!p) {
+        if (src) release_download(src);
+        char text[320];
+        snprintf(text, sizeof(text), "No such file on server: %s", filename);
+        send_control(sender_fd, MSG_CHAT, text, 0);
+        return;
+    }
+    p->src = src;
+    snprintf(p->from, sizeof(p->from), "%s", from);
+
+    char busy_text[MAX_BUF], away_text[MAX_BUF];
+    snprintf(busy_text, sizeof(busy_text),
+             "[push] %s sent you %s (%ld bytes) during another transfer. Use /download %s",
+             from, filename, src->size, filename);
+    snprintf(away_text, sizeof(away_text),
+             "[push] %s sent you %s (%ld bytes) while you were offline. Use /download %s",
+             from, filename, src->size, filename);
 
-    w = write(client_fd, &end, sizeof(end));
-    if (w < 0) perror("write");
+    int busy = 0, offline = 0, unknown = 0;
 
-    server_log("Success File Download: %s", filename);
+    if (room >= 0) {
+        for (int idx = 0; idx < MAX_CLIENTS; idx++) {
+            if (idx == sidx || client_sockets[idx] <= 0 || !room_is_member(room, idx)) continue;
+            if (!push_add(p, idx, busy_text)) busy++;
+        }
+    } else {
+        char name[MAX_NAME];
+        int n = 0;
+        for (const char *q = targets; sscanf(q, "%19s %n", name, &n) == 1; q += n) {
+            if (strcmp(name, from) == 0) continue;
+
+            int idx = find_user_index(name);
+            if (idx >= 0) {
+                if (!push_add(p, idx, busy_text)) busy++;
+            } else if (session_is_parked(name)) {
+                // 재접속하면 세션 보관함에서 바로 받음
+                Message m;
+                memset(&m, 0, sizeof(m));
+                m.type = MSG_CHAT;
+                strcpy(m.sender, "SERVER");
+                snprintf(m.data, sizeof(m.data), "%s", away_text);
+                OutFrame *f = frame_new(&m);
+                session_capture(f, NULL, name);
+                frame_release(f);
+                offline++;
+            } else if (user_exists(name)) {
+                add_notice(name, away_text);
+                offline++;
+            } else {
+                unknown++;
+            }
+        }
+    }
+
+    char report[MAX_BUF];
+    int len = snprintf(report, sizeof(report), "Push %s (%ld bytes): %d online",
+                       filename, src->size, p->count);
+    if (offline) len += snprintf(report + len, sizeof(report) - len, ", %d offline (notified on login)", offline);
+    if (busy) len += snprintf(report + len, sizeof(report) - len, ", %d busy (told to /download)", busy);
+    if (unknown) snprintf(report + len, sizeof(report) - len, ", %d unknown user(s)", unknown);
+    send_control(sender_fd, MSG_CHAT, report, 0);
+
+    if (p->count == 0) {
+        release_download(src);
+        free(p);
+        return;
+    }
+
+    p->total = p->count;
+    for (int k = 0; k < MAX_CLIENTS; k++) {
+        if (!pushes[k]) {
+            pushes[k] = p;
+            break;
+        }
+    }
+
+    // 시작 알림도 프레임 하나를 공유
+    Message start;
+    memset(&start, 0, sizeof(start));
+    start.type = MSG_FILE_PUSH;
+    strcpy(start.sender, "SERVER");
+    snprintf(start.data, sizeof(start.data), "%s %ld %s", filename, src->size, from);
+
+    OutFrame *f = frame_new(&start);
+    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
+        if (p->member[idx]) queue_frame(idx, f);
+    }
+    frame_release(f);
+
+    server_log("Push start: %s from %s to %d user(s) (offline %d, busy %d)",
+               filename, from, p->count, offline, busy);
+}
+
+/**
+ * 🔹 2) 파일 청크 전송 (메인 루프 매 턴)
+ * 반환: 아직 바로 보낼 수 있는 데이터가 남았으면 true (select 를 기다리지 않음)
+ */
+bool file_transfer_pump(void) {
+    bool more = pump_copies();
+
+    for (int k = 0; k < MAX_CLIENTS; k++) {
+        if (pushes[k] && pump_push(pushes[k])) more = true;
+    }
+
+    for (int idx = 0; idx < MAX_CLIENTS; idx++) {
+        DownloadState *st = downloads[idx];
+        if (!st) continue;
+
+        for (int k = 0; k < DOWNLOAD_CHUNKS_PER_TURN; k++) {
+            // 받는 쪽이 느리면 큐가 빠질 때까지 대기 (쓰기 가능 이벤트로 재개)
+            if (conn_pending_bytes(idx) > DOWNLOAD_QUEUE_LIMIT) break;
+
+            if (st->buf_pos >= st->buf_len) {
+                if (st->eof) {
+                    finish_download(idx, true);
+                    st = NULL;
+                    break;
+                }
+
+                if (!st->reading) start_read(st);
+                break;
+            }
+
+            Message chunk;
+            memset(&chunk, 0, sizeof(chunk));
+
+            if (st->sig_block) {
+                // 읽은 구간의 블록마다 서명 (읽기 크기가 블록의 배수라 경계가 맞음)
+                int count = 0;
+                while (count < DELTA_SIGS_PER_MSG && st->buf_pos < st->buf_len) {
+                    long blen = st->buf_len - st->buf_pos;
+                    if (blen > st->sig_block) blen = st->sig_block;
+
+                    const unsigned char *p = (const unsigned char *)st->buf + st->buf_pos;
+                    delta_put_sig((unsigned char *)chunk.data + count * DELTA_SIG_SIZE,
+                                  delta_weak(p, blen), delta_strong(p, blen));
+                    st->buf_pos += blen;
+                    count++;
+                }
+
+                chunk.type = MSG_FILE_SIG;
+                strcpy(chunk.sender, "SERVER");
+                chunk.data_len = count * DELTA_SIG_SIZE;
+                queue_message(st->client_fd, &chunk);
+                st->sent += chunk.data_len;
+                continue;
+            }
+
+            int n = st->buf_len - st->buf_pos > MAX_BUF ? MAX_BUF
+                                                        : (int)(st->buf_len - st->buf_pos);
+            memcpy(chunk.data, st->data + st->buf_pos, n);
+            st->buf_pos += n;
+
+            server_log("SEND DATA: %d bytes", n);
+
+            chunk.type = MSG_FILE_DATA;
+            strcpy(chunk.sender, "SERVER");
+            chunk.data_len = n;
+
+            queue_message(st->client_fd, &chunk);
+            st->sent += n;
+        }
+
+        if (st && !st->reading && conn_pending_bytes(idx) <= DOWNLOAD_QUEUE_LIMIT) {
+            more = true;
+        }
+    }
+
+    return more;
+}
+
+/**
+ * 진행 중인 전송도, 끝나길 기다리는 파일 I/O 도 없는지 (무중단 재시작 전 확인)
+ */
+bool file_transfer_idle(void) {
+    return live_transfers == 0;
+}
+
+/**
+ * idx 연결이 업로드/다운로드 중인지
+ */
+bool file_transfer_active(int idx) {
+    return uploads[idx] != NULL || downloads[idx] != NULL || push_of[idx] != NULL;
+}
+
+/**
+ * idx 연결의 진행 중인 전송 ID (trace 용, 없으면 0)
+ */
+unsigned file_transfer_id(int idx) {
+    if (uploads[idx]) return uploads[idx]->xfer;
+    if (downloads[idx]) return downloads[idx]->xfer;
+    if (push_of[idx]) return push_of[idx]->src->xfer;
+    return 0;
+}
+
+/**
+ * 연결 종료 시 진행 중인 업로드/다운로드 정리
+ */
+void abort_file_transfer(int idx) {
+    if (idx >= 0 && idx < MAX_CLIENTS) {
+        finish_upload(idx, false);
+        finish_download(idx, false);
+
+        // 푸시는 이 수신자만 빼고 계속 (남은 수신자가 없으면 중단)
+        PushState *p = push_of[idx];
+        if (p) {
+            push_remove(p, idx);
+            if (p->count == 0) finish_push(p, false);
+        }
+    }
 }
@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "protocol.h"
+#include "server_heartbeat.h"
+#include "server_auth.h"
+#include "server_bucket.h"
+#include "server_conn.h"
+#include "server_user_list.h"
+
+extern int client_sockets[];
+extern void server_log(const char *fmt, ...);
+extern bool file_transfer_active(int idx);
+
+#define MAX_CLIENTS 10
+#define SLOT_MASK   (HB_WHEEL_SLOTS - 1)
+
+// 연결 하나의 하트비트 상태 + 휠 칸 목록 연결
+typedef struct {
+    bool   armed;
+    long   expire;        // 걸어둔 틱 (절대값, 칸 = expire & SLOT_MASK)
+    int    prev, next;    // 같은 칸 목록 (client_sockets[] 인덱스, -1 = 끝)
+    double opened;
+    double last_rx;       // 마지막 수신 (PONG 포함)
+    double last_active;   // 마지막 채팅/명령 (PING/PONG 제외)
+    double ping_sent;     // 응답을 기다리는 PING 을 보낸 시각 (0 = 없음)
+} HbConn;
+
+static HbConn conns[MAX_CLIENTS];
+static int    slot_head[HB_WHEEL_SLOTS];
+static bool   wheel_ready = false;
+static double wheel_start;            // 0번 틱 시각
+static long   wheel_tick = 0;         // 다음에 처리할 틱
+static int    armed_count = 0;
+
+static int ping_sec = HB_PING_SEC;
+static int pong_sec = HB_PONG_SEC;
+static int idle_sec = HB_IDLE_SEC;
+
+static unsigned long stat_pings = 0;
+static unsigned long stat_dead = 0;
+static unsigned long stat_idle = 0;
+static unsigned long stat_login = 0;
+
+
+static void init_wheel(void) {
+    if (wheel_ready) return;
+    for (int s = 0; s < HB_WHEEL_SLOTS; s++) slot_head[s] = -1;
+    wheel_start = now_seconds();
+    wheel_ready = true;
+}
+
+static long tick_of(double t) {
+    return (long)((t - wheel_start) * 1000 / HB_TICK_MS);
+}
+
+static void unlink_timer(int idx) {
+    HbConn *c = &conns[idx];
+    if (!c->armed) return;
+
+    if (c->prev >= 0) conns[c->prev].next = c->next;
+    else slot_head[c->expire & SLOT_MASK] = c->next;
+    if (c->next >= 0) conns[c->next].prev = c->prev;
+
+    c->armed = false;
+    armed_count--;
+}
+
+/**
+ * t 시각이 지난 뒤 첫 틱 칸에 걸기 (이미 걸려 있으면 옮김)
+ * 처리 중인 칸에는 다시 넣지 않도록 최소 다음 틱
+ */
+static void arm(int idx, double t) {
+    unlink_timer(idx);
+
+    long tick = tick_of(t) + 1;
+    if (tick <= wheel_tick) tick = wheel_tick + 1;
+
+    HbConn *c = &conns[idx];
+    int s = tick & SLOT_MASK;
+    c->expire = tick;
+    c->prev = -1;
+    c->next = slot_head[s];
+    if (c->next >= 0) conns[c->next].prev = idx;
+    slot_head[s] = idx;
+
+    c->armed = true;
+    armed_count++;
+}
+
+static bool logged_in(int idx) {
+    const char *name = get_username(client_sockets[idx]);
+    return name && name[0] != '\0';
+}
+
+static void send_notice(int idx, int type, const char *text) {
+    Message m;
+    memset(&m, 0, sizeof(m));
+    m.type = type;
+    strcpy(m.sender, "SERVER");
+    snprintf(m.data, sizeof(m.data), "%s", text);
+    queue_message(client_sockets[idx], &m);
+}
+
+/**
+ * 칸이 돌아온 연결 확인 → 끊거나, PING 을 보내거나, 다음 확인 시각으로 다시 걸기
+ */
+static void check(int idx, double now) {
+    HbConn *c = &conns[idx];
+    int sd = client_sockets[idx];
+    if (sd <= 0) return;
+
+    bool user = logged_in(idx);
+
+    if (!user && now - c->opened >= HB_LOGIN_SEC) {
+        stat_login++;
+        server_log("heartbeat: socket %d did not log in within %d s", sd, HB_LOGIN_SEC);
+        disconnect_client(idx);
+        return;
+    }
+
+    if (user && idle_sec > 0 && now - c->last_active >= idle_sec) {
+        char text[128];
+        snprintf(text, sizeof(text), "Disconnected: idle for %d seconds.", idle_sec);
+        send_notice(idx, MSG_CHAT, text);
+
+        stat_idle++;
+        server_log("heartbeat: %s idle for %d s, disconnecting", get_username(sd), idle_sec);
+        disconnect_client(idx);
+        return;
+    }
+
+    // 파일 전송 중에는 서버가 수신을 멈출 수 있으므로 (크레딧/복사 대기) 응답 없음으로 보지 않음
+    if (file_transfer_active(idx)) {
+        c->last_rx = now;
+        c->ping_sent = 0;
+    }
+
+    if (c->ping_sent > 0) {
+        if (c->last_rx >= c->ping_sent) {
+            c->ping_sent = 0;                    // 그 사이에 뭐라도 받았음
+        } else if (now - c->ping_sent >= pong_sec) {
+            stat_dead++;
+            server_log("heartbeat: no reply from socket %d (%s) for %.0f s, dropping",
+                       sd, user ? get_username(sd) : "-", now - c->last_rx);
+            drop_client(idx);                    // 깨어나면 토큰으로 재접속 가능
+            return;
+        }
+    }
+
+    if (ping_sec > 0 && c->ping_sent == 0 && now - c->last_rx >= ping_sec) {
+        send_notice(idx, MSG_PING, "");
+        c->ping_sent = now;
+        stat_pings++;
+    }
+
+    // 다음 확인 시각: PONG 마감 / 다음 PING / 로그인 마감 / 유휴 마감 중 가장 이른 것
+    double next = -1;
+    if (c->ping_sent > 0) next = c->ping_sent + pong_sec;
+    else if (ping_sec > 0) next = c->last_rx + ping_sec;
+
+    double limit = !user ? c->opened + HB_LOGIN_SEC
+                         : idle_sec > 0 ? c->last_active + idle_sec : -1;
+    if (limit >= 0 && (next < 0 || limit < next)) next = limit;
+
+    if (next >= 0) arm(idx, next);
+}
+
+
+/**
+ * -p / -t / -i 옵션 (초)
+ */
+void heartbeat_configure(int ping, int pong, int idle) {
+    if (ping >= 0) ping_sec = ping;
+    if (pong > 0) pong_sec = pong;
+    if (idle >= 0) idle_sec = idle;
+}
+
+/**
+ * 새 연결 (접속 / 업그레이드 인계) → 첫 확인 시각 걸기
+ */
+void heartbeat_open(int idx) {
+    init_wheel();
+
+    double now = now_seconds();
+    HbConn *c = &conns[idx];
+    unlink_timer(idx);
+    c->opened = now;
+    c->last_rx = now;
+    c->last_active = now;
+    c->ping_sent = 0;
+
+    int first = ping_sec > 0 && ping_sec < HB_LOGIN_SEC ? ping_sec : HB_LOGIN_SEC;
+    arm(idx, now + first);
+}
+
+void heartbeat_close(int idx) {
+    unlink_timer(idx);
+    conns[idx].ping_sent = 0;
+}
+
+/**
+ * 프레임 하나 받을 때마다 (휠은 건드리지 않고 시각만 기록 → 칸이 돌아왔을 때 반영)
+ */
+void heartbeat_touch(int idx, int msg_type) {
+    double now = now_seconds();
+    conns[idx].last_rx = now;
+    if (msg_type != MSG_PONG && msg_type != MSG_PING) conns[idx].last_active = now;
+}
+
+/**
+ * 메인 루프 매 턴: 지난 틱들의 칸 처리
+ * 반환: 걸린 타이머가 있는 다음 틱까지 ms, 없으면 -1
+ */
+int heartbeat_tick(void) {
+    init_wheel();
+
+    double now = now_seconds();
+    long now_tick = tick_of(now);
+
+    // 한 바퀴 넘게 못 돌았으면 칸마다 한 번씩만 보면 됨 (마감이 지난 항목은 모두 처리)
+    if (now_tick - wheel_tick >= HB_WHEEL_SLOTS) wheel_tick = now_tick - HB_WHEEL_SLOTS + 1;
+
+    for (; wheel_tick <= now_tick; wheel_tick++) {
+        int due[MAX_CLIENTS];
+        int n = 0;
+
+        for (int idx = slot_head[wheel_tick & SLOT_MASK]; idx >= 0; idx = conns[idx].next) {
+            if (conns[idx].expire <= wheel_tick) due[n++] = idx;
+        }
+        for (int k = 0; k < n; k++) unlink_timer(due[k]);
+        for (int k = 0; k < n; k++) check(due[k], now);
+    }
+
+    if (armed_count == 0) return -1;
+
+    // 다음에 처리할 항목이 있는 칸까지
+    for (long t = wheel_tick; t < wheel_tick + HB_WHEEL_SLOTS; t++) {
+        for (int idx = slot_head[t & SLOT_MASK]; idx >= 0; idx = conns[idx].next) {
+            if (conns[idx].expire <= t) {
+                double at = wheel_start + (double)t * HB_TICK_MS / 1000;
+                return at > now ? (int)((at - now) * 1000) + 1 : 0;
+            }
+        }
+    }
+    return HB_WHEEL_SLOTS * HB_TICK_MS;      // 모두 다음 바퀴 이후
+}
+
+void heartbeat_stats(char *buf, size_t bufsize) {
+    snprintf(buf, bufsize,
+             "Heartbeat: ping %d s, pong %d s, idle %d s | %lu pings, dropped %lu unresponsive, "
+             "%lu idle, %lu login timeouts | %d timers",
+             ping_sec, pong_sec, idle_sec, stat_pings, stat_dead, stat_idle, stat_login,
+             armed_count);
+}
@@ -0,0 +1,27 @@
+#ifndef SERVER_HEARTBEAT_H
+#define SERVER_HEARTBEAT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// 응답 없는 연결 정리 (잠든 노트북, NAT 타임아웃 등으로 send 가 실패하지 않는 경우)
+//  마지막 수신 뒤 PING 간격이 지나면 MSG_PING, 그 뒤 PONG 대기 시간 안에 아무것도 안 오면 끊음
+//  (재접속 토큰으로 이어갈 수 있게 세션은 남김)
+#define HB_PING_SEC        30     // -p 로 변경, 0 = 끔
+#define HB_PONG_SEC        10     // -t 로 변경
+#define HB_LOGIN_SEC       30     // 로그인 전 연결이 버틸 수 있는 시간
+#define HB_IDLE_SEC        0      // -i: 채팅/명령 없이 이만큼 지나면 끊음 (0 = 끔, PONG 은 활동 아님)
+
+// 타이머 휠: 연결마다 다음 확인 시각 하나만 걸어두고, 수신할 때는 시각만 기록
+//  (칸이 돌아왔을 때 실제 마지막 수신 시각을 보고 다시 걸거나 처리)
+#define HB_TICK_MS         250
+#define HB_WHEEL_SLOTS     256    // 2의 거듭제곱 (한 바퀴 = 64초, 더 먼 시각은 바퀴 수로 구분)
+
+void heartbeat_configure(int ping_sec, int pong_sec, int idle_sec);
+void heartbeat_open(int idx);
+void heartbeat_close(int idx);
+void heartbeat_touch(int idx, int msg_type);
+int  heartbeat_tick(void);
+void heartbeat_stats(char *buf, size_t bufsize);
+
+#endif
@@ -0,0 +1,454 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "server_history.h"
+
+extern void server_log(const char *fmt, ...);
+
+#define TERM_TABLE_INIT  4096     // 2의 거듭제곱
+#define LINE_MAX_BYTES   2048
+#define MAX_QUERY_LEN    256
+
+// 단어 하나의 포스팅 목록: 메시지 번호(+1) 차이를 varint 로 이어붙임 (오름차순)
+typedef struct {
+    char     *term;
+    uint32_t  hash;          // 문자열 비교 전에 먼저 비교 (캐시 미스 줄이기)
+    uint8_t  *post;
+    uint32_t  len, cap;
+    uint32_t  last;          // 마지막으로 넣은 번호 + 1 (0 = 아직 없음)
+    uint32_t  count;
+} Posting;
+
+static Posting  *terms = NULL;
+static uint32_t  term_cap = 0;
+static uint32_t  term_used = 0;
+static size_t    posting_bytes = 0;
+
+// 메시지 번호 → 파일 위치 (다음 번호의 위치가 끝)
+static off_t    *offsets = NULL;
+static uint32_t  msg_count = 0;
+static uint32_t  offset_cap = 0;
+static off_t     file_end = 0;
+static int       hist_fd = -1;
+
+
+static uint32_t hash_term(const char *s) {
+    uint32_t h = 2166136261u;          // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool term_table_grow(void) {
+    uint32_t cap = term_cap ? term_cap * 2 : TERM_TABLE_INIT;
+    Posting *t = calloc(cap, sizeof(Posting));
+    if (!t) return false;
+
+    for (uint32_t i = 0; i < term_cap; i++) {
+        if (!terms[i].term) continue;
+        uint32_t h = terms[i].hash & (cap - 1);
+        while (t[h].term) h = (h + 1) & (cap - 1);
+        t[h] = terms[i];
+    }
+
+    free(terms);
+    terms = t;
+    term_cap = cap;
+    return true;
+}
+
+static Posting* term_find_hashed(const char *term, uint32_t hash) {
+    if (term_cap == 0) return NULL;
+
+    uint32_t h = hash & (term_cap - 1);
+    while (terms[h].term) {
+        if (terms[h].hash == hash && strcmp(terms[h].term, term) == 0) return &terms[h];
+        h = (h + 1) & (term_cap - 1);
+    }
+    return NULL;
+}
+
+static Posting* term_find(const char *term) {
+    return term_find_hashed(term, hash_term(term));
+}
+
+static Posting* term_get(const char *term) {
+    uint32_t hash = hash_term(term);
+    Posting *p = term_find_hashed(term, hash);
+    if (p) return p;
+
+    // 70% 가 차면 두 배로
+    if ((term_used + 1) * 10 > term_cap * 7 && !term_table_grow()) return NULL;
+
+    uint32_t h = hash & (term_cap - 1);
+    while (terms[h].term) h = (h + 1) & (term_cap - 1);
+
+    terms[h].term = strdup(term);
+    if (!terms[h].term) return NULL;
+    terms[h].hash = hash;
+    term_used++;
+    return &terms[h];
+}
+
+/**
+ * 포스팅 목록 끝에 메시지 번호 추가 (같은 메시지 안의 반복 단어는 한 번만)
+ */
+static void posting_add(const char *term, uint32_t id) {
+    Posting *p = term_get(term);
+    if (!p || p->last == id + 1) return;
+
+    if (p->len + 5 > p->cap) {
+        uint32_t cap = p->cap ? p->cap * 2 : 8;
+        uint8_t *post = realloc(p->post, cap);
+        if (!post) return;
+        posting_bytes += cap - p->cap;
+        p->post = post;
+        p->cap = cap;
+    }
+
+    uint32_t delta = id + 1 - p->last;
+    while (delta >= 0x80) {
+        p->post[p->len++] = (uint8_t)(delta | 0x80);
+        delta >>= 7;
+    }
+    p->post[p->len++] = (uint8_t)delta;
+
+    p->last = id + 1;
+    p->count++;
+}
+
+/**
+ * 단어 자르기: ASCII 영숫자와 UTF-8 멀티바이트(한글 등)가 이어진 구간, 영문은 소문자로
+ * 반환: 다음 읽을 위치 (단어가 없으면 NULL)
+ */
+static const char* next_term(const char *s, char *term) {
+    while (*s) {
+        while (*s && !(isalnum((unsigned char)*s) || (unsigned char)*s >= 0x80)) s++;
+        if (!*s) return NULL;
+
+        size_t n = 0;
+        bool cut_mid = false;           // 잘린 첫 바이트가 글자 중간(연속 바이트)인지
+        const char *start = s;
+        while (*s && (isalnum((unsigned char)*s) || (unsigned char)*s >= 0x80)) {
+            if (n < HISTORY_TERM_MAX) {
+                term[n++] = (char)tolower((unsigned char)*s);
+            } else if (s == start + HISTORY_TERM_MAX) {
+                cut_mid = ((unsigned char)*s & 0xC0) == 0x80;
+            }
+            s++;
+        }
+        // 긴 단어는 UTF-8 글자 중간에서 자르지 않음 (걸친 글자의 첫 바이트까지 되돌림)
+        if (cut_mid) {
+            while (n > 0 && ((unsigned char)term[--n] & 0xC0) == 0x80) {}
+        }
+        term[n] = '\0';
+
+        if (n >= HISTORY_TERM_MIN) return s;
+    }
+    return NULL;
+}
+
+static void index_message(uint32_t id, const char *sender, const char *text) {
+    char term[HISTORY_TERM_MAX + 8];
+
+    const char *s = text;
+    while ((s = next_term(s, term)) != NULL) {
+        posting_add(term, id);
+    }
+
+    // 보낸 사람은 "from:<이름>" 으로
+    snprintf(term, sizeof(term), "from:%.*s", HISTORY_TERM_MAX, sender);
+    for (char *c = term; *c; c++) *c = (char)tolower((unsigned char)*c);
+    posting_add(term, id);
+}
+
+static bool offsets_push(off_t off) {
+    if (msg_count == offset_cap) {
+        uint32_t cap = offset_cap ? offset_cap * 2 : 1024;
+        off_t *o = realloc(offsets, cap * sizeof(off_t));
+        if (!o) return false;
+        offsets = o;
+        offset_cap = cap;
+    }
+    offsets[msg_count] = off;
+    return true;
+}
+
+/**
+ * 한 줄을 시각/방/보낸사람/본문으로 나눔 (line 을 직접 수정)
+ */
+static bool split_line(char *line, time_t *when, char **room, char **sender, char **text) {
+    char *save = NULL;
+    char *t = strtok_r(line, "\t", &save);
+    *room = strtok_r(NULL, "\t", &save);
+    *sender = strtok_r(NULL, "\t", &save);
+    *text = strtok_r(NULL, "\n", &save);
+    if (!t || !*room || !*sender) return false;
+    if (!*text) *text = "";
+
+    *when = (time_t)strtoll(t, NULL, 10);
+    return true;
+}
+
+
+/**
+ * 서버 시작 시 기록 파일을 한 번 읽어 색인 구성 (이후에는 메시지마다 증분)
+ * 마지막 줄이 쓰다 만 상태면 잘라냄
+ */
+void history_init(void) {
+    mkdir("./server", 0755);
+
+    hist_fd = open(HISTORY_FILE, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (hist_fd < 0) {
+        server_log("history: open %s failed (errno=%d)", HISTORY_FILE, errno);
+        return;
+    }
+
+    FILE *fp = fdopen(dup(hist_fd), "r");
+    if (!fp) return;
+
+    char line[LINE_MAX_BYTES];
+    off_t off = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        size_t n = strlen(line);
+        if (n == 0 || line[n - 1] != '\n') break;
+
+        time_t when;
+        char *room, *sender, *text;
+        if (split_line(line, &when, &room, &sender, &text) && offsets_push(off)) {
+            index_message(msg_count++, sender, text);
+        }
+        off += n;
+    }
+    fclose(fp);
+
+    struct stat sb;
+    if (fstat(hist_fd, &sb) == 0 && sb.st_size > off) {
+        server_log("history: dropping %ld bytes of partial record", (long)(sb.st_size - off));
+        if (ftruncate(hist_fd, off) < 0) {
+            server_log("history: ftruncate failed (errno=%d)", errno);
+        }
+    }
+    file_end = off;
+
+    server_log("history: %u messages, %u terms indexed", msg_count, term_used);
+}
+
+/**
+ * 방 채팅 한 줄 기록 + 바로 색인 (메인 루프에서 메시지마다)
+ */
+void history_append(const char *room, const char *sender, const char *text) {
+    if (hist_fd < 0) return;
+
+    char line[LINE_MAX_BYTES];
+    int n = snprintf(line, sizeof(line), "%lld\t%s\t%s\t",
+                     (long long)time(NULL), room, sender);
+    int body = n;
+    n += snprintf(line + n, sizeof(line) - n - 1, "%s", text);
+    if (n > (int)sizeof(line) - 2) n = sizeof(line) - 2;
+
+    // 구분자와 겹치는 문자는 공백으로
+    for (int k = body; k < n; k++) {
+        if (line[k] == '\t' || line[k] == '\n' || line[k] == '\r') line[k] = ' ';
+    }
+    line[n++] = '\n';
+
+    if (write(hist_fd, line, n) != n) {
+        server_log("history: write failed (errno=%d)", errno);
+        return;
+    }
+
+    if (!offsets_push(file_end)) return;
+    file_end += n;
+
+    line[n - 1] = '\0';
+    index_message(msg_count++, sender, line + body);
+}
+
+
+/* ===================== 검색 ===================== */
+
+// 포스팅 목록을 앞에서부터 풀어가며 읽는 커서
+typedef struct {
+    const uint8_t *p, *end;
+    uint32_t       cur;       // 지금 가리키는 번호 + 1 (0 = 끝)
+    uint32_t       count;
+} Cursor;
+
+static void cursor_next(Cursor *c) {
+    if (c->p >= c->end) {
+        c->cur = 0;
+        return;
+    }
+
+    uint32_t delta = 0;
+    int shift = 0;
+    while (c->p < c->end) {
+        uint8_t b = *c->p++;
+        delta |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+        shift += 7;
+    }
+    c->cur += delta;
+}
+
+static int cmp_cursor(const void *a, const void *b) {
+    const Cursor *x = a, *y = b;
+    return (x->count > y->count) - (x->count < y->count);
+}
+
+static bool read_message(uint32_t id, char *line, size_t size) {
+    off_t start = offsets[id];
+    off_t end = id + 1 < msg_count ? offsets[id + 1] : file_end;
+    size_t len = (size_t)(end - start);
+    if (len >= size) len = size - 1;
+
+    ssize_t n = pread(hist_fd, line, len, start);
+    if (n <= 0) return false;
+    line[n] = '\0';
+    return true;
+}
+
+// UTF-8 글자 중간에서 자르지 않도록 max 바이트 이하로
+static int utf8_clip(const char *s, int max) {
+    int n = (int)strlen(s);
+    if (n <= max) return n;
+    while (max > 0 && ((unsigned char)s[max] & 0xC0) == 0x80) max--;
+    return max;
+}
+
+/**
+ * 검색어의 모든 단어를 포함하는 메시지를 최신순으로 page 번째 페이지만 buf 에
+ *  - 단어: 본문 단어 (대소문자 무시) 또는 from:<보낸사람>
+ *  - 가장 짧은 목록부터 교집합 → 마지막 page*HISTORY_PAGE 개만 링에 보관
+ * 반환: 전체 일치 수 (-1 = 검색어 없음)
+ */
+int history_search(const char *query, int page, char *buf, size_t bufsize) {
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    if (page < 1) page = 1;
+    if (page > HISTORY_PAGE_MAX) page = HISTORY_PAGE_MAX;
+
+    // 검색어 → 단어 목록 (파일에 넣을 때와 같은 규칙)
+    char words[HISTORY_QUERY_TERMS][HISTORY_TERM_MAX + 8];
+    int nwords = 0;
+    char q[MAX_QUERY_LEN];
+    snprintf(q, sizeof(q), "%s", query);
+
+    char *save = NULL;
+    for (char *w = strtok_r(q, " ", &save); w && nwords < HISTORY_QUERY_TERMS;
+         w = strtok_r(NULL, " ", &save)) {
+        if (strncasecmp(w, "from:", 5) == 0 && w[5]) {
+            snprintf(words[nwords], sizeof(words[0]), "from:%.*s", HISTORY_TERM_MAX, w + 5);
+            for (char *c = words[nwords]; *c; c++) *c = (char)tolower((unsigned char)*c);
+            nwords++;
+            continue;
+        }
+        const char *s = w;
+        while (nwords < HISTORY_QUERY_TERMS && (s = next_term(s, words[nwords])) != NULL) {
+            nwords++;
+        }
+    }
+
+    if (nwords == 0) {
+        snprintf(buf, bufsize, "Usage: /search [-p page] <words> [from:user]");
+        return -1;
+    }
+
+    Cursor cur[HISTORY_QUERY_TERMS];
+    bool missing = false;
+    for (int k = 0; k < nwords; k++) {
+        Posting *p = term_find(words[k]);
+        if (!p || p->count == 0) {
+            missing = true;
+            break;
+        }
+        cur[k].p = p->post;
+        cur[k].end = p->post + p->len;
+        cur[k].cur = 0;
+        cur[k].count = p->count;
+    }
+
+    int window = page * HISTORY_PAGE;
+    uint32_t *ring = missing ? NULL : malloc(sizeof(uint32_t) * window);
+    long total = 0;
+
+    if (ring) {
+        qsort(cur, nwords, sizeof(Cursor), cmp_cursor);
+        for (int k = 0; k < nwords; k++) cursor_next(&cur[k]);
+
+        // 모든 커서가 같은 번호를 가리킬 때만 일치
+        while (cur[0].cur) {
+            uint32_t want = cur[0].cur;
+            bool all = true;
+
+            for (int k = 1; k < nwords; k++) {
+                while (cur[k].cur && cur[k].cur < want) cursor_next(&cur[k]);
+                if (!cur[k].cur) goto done;
+                if (cur[k].cur > want) {
+                    want = cur[k].cur;
+                    all = false;
+                }
+            }
+
+            if (all) {
+                ring[total % window] = want - 1;
+                total++;
+                cursor_next(&cur[0]);
+            } else {
+                while (cur[0].cur && cur[0].cur < want) cursor_next(&cur[0]);
+            }
+        }
+    }
+done:
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+
+    int pages = (int)((total + HISTORY_PAGE - 1) / HISTORY_PAGE);
+    size_t len = snprintf(buf, bufsize, "Search \"%s\": %ld match%s, page %d/%d (%.2f ms)",
+                          query, total, total == 1 ? "" : "es", page,
+                          pages > 0 ? pages : 1, ms);
+
+    // 최신순 (page-1)*HISTORY_PAGE 번째부터
+    for (long r = (long)(page - 1) * HISTORY_PAGE;
+         r < (long)page * HISTORY_PAGE && r < total && len < bufsize; r++) {
+        uint32_t id = ring[(total - 1 - r) % window];
+
+        char line[LINE_MAX_BYTES];
+        time_t when;
+        char *room, *sender, *text;
+        if (!read_message(id, line, sizeof(line)) ||
+            !split_line(line, &when, &room, &sender, &text)) continue;
+
+        struct tm tm;
+        localtime_r(&when, &tm);
+
+        // 한 페이지가 메시지 하나(MAX_BUF)에 들어가도록 본문은 앞부분만
+        int room_left = (int)(bufsize - len) - 48 - (int)strlen(room) - (int)strlen(sender);
+        int clip = utf8_clip(text, room_left < 72 ? (room_left > 0 ? room_left : 0) : 72);
+        len += snprintf(buf + len, bufsize - len, "\n[%02d-%02d %02d:%02d #%s] %s: %.*s%s",
+                        tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min,
+                        room, sender, clip, text, clip < (int)strlen(text) ? "…" : "");
+    }
+
+    free(ring);
+    return (int)total;
+}
+
+void history_stats(char *buf, size_t bufsize) {
+    snprintf(buf, bufsize, "History: %u messages, %u terms, %.1f KB postings, %.1f MB on disk",
+             msg_count, term_used, posting_bytes / 1024.0, file_end / 1048576.0);
+}
@@ -0,0 +1,21 @@
+#ifndef SERVER_HISTORY_H
+#define SERVER_HISTORY_H
+
+#include <stddef.h>
+
+// 방 채팅 기록 (한 줄에 한 메시지, 추가만 함) + 단어별 메시지 번호 역색인
+//  "<시각>\t<방>\t<보낸사람>\t<본문>\n"
+// (.txt 는 make clean 이 지우므로 다른 확장자)
+#define HISTORY_FILE         "./server/chat_history.dat"
+#define HISTORY_PAGE         10       // /search 한 페이지 결과 수
+#define HISTORY_PAGE_MAX     100      // 최대 페이지 (오래된 결과는 검색어를 좁혀서)
+#define HISTORY_TERM_MIN     2        // 이보다 짧은 단어는 색인하지 않음 (바이트)
+#define HISTORY_TERM_MAX     32
+#define HISTORY_QUERY_TERMS  8
+
+void history_init(void);
+void history_append(const char *room, const char *sender, const char *text);
+int  history_search(const char *query, int page, char *buf, size_t bufsize);
+void history_stats(char *buf, size_t bufsize);
+
+#endif
@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+#include "server_io.h"
+
+extern void server_log(const char *fmt, ...);
+
+#define RING_ENTRIES 256
+#define OP_POOL_SIZE (RING_ENTRIES * 4)
+
+// 요청 하나 (io_uring 의 user_data / POSIX 의 완료 대기열 항목)
+typedef struct IoOp {
+    io_cb        cb;
+    void        *ctx;
+    int          res;
+    bool         inflight;     // io_uring 에 제출되어 완료 대기 중 (SQ 자리 대기 포함)
+    bool         waiting;      // SQ 가 가득 차서 아직 SQE 를 못 받음
+    struct IoOp *next;
+    struct IoOp *heap_prev;    // 힙에서 할당한 요청 목록 (io_cancel 이 풀과 함께 훑음)
+    struct IoOp *heap_next;
+
+    // SQ 자리를 기다리는 동안 보관하는 요청 내용
+    int          opcode;
+    int          fd;
+    const void  *addr;
+    unsigned     len;
+    off_t        off;
+    int          msg_flags;
+} IoOp;
+
+static int engine = IO_ENGINE_POSIX;
+
+static IoOp  op_pool[OP_POOL_SIZE];
+static IoOp *op_free = NULL;
+static IoOp *heap_ops = NULL;
+
+// io_uring: SQ 가 가득 차서 자리를 기다리는 요청 (순서 유지, io_submit 이 빈 자리에 채움)
+static IoOp *wait_head = NULL;
+static IoOp *wait_tail = NULL;
+
+// POSIX: 즉시 실행하고 콜백만 io_complete() 에서 (순서 유지용 FIFO)
+// io_uring: 제출 전에 취소된 요청의 -ECANCELED 완료
+static IoOp *done_head = NULL;
+static IoOp *done_tail = NULL;
+
+// io_uring 링 (mmap 된 공유 메모리)
+static int       ring_fd = -1;
+static int       event_fd = -1;
+static unsigned *sq_head, *sq_tail, *sq_mask, *sq_array, *sq_flags;
+static unsigned *cq_head, *cq_tail, *cq_mask;
+static struct io_uring_sqe *sqes;
+static struct io_uring_cqe *cqes;
+static unsigned  sq_entries;
+static unsigned  sq_local_tail;
+static unsigned  to_submit = 0;
+
+
+static IoOp* op_alloc(io_cb cb, void *ctx) {
+    IoOp *op = op_free;
+    if (op) {
+        op_free = op->next;
+    } else {
+        op = malloc(sizeof(IoOp));      // 풀이 모자라면 힙에서
+        if (!op) return NULL;
+
+        op->heap_prev = NULL;
+        op->heap_next = heap_ops;
+        if (heap_ops) heap_ops->heap_prev = op;
+        heap_ops = op;
+    }
+
+    op->cb = cb;
+    op->ctx = ctx;
+    op->res = 0;
+    op->inflight = false;
+    op->waiting = false;
+    op->next = NULL;
+    return op;
+}
+
+static void op_free_one(IoOp *op) {
+    if (op >= op_pool && op < op_pool + OP_POOL_SIZE) {
+        op->next = op_free;
+        op_free = op;
+    } else {
+        if (op->heap_prev) op->heap_prev->heap_next = op->heap_next;
+        else heap_ops = op->heap_next;
+        if (op->heap_next) op->heap_next->heap_prev = op->heap_prev;
+        free(op);
+    }
+}
+
+static void done_push(IoOp *op) {
+    op->next = NULL;
+    if (done_tail) done_tail->next = op;
+    else done_head = op;
+    done_tail = op;
+}
+
+static void posix_done(IoOp *op, ssize_t res) {
+    op->res = res < 0 ? -errno : (int)res;
+    done_push(op);
+}
+
+
+/* ===================== io_uring 설정 ===================== */
+
+static int uring_setup(void) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    ring_fd = (int)syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+    if (ring_fd < 0) return -1;
+
+    size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (cq_size > sq_size) sq_size = cq_size;
+        cq_size = sq_size;
+    }
+
+    char *sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED) goto fail;
+
+    char *cq_ptr = sq_ptr;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ptr == MAP_FAILED) goto fail;
+    }
+
+    sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+                PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring_fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) goto fail;
+
+    sq_head  = (unsigned *)(sq_ptr + p.sq_off.head);
+    sq_tail  = (unsigned *)(sq_ptr + p.sq_off.tail);
+    sq_mask  = (unsigned *)(sq_ptr + p.sq_off.ring_mask);
+    sq_array = (unsigned *)(sq_ptr + p.sq_off.array);
+    sq_flags = (unsigned *)(sq_ptr + p.sq_off.flags);
+    cq_head  = (unsigned *)(cq_ptr + p.cq_off.head);
+    cq_tail  = (unsigned *)(cq_ptr + p.cq_off.tail);
+    cq_mask  = (unsigned *)(cq_ptr + p.cq_off.ring_mask);
+    cqes     = (struct io_uring_cqe *)(cq_ptr + p.cq_off.cqes);
+    sq_entries = p.sq_entries;
+    sq_local_tail = *sq_tail;
+
+    // 완료 알림을 select 로 받기 위한 eventfd
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event_fd < 0) goto fail;
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_EVENTFD,
+                &event_fd, 1) < 0) goto fail;
+
+    return 0;
+
+fail:
+    close(ring_fd);
+    ring_fd = -1;
+    if (event_fd >= 0) close(event_fd);
+    event_fd = -1;
+    return -1;
+}
+
+static struct io_uring_sqe* get_sqe(void) {
+    unsigned head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    if (sq_local_tail - head >= sq_entries) return NULL;
+
+    unsigned idx = sq_local_tail & *sq_mask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array[idx] = idx;
+    sq_local_tail++;
+    to_submit++;
+    return sqe;
+}
+
+/**
+ * 보관한 요청을 SQE 하나에 채움 (SQ 가 가득이면 false)
+ */
+static bool uring_fill(IoOp *op) {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (!sqe) return false;
+
+    sqe->opcode = op->opcode;
+    sqe->fd = op->fd;
+    sqe->addr = (unsigned long)op->addr;
+    sqe->len = op->len;
+    sqe->off = op->off;
+    sqe->msg_flags = op->msg_flags;
+    sqe->user_data = (unsigned long)op;
+    op->waiting = false;
+    return true;
+}
+
+/**
+ * 요청 준비: SQ 가 가득이면 먼저 제출해서 자리를 만들고, 그래도 없으면 대기열에
+ * (콜백은 항상 io_complete 에서만 → 호출한 쪽 안에서 다시 불리지 않음)
+ */
+static void uring_prep(int opcode, int fd, const void *addr, unsigned len,
+                       off_t off, int msg_flags, IoOp *op) {
+    op->opcode = opcode;
+    op->fd = fd;
+    op->addr = addr;
+    op->len = len;
+    op->off = off;
+    op->msg_flags = msg_flags;
+    op->inflight = true;
+
+    // 앞에 기다리는 요청이 있으면 순서를 지키려고 그 뒤로
+    if (!wait_head && uring_fill(op)) return;
+
+    op->waiting = true;
+    op->next = NULL;
+    if (wait_tail) wait_tail->next = op;
+    else wait_head = op;
+    wait_tail = op;
+
+    io_submit();
+}
+
+static void cancel_done(void *ctx, int res) {
+    (void)ctx;
+    (void)res;
+}
+
+
+/* ===================== 공통 API ===================== */
+
+/**
+ * 시작 시 엔진 선택 (io_uring 을 못 쓰면 POSIX 로 대체)
+ * 반환: 실제로 선택된 엔진
+ */
+int io_engine_init(int want) {
+    for (int i = 0; i < OP_POOL_SIZE; i++) {
+        op_pool[i].next = op_free;
+        op_free = &op_pool[i];
+    }
+
+    engine = IO_ENGINE_POSIX;
+
+    if (want == IO_ENGINE_URING) {
+        if (uring_setup() == 0) {
+            engine = IO_ENGINE_URING;
+        } else {
+            server_log("io_uring unavailable (errno=%d), using posix I/O", errno);
+        }
+    }
+
+    server_log("I/O engine: %s", io_engine_name());
+    return engine;
+}
+
+int io_engine(void) {
+    return engine;
+}
+
+const char* io_engine_name(void) {
+    return engine == IO_ENGINE_URING ? "io_uring" : "posix";
+}
+
+int io_event_fd(void) {
+    return event_fd;
+}
+
+void io_read(int fd, void *buf, size_t len, off_t off, io_cb cb, void *ctx) {
+    IoOp *op = op_alloc(cb, ctx);
+    if (!op) { cb(ctx, -ENOMEM); return; }
+
+    if (engine == IO_ENGINE_URING) {
+        uring_prep(IORING_OP_READ, fd, buf, len, off, 0, op);
+    } else {
+        posix_done(op, pread(fd, buf, len, off));
+    }
+}
+
+void io_write(int fd, const void *buf, size_t len, off_t off, io_cb cb, void *ctx) {
+    IoOp *op = op_alloc(cb, ctx);
+    if (!op) { cb(ctx, -ENOMEM); return; }
+
+    if (engine == IO_ENGINE_URING) {
+        uring_prep(IORING_OP_WRITE, fd, buf, len, off, 0, op);
+    } else {
+        posix_done(op, pwrite(fd, buf, len, off));
+    }
+}
+
+/**
+ * 소켓 수신: POSIX 는 select 로 읽을 수 있을 때만 호출 (논블로킹 recv)
+ *            io_uring 은 데이터가 올 때까지 커널에서 대기
+ */
+void io_recv(int fd, void *buf, size_t len, io_cb cb, void *ctx) {
+    IoOp *op = op_alloc(cb, ctx);
+    if (!op) { cb(ctx, -ENOMEM); return; }
+
+    if (engine == IO_ENGINE_URING) {
+        uring_prep(IORING_OP_RECV, fd, buf, len, 0, 0, op);
+    } else {
+        posix_done(op, recv(fd, buf, len, MSG_DONTWAIT));
+    }
+}
+
+/**
+ * 소켓 수신 + 보조 데이터 (UNIX 소켓으로 넘어오는 fd 등)
+ * mh 와 iovec, 제어 버퍼는 완료 콜백까지 유지해야 함
+ */
+void io_recvmsg(int fd, struct msghdr *mh, int flags, io_cb cb, void *ctx) {
+    IoOp *op = op_alloc(cb, ctx);
+    if (!op) { cb(ctx, -ENOMEM); return; }
+
+    if (engine == IO_ENGINE_URING) {
+        uring_prep(IORING_OP_RECVMSG, fd, mh, 1, 0, flags & ~MSG_DONTWAIT, op);
+    } else {
+        posix_done(op, recvmsg(fd, mh, flags | MSG_DONTWAIT));
+    }
+}
+
+/**
+ * 소켓 송신 (mh 와 iovec 은 완료 콜백까지 유지해야 함)
+ */
+void io_sendmsg(int fd, struct msghdr *mh, int flags, io_cb cb, void *ctx) {
+    IoOp *op = op_alloc(cb, ctx);
+    if (!op) { cb(ctx, -ENOMEM); return; }
+
+    if (engine == IO_ENGINE_URING) {
+        // io_uring 은 버퍼가 빌 때까지 알아서 기다리므로 MSG_DONTWAIT 불필요
+        uring_prep(IORING_OP_SENDMSG, fd, mh, 1, 0, flags & ~MSG_DONTWAIT, op);
+    } else {
+        posix_done(op, sendmsg(fd, mh, flags | MSG_DONTWAIT));
+    }
+}
+
+/**
+ * ctx 로 걸어둔 요청 취소 (io_uring 만 해당, POSIX 는 이미 끝난 상태)
+ * 취소된 요청의 콜백은 -ECANCELED 로 호출됨 (그 전에 끝났으면 원래 결과)
+ */
+static void cancel_one(IoOp *target, void *ctx) {
+    if (!target->inflight || target->waiting || target->ctx != ctx) return;
+
+    IoOp *op = op_alloc(cancel_done, NULL);
+    if (op) uring_prep(IORING_OP_ASYNC_CANCEL, -1, target, 0, 0, 0, op);
+}
+
+void io_cancel(void *ctx) {
+    if (engine != IO_ENGINE_URING) return;
+
+    // 아직 SQ 자리를 기다리는 요청은 제출하지 않고 바로 취소 완료로
+    IoOp **pp = &wait_head;
+    wait_tail = NULL;
+    while (*pp) {
+        IoOp *op = *pp;
+        if (op->ctx == ctx) {
+            *pp = op->next;
+            op->waiting = false;
+            op->inflight = false;
+            op->res = -ECANCELED;
+            done_push(op);
+            continue;
+        }
+        wait_tail = op;
+        pp = &op->next;
+    }
+
+    for (int i = 0; i < OP_POOL_SIZE; i++) cancel_one(&op_pool[i], ctx);
+
+    // 취소 요청이 힙에서 할당되면 목록 앞에 붙으므로 그 전에 다음 항목을 잡아둠
+    IoOp *op = heap_ops;
+    while (op) {
+        IoOp *next = op->heap_next;
+        cancel_one(op, ctx);
+        op = next;
+    }
+}
+
+/**
+ * 이번 턴에 준비한 요청을 io_uring_enter 한 번으로 제출
+ */
+int io_submit(void) {
+    if (engine != IO_ENGINE_URING) return 0;
+
+    int total = 0;
+    while (1) {
+        // 커널이 가져가서 빈 자리에 기다리던 요청부터 채움
+        while (wait_head && uring_fill(wait_head)) {
+            wait_head = wait_head->next;
+            if (!wait_head) wait_tail = NULL;
+        }
+        if (to_submit == 0) break;
+
+        __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+        int n = (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, 0, 0, NULL, 0);
+        if (n < 0) {
+            // CQ 가 가득(EBUSY) 등: 남은 요청은 다음 턴 (완료를 처리한 뒤) 에 다시
+            if (errno != EBUSY && errno != EAGAIN) {
+                server_log("io_uring_enter failed (errno=%d)", errno);
+            }
+            return total > 0 ? total : -1;
+        }
+
+        to_submit -= n;
+        total += n;
+        if (n == 0 || !wait_head) break;
+    }
+    return total;
+}
+
+bool io_has_completions(void) {
+    if (engine == IO_ENGINE_URING && __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE) != *cq_head) {
+        return true;
+    }
+    return done_head != NULL;
+}
+
+/**
+ * 완료된 요청의 콜백 실행 (콜백 안에서 새 요청을 넣어도 됨)
+ * 반환: 처리한 완료 개수
+ */
+int io_complete(void) {
+    int count = 0;
+
+    if (engine == IO_ENGINE_URING) {
+        uint64_t junk;
+        if (read(event_fd, &junk, sizeof(junk)) < 0 && errno != EAGAIN) {
+            perror("read eventfd");
+        }
+
+        unsigned head = *cq_head;
+        while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &cqes[head & *cq_mask];
+            IoOp *op = (IoOp *)(unsigned long)cqe->user_data;
+            int res = cqe->res;
+
+            head++;
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+            op->inflight = false;
+            op->cb(op->ctx, res);
+            op_free_one(op);
+            count++;
+        }
+
+        // CQ 가 넘쳐서 커널에 남은 완료는 GETEVENTS 로 CQ 에 옮김 (다음 호출에서 처리)
+        if (__atomic_load_n(sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW) {
+            syscall(__NR_io_uring_enter, ring_fd, 0, 0, IORING_ENTER_GETEVENTS, NULL, 0);
+        }
+    }
+
+    // POSIX 완료 / io_uring 은 제출 전에 취소된 요청
+    // 콜백에서 새로 들어온 완료는 다음 호출에서 처리
+    IoOp *list = done_head;
+    done_head = done_tail = NULL;
+
+    while (list) {
+        IoOp *op = list;
+        list = list->next;
+
+        op->cb(op->ctx, op->res);
+        op_free_one(op);
+        count++;
+    }
+    return count;
+}
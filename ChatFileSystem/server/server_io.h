@@ -0,0 +1,32 @@
+#ifndef SERVER_IO_H
+#define SERVER_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+// I/O 엔진: POSIX = 기존 동기 호출, URING = io_uring (raw syscall)
+#define IO_ENGINE_POSIX 0
+#define IO_ENGINE_URING 1
+
+// 완료 콜백 (res = 처리한 바이트 수, 오류면 -errno)
+typedef void (*io_cb)(void *ctx, int res);
+
+int  io_engine_init(int engine);
+int  io_engine(void);
+const char* io_engine_name(void);
+int  io_event_fd(void);
+
+void io_read(int fd, void *buf, size_t len, off_t off, io_cb cb, void *ctx);
+void io_write(int fd, const void *buf, size_t len, off_t off, io_cb cb, void *ctx);
+void io_recv(int fd, void *buf, size_t len, io_cb cb, void *ctx);
+void io_recvmsg(int fd, struct msghdr *mh, int flags, io_cb cb, void *ctx);
+void io_sendmsg(int fd, struct msghdr *mh, int flags, io_cb cb, void *ctx);
+void io_cancel(void *ctx);
+
+int  io_submit(void);
+int  io_complete(void);
+bool io_has_completions(void);
+
+#endif
@@ -3,6 +3,7 @@
 #include <stdarg.h>
 #include <sys/stat.h>
 #include <pthread.h>
+#include "server_trace.h"
 
 pthread_mutex_t server_log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -13,11 +14,15 @@ void server_log(const char *fmt, ...) {
     // server 디렉토리 자동 생성
     mkdir("./server", 0755);
 
+    trace_begin(TR_LOG, -1, 0, 0);
     pthread_mutex_lock(&server_log_mutex);
 
+    trace_begin(TR_LOG_OPEN, -1, 0, 0);
     FILE *fp = fopen("./server/server_log.txt", "a");
+    trace_end(TR_LOG_OPEN, -1, 0, fp != NULL);
     if (!fp) {
         pthread_mutex_unlock(&server_log_mutex);
+        trace_end(TR_LOG, -1, 0, 0);
         return;
     }
 
@@ -37,4 +42,5 @@ void server_log(const char *fmt, ...) {
     fclose(fp);
 
     pthread_mutex_unlock(&server_log_mutex);
+    trace_end(TR_LOG, -1, 0, 1);
 }
@@ -0,0 +1,145 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "server_login.h"
+#include "server_trace.h"
+
+extern void server_log(const char *fmt, ...);
+extern bool check_login(const char *id, const char *pw);
+extern void finish_login(int idx, unsigned gen, int fd, const char *id, bool ok);
+
+/*
+ * MSG_LOGIN 비밀번호 검증을 메인 루프 밖에서 처리
+ *  메인 루프: login_submit → 대기열
+ *  작업 스레드: check_login (해시 계산) → 결과를 파이프에 씀
+ *  메인 루프: 파이프가 읽히면 login_complete → finish_login 으로 응답
+ */
+
+// 로그인 요청 하나 (결과도 같은 구조체로 돌려보냄, 비밀번호는 지운 뒤)
+typedef struct {
+    int      idx;
+    unsigned gen;          // 그 사이 슬롯이 다른 연결로 바뀌었는지 확인용
+    int      fd;
+    char     id[32];
+    char     pw[32];
+    bool     ok;
+} LoginJob;
+
+static LoginJob        jobs[LOGIN_QUEUE_MAX];
+static int             job_head = 0;
+static int             job_count = 0;
+static int             in_flight = 0;     // 대기 + 검증 중 + 결과 미처리
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  job_cond = PTHREAD_COND_INITIALIZER;
+static int             result_pipe[2] = { -1, -1 };
+
+
+static void* login_worker(void *arg) {
+    (void)arg;
+    trace_thread_name("login worker");
+
+    while (1) {
+        pthread_mutex_lock(&job_mutex);
+        while (job_count == 0) pthread_cond_wait(&job_cond, &job_mutex);
+
+        LoginJob job = jobs[job_head];
+        explicit_bzero(&jobs[job_head], sizeof(LoginJob));
+        job_head = (job_head + 1) % LOGIN_QUEUE_MAX;
+        job_count--;
+        pthread_mutex_unlock(&job_mutex);
+
+        trace_begin(TR_LOGIN, job.fd, 0, 0);
+        job.ok = check_login(job.id, job.pw);
+        trace_end(TR_LOGIN, job.fd, 0, job.ok);
+        explicit_bzero(job.pw, sizeof(job.pw));
+
+        // PIPE_BUF 보다 작으므로 한 번에 통째로 써짐
+        if (write(result_pipe[1], &job, sizeof(job)) != (ssize_t)sizeof(job)) {
+            server_log("login: result write failed (errno=%d)", errno);
+        }
+    }
+
+    return NULL;
+}
+
+
+/**
+ * 작업 스레드 시작 (메인 루프 전 한 번)
+ */
+int login_pool_start(void) {
+    if (pipe2(result_pipe, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    // 읽는 쪽만 논블로킹 (작업 스레드는 파이프가 차면 기다림)
+    fcntl(result_pipe[0], F_SETFL, O_NONBLOCK);
+
+    for (int i = 0; i < LOGIN_WORKERS; i++) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, login_worker, NULL) != 0) {
+            perror("pthread_create");
+            return -1;
+        }
+        pthread_detach(tid);
+    }
+    return 0;
+}
+
+/**
+ * 로그인 검증 요청 (대기열이 가득 차면 false → 호출자가 SERVER_BUSY 응답)
+ */
+bool login_submit(int idx, unsigned gen, int fd, const char *id, const char *pw) {
+    pthread_mutex_lock(&job_mutex);
+
+    if (job_count == LOGIN_QUEUE_MAX) {
+        pthread_mutex_unlock(&job_mutex);
+        return false;
+    }
+
+    LoginJob *job = &jobs[(job_head + job_count) % LOGIN_QUEUE_MAX];
+    job->idx = idx;
+    job->gen = gen;
+    job->fd = fd;
+    snprintf(job->id, sizeof(job->id), "%s", id);
+    snprintf(job->pw, sizeof(job->pw), "%s", pw);
+    job->ok = false;
+    job_count++;
+    in_flight++;
+
+    pthread_cond_signal(&job_cond);
+    pthread_mutex_unlock(&job_mutex);
+    return true;
+}
+
+int login_result_fd(void) {
+    return result_pipe[0];
+}
+
+/**
+ * 끝난 검증 결과 처리 (결과 파이프가 읽힐 때 메인 루프에서)
+ */
+void login_complete(void) {
+    LoginJob job;
+
+    while (read(result_pipe[0], &job, sizeof(job)) == (ssize_t)sizeof(job)) {
+        pthread_mutex_lock(&job_mutex);
+        in_flight--;
+        pthread_mutex_unlock(&job_mutex);
+
+        finish_login(job.idx, job.gen, job.fd, job.id, job.ok);
+    }
+}
+
+/**
+ * 아직 응답하지 않은 로그인 수 (무중단 재시작 전 확인)
+ */
+int login_in_flight(void) {
+    pthread_mutex_lock(&job_mutex);
+    int n = in_flight;
+    pthread_mutex_unlock(&job_mutex);
+    return n;
+}
@@ -0,0 +1,16 @@
+#ifndef SERVER_LOGIN_H
+#define SERVER_LOGIN_H
+
+#include <stdbool.h>
+
+// 비밀번호 검증 작업 스레드 수 / 대기열 길이 (넘치면 SERVER_BUSY)
+#define LOGIN_WORKERS    2
+#define LOGIN_QUEUE_MAX  64
+
+int  login_pool_start(void);
+bool login_submit(int idx, unsigned gen, int fd, const char *id, const char *pw);
+int  login_result_fd(void);
+void login_complete(void);
+int  login_in_flight(void);
+
+#endif
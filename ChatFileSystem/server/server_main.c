@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -5,60 +6,283 @@
 #include <arpa/inet.h>
 #include <sys/select.h>
 #include <signal.h>
+#include <errno.h>
 #include <stdbool.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include "protocol.h"
 #include "server_user_list.h"
 #include "server_auth.h"
+#include "server_room.h"
+#include "server_conn.h"
+#include "server_io.h"
+#include "server_session.h"
+#include "server_upgrade.h"
+#include "server_admit.h"
+#include "server_login.h"
+#include "server_passwd.h"
+#include "server_trace.h"
+#include "server_history.h"
+#include "server_presence.h"
+#include "server_heartbeat.h"
+#include "server_peer.h"
 
 // 외부 함수
-bool check_login(const char *id, const char *pw);
 void broadcast(int sender_fd, Message *msg, int max_clients);
 void handle_chat_message(int client_fd, Message *msg,int max_clients);
+void send_room_chat(int client_fd, Message *msg);
 void handle_file_upload(int client_fd, Message *msg);
 void handle_file_download(int client_fd, Message *msg);
+void handle_file_data(int client_fd, Message *msg);
+void handle_file_end(int client_fd, Message *msg);
+void handle_file_copy(int client_fd, Message *msg);
+void handle_file_upload_fd(int client_fd, Message *msg);
+void handle_file_sig_request(int client_fd, Message *msg);
+bool file_transfer_can_read(int idx);
+int  file_transfer_tick(void);
+bool file_transfer_pump(void);
+void init_file_storage(void);
+unsigned file_transfer_id(int idx);
+void send_file_list(int client_fd, Message *msg);
+void push_deliver_notices(int client_fd, const char *username);
+int  chat_limit_tick(void);
 void server_log(const char *fmt, ...);
 
 #define MAX_CLIENTS 10
 int client_sockets[MAX_CLIENTS] = {0};
 
-ssize_t wa;
 
-ssize_t recv_all(int sock, void *buf, size_t size){
-    size_t received = 0;
-    while(received < size){
-        ssize_t len = recv(sock, (char*)buf + received, size - received, 0);
-        if(len <= 0) return len;
-        received += len;
+/**
+ * 클라이언트 메시지 한 개 처리 (수신 버퍼에 프레임이 다 모이면 호출)
+ */
+void handle_client_message(int i, Message *msg) {
+    int sd = client_sockets[i];
+    int type = msg->type;
+
+    trace_begin(TR_DISPATCH, sd, file_transfer_id(i), type);
+    heartbeat_touch(i, type);
+
+    switch (msg->type) {
+        case MSG_FILE_UPLOAD:
+            server_log("%s 파일 업로드 요청", msg->sender);
+            handle_file_upload(sd, msg);
+            break;
+
+        case MSG_FILE_DOWNLOAD:
+            server_log("%s 파일 다운로드 요청", msg->sender);
+            handle_file_download(sd, msg);
+            break;
+
+        case MSG_FILE_LIST_REQUEST:
+            send_file_list(sd, msg);
+            break;
+
+        case MSG_CHAT:
+            if (strcmp(msg->data, "/users") == 0 || strncmp(msg->data, "/users ", 7) == 0) {
+                send_user_list(sd, msg->data[6] ? msg->data + 7 : "");
+            }else if(msg->data[0] == '/' ){
+                handle_chat_message(sd, msg, MAX_CLIENTS);
+            }
+            else {
+                printf("[%s]: %s\n", msg->sender, msg->data);
+                server_log("채팅: %s - %s", msg->sender, msg->data);
+                send_room_chat(sd, msg);
+            }
+            break;
+
+
+        case MSG_EXIT:
+            printf("[SERVER] %s exited. (socket %d)\n", msg->sender, sd);
+            server_log("클라이언트 종료: %s (socket %d)", msg->sender, sd);
+            disconnect_client(i);
+            break;
+
+        case MSG_LOGIN:
+        {
+            // 비밀번호 해시 검증은 작업 스레드에서 → 결과는 finish_login 으로
+            char id[32] = "", pw[32] = "";
+            sscanf(msg->data, "%31s %31s", id, pw);
+
+            if (!login_submit(i, conn_generation(i), sd, id, pw)) {
+                Message reply;
+                memset(&reply, 0, sizeof(reply));
+                reply.type = MSG_ERROR;
+                strcpy(reply.sender, "SERVER");
+                strcpy(reply.data, "SERVER_BUSY");
+                queue_message(sd, &reply);
+            }
+            explicit_bzero(pw, sizeof(pw));
+            explicit_bzero(msg->data, sizeof(msg->data));
+            break;
+        }
+
+
+        case MSG_RESUME:
+            // 끊긴 세션 재개 (비밀번호 확인 없이 토큰으로)
+            if (!session_resume(i, msg->data)) {
+                Message reply;
+                memset(&reply, 0, sizeof(reply));
+                reply.type = MSG_LOGIN_FAIL;
+                strcpy(reply.sender, "SERVER");
+                strcpy(reply.data, "RESUME_FAIL");
+                queue_message(sd, &reply);
+            } else {
+                printf("[SERVER] 세션 재개: %s (socket %d)\n", get_username(sd), sd);
+            }
+            break;
+
+
+        // 업로드 청크/종료는 메인 루프에서 한 개씩 처리
+        case MSG_FILE_DATA:
+            handle_file_data(sd, msg);
+            break;
+
+        case MSG_FILE_END:
+            handle_file_end(sd, msg);
+            break;
+
+        // 델타 업로드: 이전 버전 서명 요청 / 이전 버전 블록 참조
+        case MSG_FILE_SIG_REQUEST:
+            handle_file_sig_request(sd, msg);
+            break;
+
+        case MSG_FILE_COPY:
+            handle_file_copy(sd, msg);
+            break;
+
+        // 로컬(UNIX 소켓) 연결: 같이 넘어온 fd 에서 서버가 직접 읽어 저장
+        case MSG_FILE_UPLOAD_FD:
+            server_log("%s 파일 업로드 요청 (fd)", msg->sender);
+            handle_file_upload_fd(sd, msg);
+            break;
+
+        // 수신 시각은 위에서 기록했으므로 더 할 일 없음
+        case MSG_PING:
+        case MSG_PONG:
+            break;
+
+        case MSG_LIST_REQEUST:
+            presence_send_page(sd, msg->data);
+            break;
+
+        case MSG_PRESENCE_SUB:
+            // 로그인한 연결만 접속/종료 알림 구독
+            if (get_username(sd) && get_username(sd)[0] != '\0') {
+                presence_subscribe(i, msg->data[0] == '1');
+            }
+            break;
+
+        // 서버→클라이언트 전용 메시지가 들어오면 로그만 찍고 무시
+        case MSG_FILE_READY:
+        case MSG_ERROR:
+            server_log("예상치 못한 위치에서 파일 관련 메시지 수신(type=%d)", msg->type);
+            break;
+
+        default:
+            server_log("알 수 없는 메시지 타입 수신(type=%d)", msg->type);
+            break;
     }
 
-    return received;
+    // 이번 메시지로 시작된 전송도 같은 ID 로 묶이도록 끝에서 다시 조회
+    trace_end(TR_DISPATCH, sd, file_transfer_id(i), type);
+}
+
+/**
+ * 로그인 검증 결과 처리 (login_complete 에서 호출)
+ * 그 사이 연결이 끊겼거나 슬롯이 다른 연결로 바뀌었으면 버림
+ */
+void finish_login(int i, unsigned gen, int sd, const char *id, bool ok) {
+    if (client_sockets[i] != sd || conn_generation(i) != gen) return;
+
+    Message reply;
+    memset(&reply, 0, sizeof(reply));
+    strcpy(reply.sender, "SERVER");
+
+    if (ok) {
+        // 재접속용 토큰을 같이 내려줌 ("LOGIN_OK <토큰>")
+        char token[SESSION_TOKEN_LEN + 1];
+        reply.type = MSG_LOGIN_OK;
+        if (session_issue(i, id, token)) {
+            snprintf(reply.data, sizeof(reply.data), "LOGIN_OK %s", token);
+        } else {
+            strcpy(reply.data, "LOGIN_OK");
+        }
+        queue_message(sd, &reply);
+
+        register_user(sd, id);           // username 기록
+        assign_root_if_first(sd);        // root 자동 배정
+        room_join(i, DEFAULT_ROOM);      // lobby 자동 입장
+        push_deliver_notices(sd, id);    // 오프라인일 때 받은 푸시 안내
+
+        printf("[SERVER] 로그인 성공: %s (socket %d)\n", id, sd);
+    }
+    else {
+        reply.type = MSG_LOGIN_FAIL;
+        strcpy(reply.data, "LOGIN_FAIL");
+        queue_message(sd, &reply);
+
+        printf("[SERVER] 로그인 실패: %s\n", id);
+    }
+}
+
+/**
+ * -H: 표준 입력의 비밀번호를 해시해서 users.txt 한 줄에 넣을 값 출력
+ */
+static int print_password_hash(void) {
+    char pw[64];
+    if (!fgets(pw, sizeof(pw), stdin)) return EXIT_FAILURE;
+    pw[strcspn(pw, "\r\n")] = '\0';
+
+    char hash[PASSWD_HASH_MAX];
+    bool ok = passwd_hash(pw, get_hash_rounds(), hash, sizeof(hash));
+    explicit_bzero(pw, sizeof(pw));
+    if (!ok) return EXIT_FAILURE;
+
+    printf("%s\n", hash);
+    return 0;
 }
 
 void cleanup(int signo) {
     printf("\n[SERVER] 종료 중...\n");
+    upgrade_cleanup();
+    admit_cleanup();
+    peer_shutdown();
     server_log("서버 정상 종료됨.");
     exit(0);
 }
 
-int main() {
-    signal(SIGINT, cleanup);
-
-    int server_fd, client_fd, max_fd, activity;
-    struct sockaddr_in server_addr, client_addr;
-    socklen_t addrlen;
-    fd_set readfds;
-    Message msg;
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-b backlog] [-d flush_delay_us] [-e posix|uring] [-k rounds]\n"
+            "          [-p ping_sec] [-t pong_sec] [-i idle_sec] [-L path] [-P port]\n"
+            "          [-F peer_port] [-R host:port]... [-K key] [-u] [-H]\n"
+            "  -b  listen 대기열 길이 (기본 %d)\n"
+            "  -d  부하 시 송신 묶음 대기 시간 (us, 기본 %d, 0 = 매 턴 즉시)\n"
+            "  -e  I/O 엔진 (기본 posix, uring 을 못 쓰면 posix 로 대체)\n"
+            "  -k  비밀번호 해시 비용 (SHA-512 crypt rounds, 기본 %d)\n"
+            "  -p  수신이 없을 때 PING 을 보내는 간격 (초, 기본 %d, 0 = 끔)\n"
+            "  -t  PING 뒤 응답을 기다리는 시간 (초, 기본 %d, 넘으면 연결 정리)\n"
+            "  -i  채팅/명령 없이 이 시간이 지나면 연결 종료 (초, 기본 %d = 끔)\n"
+            "  -L  같은 호스트용 UNIX 소켓 경로 (기본 %s, - 면 끔)\n"
+            "  -P  클라이언트 포트 (기본 %d, 한 호스트에 여러 서버를 띄울 때)\n"
+            "  -F  다른 서버의 링크를 받을 포트 (서버 간 중계, 기본 끔)\n"
+            "  -R  이 서버가 링크를 걸 다른 서버의 -F 주소 (여러 번 지정 가능)\n"
+            "  -K  서버 간 링크 키 (양쪽이 같아야 연결됨, -F/-R 에 필수)\n"
+            "  -u  실행 중인 서버에서 리스닝 소켓/접속자를 넘겨받아 교체 (무중단 재시작)\n"
+            "  -H  표준 입력의 비밀번호를 해시해서 출력 (users.txt 용)\n",
+            prog, ACCEPT_BACKLOG, FLUSH_DELAY_US, PASSWD_ROUNDS,
+            HB_PING_SEC, HB_PONG_SEC, HB_IDLE_SEC, LOCAL_SOCK_PATH, SERVER_PORT);
+}
 
-    // 업로드 파일 저장용 디렉토리
-    if(system("mkdir -p server/server_storage")){
-        perror("system");
-    }
+/**
+ * 리스닝 소켓 생성 (실패하면 종료)
+ */
+static int open_listen_socket(int port) {
+    struct sockaddr_in server_addr;
 
     // 1. 소켓 생성(IPv4, TCP로 동작하는 소켓 생성)
 
-    server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) {
         perror("socket failed");
         exit(EXIT_FAILURE);
@@ -72,7 +296,7 @@ int main() {
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;           // IPv4
     server_addr.sin_addr.s_addr = INADDR_ANY;   // 모든 IP에서 받기
-    server_addr.sin_port = htons(SERVER_PORT);  // 포트 지정
+    server_addr.sin_port = htons(port);         // 포트 지정
 
     if (bind(server_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         perror("bind failed");
@@ -81,159 +305,312 @@ int main() {
     }
 
     // 3. 클라이언트 요청 대기(서버가 문열고 기다리기)
-    if (listen(server_fd, 3) < 0) {
+    //    (재접속 폭주 때 SYN 이 버려지지 않게 넉넉한 대기열)
+    if (listen(server_fd, admit_backlog()) < 0) {
         perror("listen failed");
         close(server_fd);
         exit(EXIT_FAILURE);
     }
 
+    return server_fd;
+}
+
+int main(int argc, char *argv[]) {
+    signal(SIGINT, cleanup);
+    signal(SIGPIPE, SIG_IGN);
+    trace_install_signal();          // SIGUSR1 → trace 덤프
+
+    int opt_c;
+    int want_engine = IO_ENGINE_POSIX;
+    bool upgrade = false;
+    bool hash_only = false;
+    const char *local_path = LOCAL_SOCK_PATH;
+    int listen_port = SERVER_PORT;
+    int peer_port = 0;
+    bool peer_remote = false;
+    bool peer_keyed = false;
+    while ((opt_c = getopt(argc, argv, "b:d:e:k:p:t:i:L:P:F:R:K:uHh")) != -1) {
+        switch (opt_c) {
+            case 'b':
+                admit_set_backlog(atoi(optarg));
+                break;
+            case 'd':
+                conn_set_flush_delay(atoi(optarg));
+                break;
+            case 'e':
+                if (strcmp(optarg, "uring") == 0) {
+                    want_engine = IO_ENGINE_URING;
+                } else if (strcmp(optarg, "posix") != 0) {
+                    usage(argv[0]);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case 'k':
+                set_hash_rounds(atoi(optarg));
+                break;
+            case 'p':
+                heartbeat_configure(atoi(optarg), -1, -1);
+                break;
+            case 't':
+                heartbeat_configure(-1, atoi(optarg), -1);
+                break;
+            case 'i':
+                heartbeat_configure(-1, -1, atoi(optarg));
+                break;
+            case 'L':
+                local_path = strcmp(optarg, "-") == 0 ? NULL : optarg;
+                break;
+            case 'P':
+                listen_port = atoi(optarg);
+                break;
+            case 'F':
+                peer_port = atoi(optarg);
+                break;
+            case 'R':
+                if (peer_add(optarg) < 0) {
+                    fprintf(stderr, "[SERVER] -R %s: 주소를 찾을 수 없거나 너무 많음\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+                peer_remote = true;
+                break;
+            case 'K':
+                peer_set_key(optarg);
+                peer_keyed = optarg[0] != '\0';
+                break;
+            case 'u':
+                upgrade = true;
+                break;
+            case 'H':
+                hash_only = true;
+                break;
+            default:
+                usage(argv[0]);
+                exit(opt_c == 'h' ? 0 : EXIT_FAILURE);
+        }
+    }
+
+    if (hash_only) return print_password_hash();
+
+    // 서버 간 링크는 키 필수 (키 없이 받으면 아무 프로세스나 다른 서버 행세를 함)
+    if ((peer_port > 0 || peer_remote) && !peer_keyed) {
+        fprintf(stderr, "[SERVER] -F/-R 에는 -K 키가 필요함\n");
+        exit(EXIT_FAILURE);
+    }
+
+    int server_fd = -1, local_fd = -1, peer_fd = -1, max_fd, activity;
+    fd_set readfds, writefds;
+
+    // 무중단 재시작: 기존 서버가 전송을 마치고 소켓을 넘길 때까지 대기
+    // (저장소 스캔은 기존 서버가 업로드를 다 끝낸 뒤에 해야 하므로 가장 먼저)
+    if (upgrade) {
+        server_fd = upgrade_receive(&local_fd, &peer_fd);
+        if (server_fd < 0) {
+            fprintf(stderr, "[SERVER] 업그레이드 실패: 실행 중인 서버에서 소켓을 받지 못함\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // 업로드 파일 저장용 디렉토리
+    if(system("mkdir -p server/server_storage")){
+        perror("system");
+    }
+
+    // 저장소 카탈로그 구성 (디렉토리 1회 스캔)
+    init_file_storage();
+
+    // 기본 채팅방(lobby) 생성
+    room_init();
+
+    // 채팅 기록 색인 구성 (/search)
+    history_init();
+
+    // 넘겨받은 리스닝 소켓이 없으면 새로 bind
+    if (server_fd < 0) server_fd = open_listen_socket(listen_port);
+    admit_prepare_listener(server_fd);
+
+    // 같은 호스트의 봇/도구용 로컬 리스너 (연결 이후 처리는 TCP 와 같음)
+    if (local_fd >= 0 && local_path) {
+        admit_adopt_local(local_fd, local_path);
+    } else {
+        if (local_fd >= 0) close(local_fd);
+        local_fd = local_path ? admit_listen_local(local_path) : -1;
+    }
+
+    // 다른 서버와 링크 (-F 로 받고 -R 로 검, 실제 연결은 메인 루프에서)
+    if (peer_fd >= 0 && peer_port > 0) {
+        peer_adopt_listener(peer_fd);
+    } else {
+        if (peer_fd >= 0) close(peer_fd);
+        if (peer_port > 0 && peer_listen(peer_port) < 0) {
+            perror("peer listen failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    peer_start(listen_port);
+
     //printf("[DEBUG] SERVER sizeof(Message) = %ld\n", sizeof(Message));
 
 
-    printf("[SERVER] Listening on port %d...\n", SERVER_PORT);
-    server_log("서버 시작 (포트 %d)", SERVER_PORT);
+    io_engine_init(want_engine);
+
+    // 로그인 비밀번호 검증 작업 스레드
+    if (login_pool_start() < 0) exit(EXIT_FAILURE);
+
+    if (upgrade) {
+        int adopted = upgrade_adopt();
+        printf("[SERVER] 업그레이드 완료: 접속자 %d명 인계받음\n", adopted);
+    }
+
+    // 다음 업그레이드 요청을 받을 제어 소켓
+    upgrade_listen();
+
+    trace_thread_name("main loop");
+
+    printf("[SERVER] Listening on port %d... (I/O: %s)\n", listen_port, io_engine_name());
+    server_log("서버 시작 (포트 %d)", listen_port);
+    if (peer_port > 0) printf("[SERVER] Peer port: %d\n", peer_port);
+    if (local_fd >= 0) printf("[SERVER] Local socket: %s\n", local_path);
 
     while (1) {
         FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
         FD_SET(server_fd, &readfds);
         max_fd = server_fd;
+        if (local_fd >= 0) {
+            FD_SET(local_fd, &readfds);
+            if (local_fd > max_fd) max_fd = local_fd;
+        }
+
+        FD_SET(login_result_fd(), &readfds);
+        if (login_result_fd() > max_fd) max_fd = login_result_fd();
+
+        int ctl = upgrade_watch_fd();
+        if (ctl >= 0) {
+            FD_SET(ctl, &readfds);
+            if (ctl > max_fd) max_fd = ctl;
+        }
+
+        // 무중단 재시작 중: 전송이 끝나고 큐가 비면 여기서 인계 후 종료
+        long upgrade_ms = upgrade_tick(server_fd);
+
+        // 업로드 크레딧 지급 (토큰 대기 중이면 그 시간만큼만 select 대기)
+        long wait_us = file_transfer_tick();
+        if (wait_us > 0) wait_us *= 1000;
+
+        // 재접속 대기 세션 만료 처리
+        long session_ms = session_tick();
+        if (session_ms >= 0 && (wait_us < 0 || session_ms * 1000 < wait_us)) {
+            wait_us = session_ms * 1000;
+        }
+        if (upgrade_ms >= 0 && (wait_us < 0 || upgrade_ms * 1000 < wait_us)) {
+            wait_us = upgrade_ms * 1000;
+        }
+
+        // 한도 초과로 합쳐둔 채팅 전송
+        long chat_ms = chat_limit_tick();
+        if (chat_ms >= 0 && (wait_us < 0 || chat_ms * 1000 < wait_us)) {
+            wait_us = chat_ms * 1000;
+        }
+
+        // 응답 없는/유휴 연결 정리 (타이머 휠에서 마감이 된 칸만)
+        long hb_ms = heartbeat_tick();
+        if (hb_ms >= 0 && (wait_us < 0 || hb_ms * 1000 < wait_us)) {
+            wait_us = hb_ms * 1000;
+        }
+
+        // 서버 간 링크: 재접속, 생존 신호, 카탈로그 변경 전달
+        long peer_ms = peer_tick();
+        if (peer_ms >= 0 && (wait_us < 0 || peer_ms * 1000 < wait_us)) {
+            wait_us = peer_ms * 1000;
+        }
+
+        // 다운로드 청크 채우기 → 이번 턴에 쌓인 프레임을 연결별로 한 번에 전송
+        if (file_transfer_pump()) wait_us = 0;
+
+        long flush_us = conn_flush_all();
+        if (flush_us >= 0 && (wait_us < 0 || flush_us < wait_us)) wait_us = flush_us;
+        peer_flush();
+
+        struct timeval tv, *timeout = NULL;
+        if (wait_us >= 0) {
+            tv.tv_sec = wait_us / 1000000;
+            tv.tv_usec = wait_us % 1000000;
+            timeout = &tv;
+        }
 
         // 기존 클라이언트 소켓들을 감시 목록에 추가
+        // (업로드 크레딧을 다 쓴 연결은 제외 → 송신측이 TCP 레벨에서 대기)
+        // (송신 버퍼가 가득 찬 연결은 쓰기 가능 여부도 감시)
+        // io_uring: 수신은 커널에 걸어두고 완료 알림(eventfd)만 감시
+        // (인계 직전에는 수신을 멈춤 → 남은 데이터는 소켓과 함께 새 서버로)
+        bool uring = io_engine() == IO_ENGINE_URING;
+        bool reading = !upgrade_quiescing();
         for (int i = 0; i < MAX_CLIENTS; i++) {
             int sd = client_sockets[i];
-            if (sd > 0) FD_SET(sd, &readfds);
+            if (sd <= 0) continue;
+
+            if (uring) {
+                if (reading && file_transfer_can_read(i)) conn_read(i);
+            } else {
+                if (reading && file_transfer_can_read(i)) FD_SET(sd, &readfds);
+                if (conn_write_blocked(i)) FD_SET(sd, &writefds);
+            }
             if (sd > max_fd) max_fd = sd;
         }
 
-        // 4. I/O 이벤트 감지(select(감시할 fd개수 + 1, 읽을 데이터 있는지 감시하는 파일 집합, 파일에 데이터 쓸 수 있는지 검사하기 위한 파일집합)..)
-        activity = select(max_fd + 1, &readfds, NULL, NULL, NULL);
-        if (activity < 0) {
-            perror("select error");
-            continue;
+        max_fd = peer_fdset(&readfds, &writefds, max_fd);
+
+        if (uring) {
+            io_submit();
+            FD_SET(io_event_fd(), &readfds);
+            if (io_event_fd() > max_fd) max_fd = io_event_fd();
         }
 
-        // 5. 신규 접속 처리
-        if (FD_ISSET(server_fd, &readfds)) {
-            addrlen = sizeof(client_addr);
-            client_fd = accept(server_fd, (struct sockaddr *)&client_addr, &addrlen);
-            if (client_fd < 0) {
-                perror("accept failed");
-                continue;
-            }
+        // 이미 끝난 I/O 가 있으면 기다리지 않음
+        if (io_has_completions()) {
+            tv.tv_sec = 0;
+            tv.tv_usec = 0;
+            timeout = &tv;
+        }
 
-            printf("[SERVER] 새 연결: socket %d\n", client_fd);
-            server_log("클라이언트 연결 (socket %d)", client_fd);
+        // 4. I/O 이벤트 감지(select(감시할 fd개수 + 1, 읽을 데이터 있는지 감시하는 파일 집합, 파일에 데이터 쓸 수 있는지 검사하기 위한 파일집합)..)
+        trace_begin(TR_SELECT, -1, 0, 0);
+        activity = select(max_fd + 1, &readfds, &writefds, NULL, timeout);
+        int select_errno = errno;
+        trace_end(TR_SELECT, -1, 0, activity);
 
-            for (int i = 0; i < MAX_CLIENTS; i++) {
-                if (client_sockets[i] == 0) {
-                    client_sockets[i] = client_fd;
-                    break;
-                }
-            }
+        // 시그널로 깨어난 경우 (SIGUSR1 덤프 요청 등)
+        trace_poll();
+        if (activity < 0) {
+            if (select_errno != EINTR) perror("select error");
+            continue;
         }
 
-        // 6. 기존 클라이언트 메시지 처리
+        // 쓰기 가능해진 연결은 남은 큐 전송
         for (int i = 0; i < MAX_CLIENTS; i++) {
             int sd = client_sockets[i];
+            if (sd > 0 && !uring && FD_ISSET(sd, &writefds)) conn_flush(i);
+        }
 
-            if (sd > 0 && FD_ISSET(sd, &readfds)) {
-                //여기서 sizeof(Message)로 설정햇더라도 read로는 읽어오지 못한다.
-                //int valread = read(sd, &msg, sizeof(Message)); // 클라이언트 → 서버
-                int valread = recv_all(sd, &msg, sizeof(Message));
-                // 연결 종료/오류
-                if (valread <= 0) {
-                    printf("[SERVER] Client %d disconnected\n", sd);
-                    server_log("클라이언트 비정상 종료 (socket %d)", sd);
-                    close(sd);
-                    client_sockets[i] = 0;
-                    continue;
-                }
+        if (ctl >= 0 && FD_ISSET(ctl, &readfds)) upgrade_on_readable();
 
-                switch (msg.type) {
-                    case MSG_FILE_UPLOAD:
-                        server_log("%s 파일 업로드 요청", msg.sender);
-                        handle_file_upload(sd, &msg);
-                        break;
-
-                    case MSG_FILE_DOWNLOAD:
-                        server_log("%s 파일 다운로드 요청", msg.sender);
-                        handle_file_download(sd, &msg);
-                        break;
-
-                    case MSG_CHAT:
-                        if (strcmp(msg.data, "/users") == 0) {
-                            send_user_list(sd);
-                        }else if(msg.data[0] == '/' ){
-                            handle_chat_message(sd, &msg, MAX_CLIENTS);
-                        }
-                        else {
-                            printf("[%s]: %s\n", msg.sender, msg.data);
-                            server_log("채팅: %s - %s", msg.sender, msg.data);
-                            broadcast(sd, &msg, MAX_CLIENTS);
-                        }
-                        break;
-
-
-                    case MSG_EXIT:
-                        printf("[SERVER] %s exited. (socket %d)\n", msg.sender, sd);
-                        server_log("클라이언트 종료: %s (socket %d)", msg.sender, sd);
-                        close(sd);
-                        client_sockets[i] = 0;
-                        break;
-
-                    case MSG_LOGIN:
-                    {
-                        char id[32], pw[32];
-                        sscanf(msg.data, "%s %s", id, pw);
-
-                        Message reply;
-                        memset(&reply, 0, sizeof(reply));
-                        strcpy(reply.sender, "SERVER");
-
-                        if (check_login(id, pw)) {
-                            reply.type = MSG_LOGIN_OK;
-                            strcpy(reply.data, "LOGIN_OK");
-                            wa = write(sd, &reply, sizeof(reply));
-                            if(wa < 0){
-                                perror("write");
-                            }
-
-                            register_user(sd, id);           // username 기록
-                            assign_root_if_first(sd);        // root 자동 배정
-
-                            printf("[SERVER] 로그인 성공: %s (socket %d)\n", id, sd);
-                        }
-                        else {
-                            reply.type = MSG_LOGIN_FAIL;
-                            strcpy(reply.data, "LOGIN_FAIL");
-                            wa = write(sd, &reply, sizeof(reply));
-
-                            if(wa < 0){
-                                perror("write");
-                            }
-
-                            printf("[SERVER] 로그인 실패: %s\n", id);
-                        }
-                        break;
-                    }
-
-
-                    // 파일 데이터/종료 메시지는 보통 handle_file_* 내부에서 처리하겠지만,
-                    // 혹시 여기로 들어오면 로그만 찍고 무시
-                    case MSG_FILE_DATA:
-                    case MSG_FILE_END:
-                    case MSG_FILE_READY:
-                    case MSG_LIST_REQEUST:
-                        send_user_list(sd);
-                    case MSG_ERROR:
-                        server_log("예상치 못한 위치에서 파일 관련 메시지 수신(type=%d)", msg.type);
-                        break;
-
-                    default:
-                        server_log("알 수 없는 메시지 타입 수신(type=%d)", msg.type);
-                        break;
-                }
-            }
+        // 검증이 끝난 로그인 응답
+        if (FD_ISSET(login_result_fd(), &readfds)) login_complete();
+
+        // 5. 신규 접속 처리 (대기열을 비울 때까지 한 번에, 만석/속도 초과는 거절)
+        if (FD_ISSET(server_fd, &readfds)) admit_accept(server_fd);
+        if (local_fd >= 0 && FD_ISSET(local_fd, &readfds)) admit_accept(local_fd);
+
+        // 다른 서버 링크 (받은 채팅/접속자/파일 목록 적용 후 나머지 링크로 전달)
+        peer_on_ready(&readfds, &writefds);
+
+        // 6. 기존 클라이언트 메시지 수신 (POSIX: 읽을 수 있는 연결만 recv)
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            int sd = client_sockets[i];
+            if (sd > 0 && !uring && FD_ISSET(sd, &readfds)) conn_read(i);
         }
+
+        // 7. 완료된 송수신/파일 I/O 처리 → 메시지 핸들러 호출
+        io_complete();
     }
 }
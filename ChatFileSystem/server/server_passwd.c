@@ -0,0 +1,91 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <crypt.h>
+#include <sys/random.h>
+#include "server_passwd.h"
+
+extern void server_log(const char *fmt, ...);
+
+// crypt 솔트에 쓸 수 있는 문자
+static const char salt_chars[] =
+    "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+static bool random_bytes(unsigned char *buf, size_t len) {
+    if (getrandom(buf, len, 0) == (ssize_t)len) return true;
+
+    int fd = open("/dev/urandom", O_RDONLY);
+    bool ok = fd >= 0 && read(fd, buf, len) == (ssize_t)len;
+    if (fd >= 0) close(fd);
+    return ok;
+}
+
+// 해시가 같은지 길이/내용과 무관하게 같은 시간에 비교
+static bool hash_equal(const char *a, const char *b) {
+    size_t la = strlen(a), lb = strlen(b);
+    unsigned char diff = la != lb;
+
+    for (size_t i = 0; i < la && i < lb; i++) {
+        diff |= (unsigned char)a[i] ^ (unsigned char)b[i];
+    }
+    return diff == 0;
+}
+
+
+/**
+ * 새 솔트로 비밀번호 해시 생성 (작업 스레드에서 호출해도 안전)
+ */
+bool passwd_hash(const char *pw, int rounds, char *out, size_t outsize) {
+    unsigned char raw[PASSWD_SALT_LEN];
+    if (!random_bytes(raw, sizeof(raw))) {
+        server_log("passwd: no random source");
+        return false;
+    }
+
+    char setting[64];
+    int n = snprintf(setting, sizeof(setting), "$6$rounds=%d$", rounds);
+    for (int i = 0; i < PASSWD_SALT_LEN; i++) {
+        setting[n++] = salt_chars[raw[i] % 64];
+    }
+    setting[n] = '\0';
+
+    struct crypt_data *cd = calloc(1, sizeof(struct crypt_data));
+    if (!cd) return false;
+
+    const char *h = crypt_r(pw, setting, cd);
+    bool ok = h && h[0] == '$' && strlen(h) < outsize;
+    if (ok) strcpy(out, h);
+
+    explicit_bzero(cd, sizeof(*cd));
+    free(cd);
+    return ok;
+}
+
+/**
+ * 저장된 해시와 비교 (저장된 값에 든 솔트/rounds 를 그대로 사용)
+ */
+bool passwd_verify(const char *pw, const char *stored) {
+    struct crypt_data *cd = calloc(1, sizeof(struct crypt_data));
+    if (!cd) return false;
+
+    const char *h = crypt_r(pw, stored, cd);
+    bool ok = h && h[0] == '$' && hash_equal(h, stored);
+
+    explicit_bzero(cd, sizeof(*cd));
+    free(cd);
+    return ok;
+}
+
+/**
+ * 평문이거나 지금 설정보다 가벼운 해시인지 (로그인 성공 시 다시 해시)
+ */
+bool passwd_needs_rehash(const char *stored, int rounds) {
+    if (strncmp(stored, "$6$", 3) != 0) return true;
+
+    int stored_rounds = 5000;        // rounds= 가 없으면 crypt 기본값
+    sscanf(stored, "$6$rounds=%d$", &stored_rounds);
+    return stored_rounds < rounds;
+}
@@ -0,0 +1,17 @@
+#ifndef SERVER_PASSWD_H
+#define SERVER_PASSWD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// users.txt 비밀번호 해시: SHA-512 crypt ("$6$rounds=N$salt$hash")
+//  rounds 가 비용 (클수록 느림), 해시마다 저장되므로 나중에 올려도 기존 해시는 그대로 검증
+#define PASSWD_ROUNDS      50000
+#define PASSWD_SALT_LEN    16
+#define PASSWD_HASH_MAX    128
+
+bool passwd_hash(const char *pw, int rounds, char *out, size_t outsize);
+bool passwd_verify(const char *pw, const char *stored);
+bool passwd_needs_rehash(const char *stored, int rounds);
+
+#endif
@@ -0,0 +1,1176 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/random.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "protocol.h"
+#include "server_peer.h"
+#include "server_bucket.h"
+#include "server_catalog.h"
+#include "server_presence.h"
+#include "server_room.h"
+
+extern int client_sockets[];
+extern char usernames[][MAX_NAME];
+extern void server_log(const char *fmt, ...);
+extern void deliver_peer_chat(const char *room, const char *sender, const char *text);
+
+#define MAX_CLIENTS 10
+
+/*
+ * 링크 위의 레코드 = 16바이트 헤더(네트워크 바이트 순서) + 내용
+ *   len(4, 헤더 포함) type(1) hops(1) flags(2) origin(4) seq(4)
+ * 내용은 '\0' 으로 구분한 문자열들
+ *
+ * 중복/루프 방지
+ *  - 채팅: 출발 서버별 최근 PEER_WINDOW 개 순번 비트맵 (처음 본 것만 전달, 채팅만의 순번)
+ *  - 접속자/파일: 상태라서 "더 새 순번일 때만 적용" → 같은 걸 여러 경로로 받아도 한 번만 전달
+ *  링크가 새로 붙으면 아는 상태(다른 서버 것 포함)를 그 링크로 다시 보내서 맞춤
+ */
+enum {
+    PR_HELLO = 1,    // 링크 시작: 키 \0 서버 이름 (전달하지 않음)
+    PR_CHAT,         // 방 채팅: 방 \0 보낸사람 \0 본문
+    PR_ROSTER,       // 출발 서버의 접속자 전체: 서버 이름 \0 이름 \0 ... (PF_BYE = 종료)
+    PR_FILE,         // 파일 등록/갱신: 이름 \0 소유자 \0 "크기 mtime 만료"
+    PR_FILE_DEL,     // 파일 삭제: 이름
+    PR_FILE_SYNC,    // 파일 목록을 처음부터 다시 보냈음: "기준 순번" → 그보다 오래된 항목은 지움
+};
+#define PF_BYE 1
+
+#define HDR_SIZE        16
+#define RECORD_MAX      4096
+#define PEER_WINDOW     1024          // 채팅 중복 확인 창 (순번 수, 64의 배수)
+#define HELLO_SEC       10            // 인사가 끝나지 않은 링크를 기다리는 시간
+#define FILE_BUCKETS    1024          // 2의 거듭제곱
+#define NAME_LEN        64
+
+enum { LINK_FREE = 0, LINK_CONNECTING, LINK_HELLO, LINK_UP };
+
+typedef struct {
+    int      state;
+    int      fd;
+    int      conf;                    // -R 항목 (-1 = 받아들인 링크)
+    bool     dead;                    // 다음 정리 때 닫음
+    uint32_t origin;                  // 상대 서버 ID (UP 이후)
+    char     name[NAME_LEN];
+    double   opened;
+    double   last_rx;
+    char    *out;                     // 이번 턴에 쌓인 레코드 (한 번에 send)
+    size_t   out_len, out_cap;
+    char     in[RECORD_MAX * 2];
+    size_t   in_len;
+    unsigned long rx_records, tx_records, tx_writes;
+} PeerLink;
+
+// -R 로 지정한 상대 (주소는 시작할 때 한 번만 찾음)
+typedef struct {
+    char     host[128];
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    int      link;                    // 잡고 있는 링크 (-1 = 없음)
+    double   next_try;
+    int      backoff;
+} PeerConf;
+
+// 다른 서버 하나에 대해 아는 것
+typedef struct {
+    bool     in_use;
+    uint32_t id;
+    char     name[NAME_LEN];
+    uint32_t roster_seq;              // 적용한 마지막 접속자 목록
+    double   heard;                   // 새 목록을 마지막으로 적용한 시각
+    char     users[MAX_CLIENTS][MAX_NAME];
+    int      user_count;
+    bool     win_init;
+    uint32_t win_top;
+    uint64_t win[PEER_WINDOW / 64];   // 비트 k = 순번 win_top - k 를 봤음
+    uint32_t floor;                   // 이보다 오래된 파일 항목은 무시 (PR_FILE_SYNC)
+    uint32_t floor_seq;
+} Origin;
+
+// 다른 서버의 파일 하나 (삭제도 순번과 함께 남겨서 늦게 온 옛 등록을 막음)
+typedef struct RemoteFile {
+    uint32_t origin;
+    uint32_t seq;
+    bool     deleted;
+    char     name[256];
+    char     owner[MAX_NAME];
+    long     size;
+    long     mtime;
+    long     expire_at;
+    struct RemoteFile *next;
+} RemoteFile;
+
+static PeerLink   links[PEER_LINKS_MAX];
+static PeerConf   confs[PEER_LINKS_MAX];
+static int        conf_count = 0;
+static Origin     origins[PEER_ORIGINS_MAX];
+static RemoteFile *file_buckets[FILE_BUCKETS];
+static int        file_count = 0;         // 삭제 표시 포함
+static int        live_files = 0;
+
+static int      listen_fd = -1;
+static char     peer_key[64] = "";
+static uint32_t self_id = 0;
+static char     self_name[NAME_LEN];
+static uint32_t self_seq = 0;            // 접속자/파일 레코드 순번
+static uint32_t self_chat_seq = 0;       // 채팅 순번 (따로 세야 파일 목록 전송이 중복 확인 창을 밀지 않음)
+static bool     started = false;
+static double   next_beat = 0;
+static char     last_roster[MAX_CLIENTS * MAX_NAME + 1];   // 마지막으로 알린 내 접속자 (비교용)
+
+static unsigned long stat_relayed = 0, stat_dup = 0, stat_dropped = 0;
+
+
+/* ===================== 레코드 ===================== */
+
+static void put32(unsigned char *p, uint32_t v) {
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+static uint32_t get32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+/**
+ * 링크 송신 버퍼 뒤에 레코드 하나 (실제 전송은 peer_flush 에서 한 번에)
+ */
+static void link_append(PeerLink *l, int type, int hops, int flags,
+                        uint32_t origin, uint32_t seq, const char *data, size_t len) {
+    if (l->dead) return;
+
+    size_t need = HDR_SIZE + len;
+    if (l->out_len + need > PEER_SENDQ_MAX) {
+        server_log("peer %s: send queue over %d bytes, dropping link", l->name, PEER_SENDQ_MAX);
+        l->dead = true;
+        return;
+    }
+    if (l->out_len + need > l->out_cap) {
+        size_t cap = l->out_cap ? l->out_cap : 16 * 1024;
+        while (cap < l->out_len + need) cap *= 2;
+        char *p = realloc(l->out, cap);
+        if (!p) {
+            l->dead = true;
+            return;
+        }
+        l->out = p;
+        l->out_cap = cap;
+    }
+
+    unsigned char *h = (unsigned char *)l->out + l->out_len;
+    put32(h, (uint32_t)need);
+    h[4] = (unsigned char)type;
+    h[5] = (unsigned char)hops;
+    h[6] = (unsigned char)(flags >> 8);
+    h[7] = (unsigned char)flags;
+    put32(h + 8, origin);
+    put32(h + 12, seq);
+    memcpy(h + HDR_SIZE, data, len);
+    l->out_len += need;
+    l->tx_records++;
+}
+
+/**
+ * 열린 링크 전부에 (except 는 받은 링크 → 되돌려 보내지 않음)
+ */
+static void flood(int except, int type, int hops, int flags,
+                  uint32_t origin, uint32_t seq, const char *data, size_t len) {
+    for (int i = 0; i < PEER_LINKS_MAX; i++) {
+        if (i == except || links[i].state != LINK_UP) continue;
+        link_append(&links[i], type, hops, flags, origin, seq, data, len);
+    }
+}
+
+/**
+ * 문자열들을 '\0' 구분으로 이어붙임 (반환: 길이, 넘치면 -1)
+ */
+static int pack_fields(char *out, size_t cap, const char **fields, int n) {
+    size_t len = 0;
+    for (int i = 0; i < n; i++) {
+        size_t l = strlen(fields[i]) + 1;
+        if (len + l > cap) return -1;
+        memcpy(out + len, fields[i], l);
+        len += l;
+    }
+    return (int)len;
+}
+
+/**
+ * 내용을 '\0' 기준으로 나눔 (마지막 필드가 '\0' 없이 끝나면 잘못된 레코드)
+ */
+static int split_fields(char *data, size_t len, char **out, int max) {
+    int n = 0;
+    size_t i = 0;
+    while (i < len && n < max) {
+        char *end = memchr(data + i, '\0', len - i);
+        if (!end) return -1;
+        out[n++] = data + i;
+        i = (size_t)(end - data) + 1;
+    }
+    return n;
+}
+
+
+// 키 비교는 내용과 무관하게 같은 시간 (0 으로 채운 peer_key 크기 전체를 비교)
+static bool key_equal(const char *given) {
+    char buf[sizeof(peer_key)];
+    size_t len = strnlen(given, sizeof(buf));
+    unsigned char diff = len == sizeof(buf);     // 너무 긴 키도 불일치
+
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, given, len < sizeof(buf) ? len : sizeof(buf) - 1);
+    for (size_t i = 0; i < sizeof(buf); i++)
+        diff |= (unsigned char)buf[i] ^ (unsigned char)peer_key[i];
+    return diff == 0;
+}
+
+
+/* ===================== 다른 서버 상태 ===================== */
+
+static Origin* origin_find(uint32_t id) {
+    for (int i = 0; i < PEER_ORIGINS_MAX; i++) {
+        if (origins[i].in_use && origins[i].id == id) return &origins[i];
+    }
+    return NULL;
+}
+
+static Origin* origin_get(uint32_t id) {
+    Origin *o = origin_find(id);
+    if (o) return o;
+
+    for (int i = 0; i < PEER_ORIGINS_MAX; i++) {
+        if (origins[i].in_use) continue;
+        o = &origins[i];
+        memset(o, 0, sizeof(*o));
+        o->in_use = true;
+        o->id = id;
+        o->heard = now_seconds();     // 목록이 한 번도 안 오면 이 시각 기준으로 만료
+        snprintf(o->name, sizeof(o->name), "%08x", id);
+        return o;
+    }
+
+    stat_dropped++;
+    return NULL;
+}
+
+static unsigned int file_hash(uint32_t origin, const char *name) {
+    unsigned int h = 2166136261u ^ origin;       // FNV-1a
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h & (FILE_BUCKETS - 1);
+}
+
+static RemoteFile* file_find(uint32_t origin, const char *name) {
+    for (RemoteFile *f = file_buckets[file_hash(origin, name)]; f; f = f->next) {
+        if (f->origin == origin && strcmp(f->name, name) == 0) return f;
+    }
+    return NULL;
+}
+
+/**
+ * 조건에 맞는 origin 의 파일 항목 삭제 (min_seq = 0 이면 전부)
+ */
+static void file_purge(uint32_t origin, uint32_t min_seq, bool all) {
+    for (int b = 0; b < FILE_BUCKETS; b++) {
+        RemoteFile **pp = &file_buckets[b];
+        while (*pp) {
+            RemoteFile *f = *pp;
+            if (f->origin == origin && (all || f->seq < min_seq)) {
+                *pp = f->next;
+                if (!f->deleted) live_files--;
+                file_count--;
+                free(f);
+                continue;
+            }
+            pp = &f->next;
+        }
+    }
+}
+
+/**
+ * 서버가 종료/무응답 → 그 서버 접속자는 퇴장, 파일 목록에서도 뺌
+ */
+static void origin_drop(Origin *o, const char *why) {
+    for (int k = 0; k < o->user_count; k++) presence_leave(o->users[k]);
+    file_purge(o->id, 0, true);
+    server_log("peer: server %s (%08x) gone (%s), %d users removed",
+               o->name, o->id, why, o->user_count);
+    o->in_use = false;
+}
+
+static bool has_user(char users[][MAX_NAME], int count, const char *name) {
+    for (int k = 0; k < count; k++) {
+        if (strcmp(users[k], name) == 0) return true;
+    }
+    return false;
+}
+
+/**
+ * 채팅 순번 중복 확인 (처음 보면 표시하고 true)
+ */
+static bool window_accept(Origin *o, uint32_t seq) {
+    if (!o->win_init) {
+        o->win_init = true;
+        o->win_top = seq;
+        memset(o->win, 0, sizeof(o->win));
+        o->win[0] = 1;
+        return true;
+    }
+
+    int32_t ahead = (int32_t)(seq - o->win_top);
+    if (ahead > 0) {
+        // 창을 ahead 만큼 밀기 (비트 k → k + ahead)
+        uint32_t d = (uint32_t)ahead;
+        if (d >= PEER_WINDOW) {
+            memset(o->win, 0, sizeof(o->win));
+        } else {
+            int words = d / 64, bits = d % 64;
+            for (int i = PEER_WINDOW / 64 - 1; i >= 0; i--) {
+                int src = i - words;
+                uint64_t v = 0;
+                if (src >= 0) {
+                    v = o->win[src] << bits;
+                    if (bits && src > 0) v |= o->win[src - 1] >> (64 - bits);
+                }
+                o->win[i] = v;
+            }
+        }
+        o->win_top = seq;
+        o->win[0] |= 1;
+        return true;
+    }
+
+    uint32_t back = (uint32_t)-ahead;
+    if (back >= PEER_WINDOW) return false;        // 너무 오래된 순번
+    uint64_t bit = 1ULL << (back % 64);
+    if (o->win[back / 64] & bit) return false;
+    o->win[back / 64] |= bit;
+    return true;
+}
+
+
+/* ===================== 받은 레코드 적용 ===================== */
+
+// 다른 서버가 보낸 보낸사람 이름: 제어 문자 없이, SERVER 행세 금지 (기록 파일 형식도 지킴)
+static bool valid_sender(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= MAX_NAME || strcmp(name, "SERVER") == 0) return false;
+
+    for (size_t i = 0; i < len; i++) {
+        if ((unsigned char)name[i] < 0x20 || name[i] == 0x7f) return false;
+    }
+    return true;
+}
+
+static bool apply_chat(Origin *o, uint32_t seq, char **f, int n) {
+    if (n < 3 || !room_name_valid(f[0]) || !valid_sender(f[1])) {
+        server_log("peer: bad chat record from %s dropped", o->name);
+        return false;
+    }
+    if (!window_accept(o, seq)) return false;
+    deliver_peer_chat(f[0], f[1], f[2]);
+    return true;
+}
+
+static bool apply_roster(Origin *o, uint32_t seq, int flags, char **f, int n) {
+    if (n < 1 || seq <= o->roster_seq) return false;
+
+    if (flags & PF_BYE) {
+        o->roster_seq = seq;
+        origin_drop(o, "shutdown");
+        return true;
+    }
+
+    char users[MAX_CLIENTS][MAX_NAME];
+    int count = 0;
+    for (int k = 1; k < n && count < MAX_CLIENTS; k++) {
+        if (f[k][0] == '\0' || has_user(users, count, f[k])) continue;
+        snprintf(users[count++], MAX_NAME, "%s", f[k]);
+    }
+
+    // 바뀐 이름만 접속/종료 처리 (같은 목록 반복은 생존 신호)
+    for (int k = 0; k < count; k++) {
+        if (!has_user(o->users, o->user_count, users[k])) presence_join(users[k]);
+    }
+    for (int k = 0; k < o->user_count; k++) {
+        if (!has_user(users, count, o->users[k])) presence_leave(o->users[k]);
+    }
+
+    if (strcmp(o->name, f[0]) != 0) {
+        server_log("peer: server %s (%08x) joined", f[0], o->id);
+        snprintf(o->name, sizeof(o->name), "%s", f[0]);
+    }
+    memcpy(o->users, users, sizeof(users));
+    o->user_count = count;
+    o->roster_seq = seq;
+    o->heard = now_seconds();
+    return true;
+}
+
+static bool apply_file(Origin *o, uint32_t seq, bool deleted, char **f, int n) {
+    if (n < (deleted ? 1 : 3) || seq < o->floor) return false;
+
+    RemoteFile *rf = file_find(o->id, f[0]);
+    if (rf && (int32_t)(seq - rf->seq) <= 0) return false;
+
+    if (!rf) {
+        if (file_count >= PEER_FILES_MAX) {
+            stat_dropped++;
+            return false;
+        }
+        rf = calloc(1, sizeof(RemoteFile));
+        if (!rf) return false;
+        rf->origin = o->id;
+        rf->deleted = true;
+        snprintf(rf->name, sizeof(rf->name), "%s", f[0]);
+        unsigned int b = file_hash(o->id, rf->name);
+        rf->next = file_buckets[b];
+        file_buckets[b] = rf;
+        file_count++;
+    }
+
+    if (rf->deleted && !deleted) live_files++;
+    if (!rf->deleted && deleted) live_files--;
+    rf->deleted = deleted;
+    rf->seq = seq;
+    if (!deleted) {
+        snprintf(rf->owner, sizeof(rf->owner), "%s", f[1]);
+        sscanf(f[2], "%ld %ld %ld", &rf->size, &rf->mtime, &rf->expire_at);
+    }
+    return true;
+}
+
+static bool apply_sync(Origin *o, uint32_t seq, char **f, int n) {
+    unsigned long floor;
+    if (n < 1 || sscanf(f[0], "%lu", &floor) != 1) return false;
+    if ((int32_t)((uint32_t)floor - o->floor) <= 0) return false;
+
+    o->floor = (uint32_t)floor;
+    o->floor_seq = seq;
+    file_purge(o->id, o->floor, false);
+    return true;
+}
+
+static void link_up(int li);
+
+/**
+ * 인사: 키 확인 → 같은 상대와 링크가 둘이면 ID 가 작은 쪽이 건 링크만 남김
+ */
+static void handle_hello(int li, uint32_t origin, char **f, int n) {
+    PeerLink *l = &links[li];
+
+    if (l->state != LINK_HELLO || n < 2 || peer_key[0] == '\0' || !key_equal(f[0])) {
+        server_log("peer: handshake rejected on link %d (bad key or state)", li);
+        l->dead = true;
+        return;
+    }
+    if (origin == self_id) {
+        server_log("peer: link %d reached this server itself, closing", li);
+        l->dead = true;
+        return;
+    }
+
+    uint32_t keeper = origin < self_id ? origin : self_id;
+    for (int j = 0; j < PEER_LINKS_MAX; j++) {
+        PeerLink *m = &links[j];
+        if (j == li || m->state != LINK_UP || m->origin != origin) continue;
+
+        uint32_t mine = l->conf >= 0 ? self_id : origin;
+        uint32_t theirs = m->conf >= 0 ? self_id : origin;
+        if (mine == keeper && theirs != keeper) {
+            m->dead = true;
+        } else {
+            l->dead = true;
+            return;
+        }
+    }
+
+    l->origin = origin;
+    snprintf(l->name, sizeof(l->name), "%s", f[1]);
+
+    // 받아들인 쪽은 인사를 받고 나서 답함
+    if (l->conf < 0) {
+        char buf[256];
+        const char *fields[] = { peer_key, self_name };
+        int len = pack_fields(buf, sizeof(buf), fields, 2);
+        link_append(l, PR_HELLO, 0, 0, self_id, 0, buf, len);
+    }
+    link_up(li);
+}
+
+static void handle_record(int li, const unsigned char *rec, size_t len) {
+    PeerLink *l = &links[li];
+    int type = rec[4], hops = rec[5];
+    int flags = (rec[6] << 8) | rec[7];
+    uint32_t origin = get32(rec + 8), seq = get32(rec + 12);
+
+    char data[RECORD_MAX];
+    size_t dlen = len - HDR_SIZE;
+    memcpy(data, rec + HDR_SIZE, dlen);
+
+    char *f[MAX_CLIENTS + 2];
+    int n = split_fields(data, dlen, f, MAX_CLIENTS + 2);
+    if (n < 0) {
+        server_log("peer %s: malformed record (type %d)", l->name, type);
+        l->dead = true;
+        return;
+    }
+
+    l->rx_records++;
+    if (type == PR_HELLO) {
+        handle_hello(li, origin, f, n);
+        return;
+    }
+    if (l->state != LINK_UP) {
+        l->dead = true;
+        return;
+    }
+
+    // 자기가 보낸 것이 돌아왔거나 너무 멀리 돈 것
+    if (origin == self_id || hops >= PEER_MAX_HOPS) {
+        stat_dup++;
+        return;
+    }
+
+    // 이미 정리한 서버의 종료 알림이 다른 경로로 또 온 것
+    Origin *o = type == PR_ROSTER && (flags & PF_BYE) ? origin_find(origin) : origin_get(origin);
+    if (!o) return;
+
+    bool applied = false;
+    switch (type) {
+        case PR_CHAT:      applied = apply_chat(o, seq, f, n);               break;
+        case PR_ROSTER:    applied = apply_roster(o, seq, flags, f, n);      break;
+        case PR_FILE:      applied = apply_file(o, seq, false, f, n);        break;
+        case PR_FILE_DEL:  applied = apply_file(o, seq, true, f, n);         break;
+        case PR_FILE_SYNC: applied = apply_sync(o, seq, f, n);               break;
+        default:
+            server_log("peer %s: unknown record type %d", l->name, type);
+            return;
+    }
+
+    if (!applied) {
+        stat_dup++;
+        return;
+    }
+
+    // 처음 본 것만 나머지 링크로 (받은 레코드 그대로, 홉 수만 증가)
+    stat_relayed++;
+    flood(li, type, hops + 1, flags, origin, seq, data, dlen);
+}
+
+
+/* ===================== 이 서버 상태 알리기 ===================== */
+
+/**
+ * 지금 로그인한 사용자 (중복 없이, client_sockets[] 순서)
+ */
+static int local_roster(char users[][MAX_NAME]) {
+    int count = 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (client_sockets[i] <= 0 || usernames[i][0] == '\0') continue;
+        if (has_user(users, count, usernames[i])) continue;
+        snprintf(users[count++], MAX_NAME, "%s", usernames[i]);
+    }
+    return count;
+}
+
+static void send_roster(int only, int flags) {
+    char users[MAX_CLIENTS][MAX_NAME];
+    int count = local_roster(users);
+
+    const char *fields[MAX_CLIENTS + 1];
+    fields[0] = self_name;
+    for (int k = 0; k < count; k++) fields[k + 1] = users[k];
+
+    char buf[RECORD_MAX];
+    int len = pack_fields(buf, sizeof(buf), fields, count + 1);
+    if (len < 0) return;
+
+    uint32_t seq = ++self_seq;
+    if (only >= 0) link_append(&links[only], PR_ROSTER, 0, flags, self_id, seq, buf, len);
+    else flood(-1, PR_ROSTER, 0, flags, self_id, seq, buf, len);
+}
+
+static int encode_file(char *buf, size_t cap, const char *name, const char *owner,
+                       long size, long mtime, long expire_at) {
+    char meta[64];
+    snprintf(meta, sizeof(meta), "%ld %ld %ld", size, mtime, expire_at);
+    const char *fields[] = { name, owner, meta };
+    return pack_fields(buf, cap, fields, 3);
+}
+
+static void snapshot_cb(const CatalogEntry *e, void *arg) {
+    int only = *(int *)arg;
+    char buf[RECORD_MAX];
+    int len = encode_file(buf, sizeof(buf), e->name, e->owner,
+                          e->size, (long)e->mtime, (long)e->expire_at);
+    if (len < 0) return;
+
+    uint32_t seq = ++self_seq;
+    if (only >= 0) link_append(&links[only], PR_FILE, 0, 0, self_id, seq, buf, len);
+    else flood(-1, PR_FILE, 0, 0, self_id, seq, buf, len);
+}
+
+/**
+ * 내 파일 목록 전체 + 기준 순번 (받는 쪽은 그 전 항목을 지움 → 끊긴 동안 지운 파일도 정리)
+ */
+static void send_file_snapshot(int only) {
+    uint32_t floor = self_seq + 1;
+    catalog_foreach(snapshot_cb, &only);
+
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "%u", floor) + 1;
+    uint32_t seq = ++self_seq;
+    if (only >= 0) link_append(&links[only], PR_FILE_SYNC, 0, 0, self_id, seq, buf, len);
+    else flood(-1, PR_FILE_SYNC, 0, 0, self_id, seq, buf, len);
+}
+
+/**
+ * 카탈로그 변경 한 건 (catalog_drain_changes 콜백, name == NULL 이면 놓친 변경이 있어 전체 다시)
+ */
+static void catalog_change_cb(const char *name, void *arg) {
+    (void)arg;
+    if (!name) {
+        send_file_snapshot(-1);
+        return;
+    }
+
+    char buf[RECORD_MAX];
+    CatalogEntry e;
+    if (catalog_lookup(name, &e)) {
+        int len = encode_file(buf, sizeof(buf), e.name, e.owner,
+                              e.size, (long)e.mtime, (long)e.expire_at);
+        if (len > 0) flood(-1, PR_FILE, 0, 0, self_id, ++self_seq, buf, len);
+    } else {
+        int len = snprintf(buf, sizeof(buf), "%s", name) + 1;
+        flood(-1, PR_FILE_DEL, 0, 0, self_id, ++self_seq, buf, len);
+    }
+}
+
+/**
+ * 새 링크: 아는 다른 서버 상태를 원래 순번 그대로 보내고, 내 상태는 새 순번으로
+ */
+static void link_up(int li) {
+    PeerLink *l = &links[li];
+    l->state = LINK_UP;
+    if (l->conf >= 0) confs[l->conf].backoff = 1;
+
+    for (int i = 0; i < PEER_ORIGINS_MAX; i++) {
+        Origin *o = &origins[i];
+        if (!o->in_use || o->id == l->origin) continue;
+
+        char buf[RECORD_MAX];
+        if (o->roster_seq > 0) {
+            const char *fields[MAX_CLIENTS + 1];
+            fields[0] = o->name;
+            for (int k = 0; k < o->user_count; k++) fields[k + 1] = o->users[k];
+            int len = pack_fields(buf, sizeof(buf), fields, o->user_count + 1);
+            if (len > 0) link_append(l, PR_ROSTER, 0, 0, o->id, o->roster_seq, buf, len);
+        }
+        if (o->floor > 0) {
+            int len = snprintf(buf, sizeof(buf), "%u", o->floor) + 1;
+            link_append(l, PR_FILE_SYNC, 0, 0, o->id, o->floor_seq, buf, len);
+        }
+    }
+
+    for (int b = 0; b < FILE_BUCKETS; b++) {
+        for (RemoteFile *f = file_buckets[b]; f; f = f->next) {
+            if (f->origin == l->origin) continue;
+
+            char buf[RECORD_MAX];
+            int len;
+            if (f->deleted) {
+                len = snprintf(buf, sizeof(buf), "%s", f->name) + 1;
+            } else {
+                len = encode_file(buf, sizeof(buf), f->name, f->owner,
+                                  f->size, f->mtime, f->expire_at);
+            }
+            if (len > 0) {
+                link_append(l, f->deleted ? PR_FILE_DEL : PR_FILE, 0, 0, f->origin, f->seq, buf, len);
+            }
+        }
+    }
+
+    send_roster(li, 0);
+    send_file_snapshot(li);
+
+    printf("[SERVER] 서버 링크 연결: %s\n", l->name);
+    server_log("peer: link up with %s (%08x, %s)", l->name, l->origin,
+               l->conf >= 0 ? "outbound" : "inbound");
+}
+
+
+/* ===================== 링크 관리 ===================== */
+
+static int link_alloc(int fd, int conf, int state) {
+    for (int i = 0; i < PEER_LINKS_MAX; i++) {
+        PeerLink *l = &links[i];
+        if (l->state != LINK_FREE) continue;
+
+        char *out = l->out;
+        size_t cap = l->out_cap;
+        memset(l, 0, sizeof(*l));
+        l->out = out;                 // 송신 버퍼는 재사용
+        l->out_cap = cap;
+        l->fd = fd;
+        l->conf = conf;
+        l->state = state;
+        l->opened = l->last_rx = now_seconds();
+        snprintf(l->name, sizeof(l->name), "%s", conf >= 0 ? confs[conf].host : "inbound");
+        return i;
+    }
+    return -1;
+}
+
+static void link_close(int li) {
+    PeerLink *l = &links[li];
+    if (l->state == LINK_FREE) return;
+
+    if (l->state == LINK_UP) {
+        printf("[SERVER] 서버 링크 끊김: %s\n", l->name);
+        server_log("peer: link down with %s", l->name);
+    }
+    close(l->fd);
+
+    // 다시 걸 상대면 간격을 두 배씩 늘려서 재시도
+    if (l->conf >= 0) {
+        PeerConf *c = &confs[l->conf];
+        c->link = -1;
+        c->next_try = now_seconds() + c->backoff;
+        c->backoff = c->backoff * 2 > PEER_RETRY_MAX_SEC ? PEER_RETRY_MAX_SEC : c->backoff * 2;
+    }
+
+    l->state = LINK_FREE;
+    l->out_len = 0;
+    l->in_len = 0;
+    l->dead = false;
+}
+
+static void set_nonblock(int fd) {
+    int fl = fcntl(fd, F_GETFL, 0);
+    if (fl >= 0) fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void send_hello(PeerLink *l) {
+    char buf[256];
+    const char *fields[] = { peer_key, self_name };
+    int len = pack_fields(buf, sizeof(buf), fields, 2);
+    link_append(l, PR_HELLO, 0, 0, self_id, 0, buf, len);
+}
+
+static void try_connect(int ci) {
+    PeerConf *c = &confs[ci];
+
+    int fd = socket(c->addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return;
+    set_nonblock(fd);
+
+    int li = link_alloc(fd, ci, LINK_CONNECTING);
+    if (li < 0) {
+        close(fd);
+        c->next_try = now_seconds() + PEER_RETRY_MAX_SEC;
+        return;
+    }
+    c->link = li;
+
+    if (connect(fd, (struct sockaddr *)&c->addr, c->addrlen) == 0) {
+        links[li].state = LINK_HELLO;
+        send_hello(&links[li]);
+    } else if (errno != EINPROGRESS) {
+        link_close(li);
+    }
+}
+
+/**
+ * 받은 바이트에서 완성된 레코드만 처리
+ */
+static void link_read(int li) {
+    PeerLink *l = &links[li];
+
+    ssize_t n = recv(l->fd, l->in + l->in_len, sizeof(l->in) - l->in_len, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        l->dead = true;
+        return;
+    }
+    if (n < 0) return;
+
+    l->in_len += n;
+    l->last_rx = now_seconds();
+
+    size_t off = 0;
+    while (!l->dead && l->in_len - off >= HDR_SIZE) {
+        uint32_t len = get32((unsigned char *)l->in + off);
+        if (len < HDR_SIZE || len > RECORD_MAX) {
+            server_log("peer %s: bad record length %u", l->name, len);
+            l->dead = true;
+            return;
+        }
+        if (l->in_len - off < len) break;
+
+        handle_record(li, (unsigned char *)l->in + off, len);
+        off += len;
+    }
+
+    memmove(l->in, l->in + off, l->in_len - off);
+    l->in_len -= off;
+}
+
+
+/* ===================== 공개 함수 ===================== */
+
+/**
+ * -R host:port (시작 전에, 주소는 여기서 한 번 찾음)
+ */
+int peer_add(const char *hostport) {
+    if (conf_count == PEER_LINKS_MAX) return -1;
+
+    char host[128];
+    const char *colon = strrchr(hostport, ':');
+    if (!colon || colon == hostport || (size_t)(colon - hostport) >= sizeof(host)) return -1;
+    snprintf(host, sizeof(host), "%.*s", (int)(colon - hostport), hostport);
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, colon + 1, &hints, &res) != 0) return -1;
+
+    PeerConf *c = &confs[conf_count++];
+    memset(c, 0, sizeof(*c));
+    snprintf(c->host, sizeof(c->host), "%s", hostport);
+    memcpy(&c->addr, res->ai_addr, res->ai_addrlen);
+    c->addrlen = res->ai_addrlen;
+    c->link = -1;
+    c->backoff = 1;
+    freeaddrinfo(res);
+    return 0;
+}
+
+void peer_set_key(const char *key) {
+    memset(peer_key, 0, sizeof(peer_key));
+    snprintf(peer_key, sizeof(peer_key), "%s", key);
+}
+
+/**
+ * -F port: 다른 서버의 링크를 받을 소켓
+ */
+int peer_listen(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, PEER_LINKS_MAX) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    peer_adopt_listener(fd);
+    return fd;
+}
+
+/**
+ * 넘겨받은(무중단 재시작) 또는 방금 연 링크 리스너 등록
+ */
+void peer_adopt_listener(int fd) {
+    listen_fd = fd;
+    int fl = fcntl(fd, F_GETFL, 0);
+    if (fl >= 0) fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+}
+
+int peer_listen_fd(void) {
+    return listen_fd;
+}
+
+/**
+ * 서버 ID/이름 정하고 시작 (링크는 peer_tick 에서 검)
+ * ID 는 실행마다 새로 → 재시작한 서버는 다른 서버에게 새 서버로 보임
+ */
+void peer_start(int client_port) {
+    if (listen_fd < 0 && conf_count == 0) return;
+
+    if (getrandom(&self_id, sizeof(self_id), 0) != (ssize_t)sizeof(self_id)) {
+        self_id = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+    }
+    if (self_id == 0) self_id = 1;
+
+    char host[48] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    snprintf(self_name, sizeof(self_name), "%.40s:%d", host, client_port);
+
+    catalog_track_changes(true);
+    started = true;
+    next_beat = now_seconds();
+    server_log("peer: this server is %s (%08x), %d configured peers", self_name, self_id, conf_count);
+}
+
+/**
+ * 종료/인계 전에 다른 서버에 알림 (접속자/파일 목록에서 바로 빠지게)
+ * 논블로킹으로 한 번만 시도 → 보통은 큐가 비어 있어 종료 알림만 나감
+ * 밀린 링크는 기다리지 않음 (상대는 PEER_ORIGIN_SEC 뒤 이 서버를 정리)
+ */
+void peer_shutdown(void) {
+    if (!started) return;
+
+    send_roster(-1, PF_BYE);
+    peer_flush();
+}
+
+/**
+ * 메인 루프 매 턴: 재접속, 생존 신호, 무응답 서버/링크 정리, 카탈로그 변경 전달
+ * 반환: 다음 할 일까지 ms (할 일 없으면 -1)
+ */
+int peer_tick(void) {
+    if (!started) return -1;
+
+    double now = now_seconds();
+    double next = next_beat;
+
+    // 내 접속자: 바뀌었으면 바로, 아니어도 PEER_BEAT_SEC 마다 (생존 신호)
+    char users[MAX_CLIENTS][MAX_NAME];
+    int count = local_roster(users);
+    char joined[sizeof(last_roster)];
+    size_t len = 0;
+    for (int k = 0; k < count; k++) {
+        len += snprintf(joined + len, sizeof(joined) - len, "%s\n", users[k]);
+    }
+    joined[len] = '\0';
+
+    if (now >= next_beat || strcmp(joined, last_roster) != 0) {
+        memcpy(last_roster, joined, len + 1);
+        send_roster(-1, 0);
+        next_beat = now + PEER_BEAT_SEC;
+        next = next_beat;
+    }
+
+    catalog_drain_changes(catalog_change_cb, NULL);
+
+    for (int i = 0; i < PEER_ORIGINS_MAX; i++) {
+        Origin *o = &origins[i];
+        if (!o->in_use) continue;
+        if (now - o->heard > PEER_ORIGIN_SEC) {
+            origin_drop(o, "timeout");
+        } else if (o->heard + PEER_ORIGIN_SEC < next) {
+            next = o->heard + PEER_ORIGIN_SEC;
+        }
+    }
+
+    for (int i = 0; i < PEER_LINKS_MAX; i++) {
+        PeerLink *l = &links[i];
+        if (l->state == LINK_FREE) continue;
+
+        double limit = l->state == LINK_UP ? l->last_rx + PEER_LINK_SEC : l->opened + HELLO_SEC;
+        if (now > limit) {
+            server_log("peer %s: no traffic, closing link", l->name);
+            l->dead = true;
+        }
+        if (l->dead) link_close(i);
+        else if (limit < next) next = limit;
+    }
+
+    for (int ci = 0; ci < conf_count; ci++) {
+        PeerConf *c = &confs[ci];
+        if (c->link >= 0) continue;
+        if (now >= c->next_try) try_connect(ci);
+        else if (c->next_try < next) next = c->next_try;
+    }
+
+    int ms = (int)((next - now) * 1000) + 1;
+    return ms > 0 ? ms : 0;
+}
+
+/**
+ * 쌓인 레코드 전송 (링크마다 send 한 번, 다 못 보낸 나머지는 쓰기 가능할 때)
+ */
+void peer_flush(void) {
+    for (int i = 0; i < PEER_LINKS_MAX; i++) {
+        PeerLink *l = &links[i];
+        if (l->state < LINK_HELLO || l->dead || l->out_len == 0) continue;
+
+        ssize_t n = send(l->fd, l->out, l->out_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) l->dead = true;
+            continue;
+        }
+        l->tx_writes++;
+        memmove(l->out, l->out + n, l->out_len - n);
+        l->out_len -= n;
+    }
+}
+
+/**
+ * select 감시 목록에 리스너/링크 추가 (반환: 새 max_fd)
+ */
+int peer_fdset(fd_set *rfds, fd_set *wfds, int max_fd) {
+    if (listen_fd >= 0) {
+        FD_SET(listen_fd, rfds);
+        if (listen_fd > max_fd) max_fd = listen_fd;
+    }
+
+    for (int i = 0; i < PEER_LINKS_MAX; i++) {
+        PeerLink *l = &links[i];
+        if (l->state == LINK_FREE) continue;
+
+        if (l->state != LINK_CONNECTING) FD_SET(l->fd, rfds);
+        if (l->state == LINK_CONNECTING || l->out_len > 0) FD_SET(l->fd, wfds);
+        if (l->fd > max_fd) max_fd = l->fd;
+    }
+    return max_fd;
+}
+
+void peer_on_ready(fd_set *rfds, fd_set *wfds) {
+    if (listen_fd >= 0 && FD_ISSET(listen_fd, rfds)) {
+        int fd;
+        while ((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+            set_nonblock(fd);
+            if (link_alloc(fd, -1, LINK_HELLO) < 0) {
+                server_log("peer: link table full, rejecting");
+                close(fd);
+            }
+        }
+    }
+
+    for (int i = 0; i < PEER_LINKS_MAX; i++) {
+        PeerLink *l = &links[i];
+        if (l->state == LINK_FREE) continue;
+
+        if (l->state == LINK_CONNECTING && FD_ISSET(l->fd, wfds)) {
+            int err = 0;
+            socklen_t elen = sizeof(err);
+            getsockopt(l->fd, SOL_SOCKET, SO_ERROR, &err, &elen);
+            if (err != 0) {
+                l->dead = true;
+            } else {
+                l->state = LINK_HELLO;
+                l->opened = now_seconds();
+                send_hello(l);
+            }
+        } else if (FD_ISSET(l->fd, rfds)) {
+            link_read(i);
+        }
+
+        if (l->dead) link_close(i);
+    }
+}
+
+/**
+ * 이 서버 사용자의 방 채팅을 다른 서버로 (deliver_room_chat 에서 호출)
+ */
+void peer_relay_chat(const char *room, const char *sender, const char *text) {
+    if (!started) return;
+
+    char buf[RECORD_MAX];
+    const char *fields[] = { room, sender ? sender : "", text };
+    int len = pack_fields(buf, sizeof(buf), fields, 3);
+    if (len > 0) flood(-1, PR_CHAT, 0, 0, self_id, ++self_chat_seq, buf, len);
+}
+
+int peer_file_count(void) {
+    return live_files;
+}
+
+static int cmp_file(const void *a, const void *b) {
+    const RemoteFile *x = *(RemoteFile * const *)a, *y = *(RemoteFile * const *)b;
+    int c = strcmp(x->name, y->name);
+    return c ? c : (x->origin > y->origin) - (x->origin < y->origin);
+}
+
+/**
+ * /files @[prefix] [page]: 다른 서버에 있는 파일 목록 한 페이지 (이름순)
+ * 반환: 쓴 길이
+ */
+int peer_file_page(int page, const char *prefix, char *buf, size_t bufsize) {
+    RemoteFile **list = malloc(sizeof(RemoteFile *) * (live_files > 0 ? live_files : 1));
+    int total = 0;
+    size_t plen = strlen(prefix);
+
+    for (int b = 0; list && b < FILE_BUCKETS; b++) {
+        for (RemoteFile *f = file_buckets[b]; f; f = f->next) {
+            if (f->deleted || total == live_files || strncmp(f->name, prefix, plen) != 0) continue;
+            list[total++] = f;
+        }
+    }
+    qsort(list, total, sizeof(RemoteFile *), cmp_file);
+
+    int pages = (total + CATALOG_PAGE_SIZE - 1) / CATALOG_PAGE_SIZE;
+    if (pages == 0) pages = 1;
+    if (page > pages) page = pages;
+
+    size_t off = snprintf(buf, bufsize, "[Files on other servers] page %d/%d (%d files)\n",
+                          page, pages, total);
+
+    for (int i = (page - 1) * CATALOG_PAGE_SIZE; i < total && i < page * CATALOG_PAGE_SIZE; i++) {
+        Origin *o = origin_find(list[i]->origin);
+        int n = snprintf(buf + off, bufsize - off, "- %.64s (%ld B, %s, @%s)\n",
+                         list[i]->name, list[i]->size, list[i]->owner, o ? o->name : "?");
+        if (n < 0 || off + n >= bufsize) break;
+        off += n;
+    }
+
+    free(list);
+    return (int)off;
+}
+
+/**
+ * /peers (root): 링크/다른 서버 상태
+ */
+void peer_stats(char *buf, size_t bufsize) {
+    if (!started) {
+        snprintf(buf, bufsize, "Federation off (use -F / -R).");
+        return;
+    }
+
+    size_t off = snprintf(buf, bufsize,
+                          "Server %s (%08x): %lu relayed, %lu duplicates, %lu dropped\n",
+                          self_name, self_id, stat_relayed, stat_dup, stat_dropped);
+
+    static const char *state_names[] = { "free", "connecting", "hello", "up" };
+    for (int i = 0; i < PEER_LINKS_MAX && off < bufsize; i++) {
+        PeerLink *l = &links[i];
+        if (l->state == LINK_FREE) continue;
+        off += snprintf(buf + off, bufsize - off,
+                        "link %s [%s, %s]: %lu rx, %lu tx in %lu writes\n",
+                        l->name, state_names[l->state], l->conf >= 0 ? "out" : "in",
+                        l->rx_records, l->tx_records, l->tx_writes);
+    }
+
+    for (int ci = 0; ci < conf_count && off < bufsize; ci++) {
+        if (confs[ci].link < 0) {
+            off += snprintf(buf + off, bufsize - off, "link %s [retrying]\n", confs[ci].host);
+        }
+    }
+
+    double now = now_seconds();
+    for (int i = 0; i < PEER_ORIGINS_MAX && off < bufsize; i++) {
+        Origin *o = &origins[i];
+        if (!o->in_use) continue;
+        off += snprintf(buf + off, bufsize - off, "server %s: %d users, heard %.0fs ago\n",
+                        o->name, o->user_count, now - o->heard);
+    }
+    if (off < bufsize) snprintf(buf + off, bufsize - off, "%d files on other servers", live_files);
+}
@@ -0,0 +1,40 @@
+#ifndef SERVER_PEER_H
+#define SERVER_PEER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/select.h>
+
+// 서버 간 중계 (여러 인스턴스가 방 채팅 / 접속자 / 파일 목록을 공유)
+//  -F port 로 다른 서버의 링크를 받고, -R host:port 로 다른 서버에 링크를 검 (양쪽 같은 -K 키)
+//  이벤트마다 (출발 서버 ID, 순번) → 처음 본 것만 적용하고, 적용한 것만 받은 링크를 뺀 나머지로 전달
+//  링크별 송신은 한 턴에 쌓인 레코드를 send 한 번으로 묶음
+#define PEER_LINKS_MAX      8       // 링크 수 (-R 로 지정한 것 + 받아들인 것)
+#define PEER_ORIGINS_MAX    16      // 기억하는 다른 서버 수
+#define PEER_FILES_MAX      4096    // 다른 서버 파일 목록 항목 수 상한 (삭제 표시 포함)
+#define PEER_BEAT_SEC       5       // 자기 접속자 목록을 다시 알리는 간격 (생존 신호 겸)
+#define PEER_ORIGIN_SEC     15      // 이만큼 새 목록이 없는 서버는 접속자/파일 목록에서 뺌
+#define PEER_LINK_SEC       20      // 링크에서 이만큼 아무것도 안 오면 끊음
+#define PEER_RETRY_MAX_SEC  30      // 재접속 간격 상한 (1초부터 두 배씩)
+#define PEER_MAX_HOPS       8
+#define PEER_SENDQ_MAX      (4 * 1024 * 1024)   // 넘으면 링크를 끊고 재접속 때 다시 맞춤
+
+int  peer_add(const char *hostport);
+void peer_set_key(const char *key);
+int  peer_listen(int port);
+void peer_adopt_listener(int fd);
+int  peer_listen_fd(void);
+void peer_start(int client_port);
+void peer_shutdown(void);
+
+int  peer_tick(void);
+int  peer_fdset(fd_set *rfds, fd_set *wfds, int max_fd);
+void peer_on_ready(fd_set *rfds, fd_set *wfds);
+void peer_flush(void);
+
+void peer_relay_chat(const char *room, const char *sender, const char *text);
+int  peer_file_count(void);
+int  peer_file_page(int page, const char *prefix, char *buf, size_t bufsize);
+void peer_stats(char *buf, size_t bufsize);
+
+#endif
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "protocol.h"
+#include "server_presence.h"
+#include "server_auth.h"
+#include "server_conn.h"
+#include "server_peer.h"
+
+extern int client_sockets[];
+extern void server_log(const char *fmt, ...);
+
+#define MAX_CLIENTS 10
+// 이 서버 연결 수 + 다른 서버들의 접속자 (server_peer 가 join/leave 로 알려줌)
+#define ROSTER_MAX  (MAX_CLIENTS + PEER_ORIGINS_MAX * MAX_CLIENTS)
+
+// 접속 중인 ID 하나 (roster[] 는 이름순 정렬)
+typedef struct {
+    char name[MAX_NAME];
+    int  conns;                   // 이 ID 로 로그인한 연결 수
+} RosterEntry;
+
+static RosterEntry   roster[ROSTER_MAX];
+static int           roster_count = 0;
+static unsigned long seq = 0;                  // 변경마다 1 증가
+static bool          subscribed[MAX_CLIENTS];  // client_sockets[] 인덱스
+
+
+/**
+ * name 이 들어갈 위치 (이진 탐색, *found 에 이미 있는지)
+ */
+static int roster_pos(const char *name, bool *found) {
+    int lo = 0, hi = roster_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int c = strcmp(roster[mid].name, name);
+        if (c == 0) {
+            *found = true;
+            return mid;
+        }
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *found = false;
+    return lo;
+}
+
+/**
+ * 구독자 전원에게 변경 하나 (프레임 하나를 공유)
+ */
+static void publish(char op, const char *name) {
+    seq++;
+
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_PRESENCE;
+    strcpy(msg.sender, "SERVER");
+    snprintf(msg.data, sizeof(msg.data), "%lu %c%s", seq, op, name);
+
+    OutFrame *f = NULL;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!subscribed[i] || client_sockets[i] <= 0) continue;
+        if (!f) f = frame_new(&msg);
+        queue_frame(i, f);
+    }
+    frame_release(f);
+}
+
+
+/**
+ * 로그인/세션 재개 (register_user 에서 호출) → 그 ID 의 첫 연결이면 "+이름"
+ */
+void presence_join(const char *name) {
+    if (name[0] == '\0') return;
+
+    bool found;
+    int pos = roster_pos(name, &found);
+    if (found) {
+        roster[pos].conns++;
+        return;
+    }
+    if (roster_count == ROSTER_MAX) {
+        server_log("presence: roster full, %s not listed", name);
+        return;
+    }
+
+    memmove(&roster[pos + 1], &roster[pos], sizeof(RosterEntry) * (roster_count - pos));
+    snprintf(roster[pos].name, sizeof(roster[pos].name), "%s", name);
+    roster[pos].conns = 1;
+    roster_count++;
+
+    publish('+', name);
+}
+
+/**
+ * 연결 종료 (unregister_user 에서 호출) → 그 ID 의 마지막 연결이면 "-이름"
+ */
+void presence_leave(const char *name) {
+    if (name[0] == '\0') return;
+
+    bool found;
+    int pos = roster_pos(name, &found);
+    if (!found || --roster[pos].conns > 0) return;
+
+    roster_count--;
+    memmove(&roster[pos], &roster[pos + 1], sizeof(RosterEntry) * (roster_count - pos));
+
+    publish('-', name);
+}
+
+/**
+ * 변경 이벤트 구독 켜기/끄기 (연결이 끊기면 자동으로 끔)
+ */
+void presence_subscribe(int idx, bool on) {
+    if (idx >= 0 && idx < MAX_CLIENTS) subscribed[idx] = on;
+}
+
+bool presence_subscribed(int idx) {
+    return idx >= 0 && idx < MAX_CLIENTS && subscribed[idx];
+}
+
+/**
+ * MSG_LIST_REQEUST(data = "[커서] [개수]") → 커서(이전 페이지의 마지막 이름) 다음부터 한 페이지
+ *  응답 첫 줄의 seq 이후 MSG_PRESENCE 만 반영하면 되고,
+ *  커서가 이름이라 페이지 사이에 목록이 바뀌어도 빠지거나 겹치는 이름이 없음
+ */
+void presence_send_page(int client_fd, const char *request) {
+    char after[MAX_NAME] = "";
+    int limit = PRESENCE_PAGE_MAX;
+    sscanf(request, "%19s %d", after, &limit);
+    if (strcmp(after, "-") == 0) after[0] = '\0';
+    if (limit <= 0 || limit > PRESENCE_PAGE_MAX) limit = PRESENCE_PAGE_MAX;
+
+    bool found;
+    int pos = after[0] ? roster_pos(after, &found) : 0;
+    if (after[0] && found) pos++;
+
+    // 헤더 자리를 남겨두고 이름부터 채움 (다음 커서는 다 채운 뒤에 앎)
+    char names[MAX_BUF];
+    size_t len = 0;
+    int n = 0;
+    while (pos + n < roster_count && n < limit) {
+        size_t l = strlen(roster[pos + n].name);
+        if (len + l + 1 > sizeof(names) - 48) break;
+        memcpy(names + len, roster[pos + n].name, l);
+        names[len + l] = '\n';
+        len += l + 1;
+        n++;
+    }
+    names[len] = '\0';
+
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_LIST_RESPONSE;
+    strcpy(msg.sender, "SERVER");
+    snprintf(msg.data, sizeof(msg.data), "%lu %d %s\n%s", seq, roster_count,
+             n > 0 && pos + n < roster_count ? roster[pos + n - 1].name : "-", names);
+
+    queue_message(client_fd, &msg);
+}
+
+/**
+ * /users 용 사람이 읽는 한 페이지 (after 다음 이름부터)
+ * 반환: 넣은 이름 수
+ */
+int presence_text_page(const char *after, char *buf, size_t bufsize) {
+    bool found = false;
+    int pos = after && after[0] ? roster_pos(after, &found) : 0;
+    if (found) pos++;
+
+    size_t len = (size_t)snprintf(buf, bufsize, "Online: %d\n", roster_count);
+    int n = 0;
+
+    // 다음 페이지 안내 한 줄 자리를 남겨둠
+    while (pos + n < roster_count && len + MAX_NAME + 48 < bufsize) {
+        int idx = find_user_index(roster[pos + n].name);
+        if (idx >= 0) {
+            len += snprintf(buf + len, bufsize - len, "- %s (socket %d)\n",
+                            roster[pos + n].name, client_sockets[idx]);
+        } else {
+            len += snprintf(buf + len, bufsize - len, "- %s (remote)\n", roster[pos + n].name);
+        }
+        n++;
+    }
+
+    if (n > 0 && pos + n < roster_count) {
+        snprintf(buf + len, bufsize - len, "... %d more: /users %s",
+                 roster_count - pos - n, roster[pos + n - 1].name);
+    } else if (roster_count == 0) {
+        snprintf(buf + len, bufsize - len, "(no users online)\n");
+    }
+    return n;
+}
@@ -0,0 +1,19 @@
+#ifndef SERVER_PRESENCE_H
+#define SERVER_PRESENCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// 접속자 목록 (이름순, 같은 ID 의 연결이 여러 개여도 한 줄) + 구독자에게 변경만 전송
+//  목록 한 페이지: MSG_LIST_RESPONSE "<seq> <전체 수> <다음 커서|->\n이름\n이름..."
+//  변경 이벤트:    MSG_PRESENCE "<seq> +이름" (접속) / "<seq> -이름" (종료)
+#define PRESENCE_PAGE_MAX  64      // 한 페이지 최대 이름 수 (Message.data 크기로도 잘림)
+
+void presence_join(const char *name);
+void presence_leave(const char *name);
+void presence_subscribe(int idx, bool on);
+bool presence_subscribed(int idx);
+void presence_send_page(int client_fd, const char *request);
+int  presence_text_page(const char *after, char *buf, size_t bufsize);
+
+#endif
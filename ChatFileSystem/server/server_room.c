@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include "protocol.h"
+#include "server_room.h"
+#include "server_conn.h"
+#include "server_session.h"
+
+extern int client_sockets[];
+extern void server_log(const char *fmt, ...);
+
+#define MEMBER_WORDS ((MAX_CLIENTS + 63) / 64)
+#define ROOM_BUCKETS 64           // 2의 거듭제곱
+
+// 방 하나 = 이름 + 멤버 비트맵 (client_sockets[] 인덱스 기준)
+typedef struct {
+    char     name[ROOM_NAME_LEN];
+    uint64_t members[MEMBER_WORDS];
+    int      member_count;
+    int      in_use;
+    int      next;                // 같은 버킷 체인 (-1 = 끝)
+} Room;
+
+static Room rooms[MAX_ROOMS];
+static int  bucket_head[ROOM_BUCKETS];
+static int  lobby_idx = -1;
+
+// 각 클라이언트가 채팅을 보낼 "현재 방" (-1 = 없음)
+static int current_room[MAX_CLIENTS];
+
+
+static unsigned int hash_name(const char *s) {
+    unsigned int h = 2166136261u;          // FNV-1a
+    while (*s) {
+        h ^= (unsigned char)*s++;
+        h *= 16777619u;
+    }
+    return h & (ROOM_BUCKETS - 1);
+}
+
+/**
+ * 방 이름 규칙: 영문/숫자/-/_ 만, ROOM_NAME_LEN 미만 (다른 서버가 보낸 이름도 같은 기준)
+ */
+bool room_name_valid(const char *name) {
+    size_t len = strlen(name);
+    if (len == 0 || len >= ROOM_NAME_LEN) return false;
+
+    for (size_t i = 0; i < len; i++) {
+        if (!isalnum((unsigned char)name[i]) && name[i] != '-' && name[i] != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int find_room(const char *name) {
+    for (int r = bucket_head[hash_name(name)]; r >= 0; r = rooms[r].next) {
+        if (strcmp(rooms[r].name, name) == 0) return r;
+    }
+    return -1;
+}
+
+static int create_room(const char *name) {
+    for (int r = 0; r < MAX_ROOMS; r++) {
+        if (!rooms[r].in_use) {
+            memset(&rooms[r], 0, sizeof(Room));
+            snprintf(rooms[r].name, sizeof(rooms[r].name), "%s", name);
+            rooms[r].in_use = 1;
+
+            unsigned int b = hash_name(name);
+            rooms[r].next = bucket_head[b];
+            bucket_head[b] = r;
+
+            server_log("Room created: #%s", name);
+            return r;
+        }
+    }
+    return -1;
+}
+
+static void destroy_room(int r) {
+    unsigned int b = hash_name(rooms[r].name);
+    int *link = &bucket_head[b];
+
+    while (*link >= 0) {
+        if (*link == r) {
+            *link = rooms[r].next;
+            break;
+        }
+        link = &rooms[*link].next;
+    }
+
+    server_log("Room removed: #%s", rooms[r].name);
+    rooms[r].in_use = 0;
+}
+
+static void remove_member(int r, int client_idx) {
+    uint64_t bit = 1ULL << (client_idx % 64);
+    uint64_t *word = &rooms[r].members[client_idx / 64];
+
+    if (!(*word & bit)) return;
+
+    *word &= ~bit;
+    rooms[r].member_count--;
+
+    // lobby 외의 빈 방은 정리
+    if (rooms[r].member_count == 0 && r != lobby_idx) {
+        destroy_room(r);
+    }
+}
+
+
+void room_init(void) {
+    for (int b = 0; b < ROOM_BUCKETS; b++) bucket_head[b] = -1;
+    for (int i = 0; i < MAX_CLIENTS; i++) current_room[i] = -1;
+
+    lobby_idx = create_room(DEFAULT_ROOM);
+}
+
+
+/**
+ * 방 입장 (없으면 생성) → 현재 방으로 설정
+ * 반환: 방 인덱스, -1 = 이름 오류, -2 = 방 개수 초과
+ */
+int room_join(int client_idx, const char *name) {
+    if (client_idx < 0 || client_idx >= MAX_CLIENTS) return -1;
+    if (!room_name_valid(name)) return -1;
+
+    int r = find_room(name);
+    if (r < 0) {
+        r = create_room(name);
+        if (r < 0) return -2;
+    }
+
+    uint64_t bit = 1ULL << (client_idx % 64);
+    if (!(rooms[r].members[client_idx / 64] & bit)) {
+        rooms[r].members[client_idx / 64] |= bit;
+        rooms[r].member_count++;
+    }
+
+    current_room[client_idx] = r;
+    return r;
+}
+
+
+/**
+ * 방 퇴장
+ * 반환: 0 = 성공, -1 = 멤버가 아님, -2 = lobby 는 나갈 수 없음
+ */
+int room_leave(int client_idx, const char *name) {
+    int r = find_room(name);
+    if (r < 0 || !room_is_member(r, client_idx)) return -1;
+    if (r == lobby_idx) return -2;
+
+    remove_member(r, client_idx);
+
+    if (current_room[client_idx] == r) {
+        current_room[client_idx] = lobby_idx;
+    }
+    return 0;
+}
+
+/**
+ * 접속 종료 시 모든 방에서 제거
+ */
+void room_leave_all(int client_idx) {
+    if (client_idx < 0 || client_idx >= MAX_CLIENTS) return;
+
+    for (int r = 0; r < MAX_ROOMS; r++) {
+        if (rooms[r].in_use) remove_member(r, client_idx);
+    }
+    current_room[client_idx] = -1;
+}
+
+/**
+ * 이름으로 방 찾기 (없으면 -1)
+ */
+int room_find(const char *name) {
+    return find_room(name);
+}
+
+int room_current(int client_idx) {
+    if (client_idx < 0 || client_idx >= MAX_CLIENTS) return -1;
+    return current_room[client_idx];
+}
+
+const char* room_name(int room_idx) {
+    if (room_idx < 0 || room_idx >= MAX_ROOMS || !rooms[room_idx].in_use) return NULL;
+    return rooms[room_idx].name;
+}
+
+bool room_is_member(int room_idx, int client_idx) {
+    if (room_idx < 0 || room_idx >= MAX_ROOMS || !rooms[room_idx].in_use) return false;
+    if (client_idx < 0 || client_idx >= MAX_CLIENTS) return false;
+    return (rooms[room_idx].members[client_idx / 64] >> (client_idx % 64)) & 1;
+}
+
+
+/**
+ *  방 멤버에게만 메시지 전송 (sender 제외)
+ *  비트맵을 따라가므로 비용은 전체 접속자 수가 아니라 멤버 수에 비례
+ */
+void room_broadcast(int room_idx, int sender_fd, Message *msg) {
+    if (room_idx < 0 || room_idx >= MAX_ROOMS || !rooms[room_idx].in_use) return;
+
+    // 프레임은 한 번만 만들고 멤버들의 송신 큐가 공유
+    OutFrame *f = frame_new(msg);
+
+    for (int w = 0; w < MEMBER_WORDS; w++) {
+        uint64_t bits = rooms[room_idx].members[w];
+
+        while (bits) {
+            int i = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            int sd = client_sockets[i];
+            if (sd <= 0 || sd == sender_fd) continue;
+
+            queue_frame(i, f);
+        }
+    }
+
+    // 연결이 끊겨 재접속 대기 중인 멤버 몫도 보관
+    session_capture(f, rooms[room_idx].name, NULL);
+    frame_release(f);
+}
+
+
+/**
+ *  /rooms 응답 문자열 생성 (* = 현재 방, + = 참여 중)
+ */
+void build_room_list(int client_idx, char *buf, size_t bufsize) {
+    size_t off = snprintf(buf, bufsize, "[Rooms]\n");
+
+    for (int r = 0; r < MAX_ROOMS && off < bufsize; r++) {
+        if (!rooms[r].in_use) continue;
+
+        char mark = ' ';
+        if (current_room[client_idx] == r) mark = '*';
+        else if (room_is_member(r, client_idx)) mark = '+';
+
+        int n = snprintf(buf + off, bufsize - off, "%c #%s (%d users)\n",
+                         mark, rooms[r].name, rooms[r].member_count);
+        if (n < 0) break;
+        off += n;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef SERVER_ROOM_H
+#define SERVER_ROOM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "protocol.h"
+
+#define MAX_ROOMS      32
+#define ROOM_NAME_LEN  32
+#define DEFAULT_ROOM   "lobby"
+
+void room_init(void);
+int  room_join(int client_idx, const char *name);
+int  room_leave(int client_idx, const char *name);
+void room_leave_all(int client_idx);
+int  room_current(int client_idx);
+int  room_find(const char *name);
+bool room_name_valid(const char *name);
+const char* room_name(int room_idx);
+bool room_is_member(int room_idx, int client_idx);
+void room_broadcast(int room_idx, int sender_fd, Message *msg);
+void build_room_list(int client_idx, char *buf, size_t bufsize);
+
+#endif
@@ -0,0 +1,335 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/random.h>
+#include "protocol.h"
+#include "server_session.h"
+#include "server_auth.h"
+#include "server_room.h"
+#include "server_bucket.h"
+
+extern int client_sockets[];
+extern char usernames[][MAX_NAME];
+extern void server_log(const char *fmt, ...);
+
+#define MAX_SESSIONS (MAX_CLIENTS * 2)    // 접속 중 + 재접속 대기
+
+enum { SESSION_FREE = 0, SESSION_ACTIVE, SESSION_PARKED };
+
+// 로그인 한 번 = 세션 하나 (연결이 끊겨도 grace 동안 유지)
+typedef struct {
+    int       state;
+    char      token[SESSION_TOKEN_LEN + 1];
+    char      username[MAX_NAME];
+    bool      root;                    // 끊길 때 root 였는지 (root 는 예약 상태)
+    char      room[ROOM_NAME_LEN];     // 끊길 때의 현재 방
+    double    expires_at;
+    OutFrame *backlog[SESSION_BACKLOG];   // 끊겨 있는 동안 온 메시지 (링 버퍼)
+    int       head;
+    int       count;
+    long      dropped;
+} Session;
+
+static Session sessions[MAX_SESSIONS];
+static int     slot_session[MAX_CLIENTS];     // client_sockets[] 인덱스 → 세션 (-1 = 없음)
+static bool    sessions_ready = false;
+
+
+static void init_sessions(void) {
+    if (sessions_ready) return;
+    for (int i = 0; i < MAX_CLIENTS; i++) slot_session[i] = -1;
+    sessions_ready = true;
+}
+
+static void gen_token(char *out) {
+    unsigned char raw[SESSION_TOKEN_LEN / 2];
+
+    if (getrandom(raw, sizeof(raw), 0) != (ssize_t)sizeof(raw)) {
+        int fd = open("/dev/urandom", O_RDONLY);
+        if (fd < 0 || read(fd, raw, sizeof(raw)) != (ssize_t)sizeof(raw)) {
+            server_log("session: no random source");
+        }
+        if (fd >= 0) close(fd);
+    }
+
+    for (size_t i = 0; i < sizeof(raw); i++) {
+        sprintf(out + i * 2, "%02x", raw[i]);
+    }
+    out[SESSION_TOKEN_LEN] = '\0';
+}
+
+// 토큰 비교는 길이/내용과 무관하게 같은 시간
+// (b 는 SESSION_TOKEN_LEN + 1 바이트 이상 읽을 수 있어야 함 → 메시지 data 버퍼)
+static bool token_equal(const char *a, const char *b) {
+    unsigned char diff = 0;
+    for (int i = 0; i < SESSION_TOKEN_LEN; i++)
+        diff |= (unsigned char)a[i] ^ (unsigned char)b[i];
+    diff |= (unsigned char)b[SESSION_TOKEN_LEN];     // 더 긴 토큰도 불일치
+    return diff == 0;
+}
+
+static void backlog_push(Session *s, OutFrame *f) {
+    // 채팅/귓속말만 보관 (파일 청크 등은 재전송 의미 없음)
+    if (f->msg.type != MSG_CHAT && f->msg.type != MSG_DIRECT) return;
+
+    if (s->count == SESSION_BACKLOG) {
+        frame_release(s->backlog[s->head]);
+        s->head = (s->head + 1) % SESSION_BACKLOG;
+        s->count--;
+        s->dropped++;
+    }
+
+    s->backlog[(s->head + s->count) % SESSION_BACKLOG] = f;
+    s->count++;
+    f->refs++;
+}
+
+static void free_session(Session *s) {
+    while (s->count > 0) {
+        frame_release(s->backlog[s->head]);
+        s->head = (s->head + 1) % SESSION_BACKLOG;
+        s->count--;
+    }
+    memset(s, 0, sizeof(*s));
+}
+
+static void backlog_cb(OutFrame *f, void *arg) {
+    backlog_push((Session *)arg, f);
+}
+
+/**
+ * 재접속 대기 세션 폐기 (예약해둔 root 는 다른 사용자에게)
+ */
+static void expire_session(Session *s, const char *why) {
+    server_log("session: %s (%s, %d queued, %ld dropped)",
+               why, s->username, s->count, s->dropped);
+    if (s->root) drop_root_reservation();
+    free_session(s);
+}
+
+
+/**
+ * 로그인 성공 시 새 세션 발급 (같은 사용자의 재접속 대기 세션은 폐기)
+ * token_out: SESSION_TOKEN_LEN + 1 바이트
+ */
+bool session_issue(int idx, const char *username, char *token_out) {
+    init_sessions();
+    session_close(idx);
+
+    Session *free_slot = NULL;
+    for (int k = 0; k < MAX_SESSIONS; k++) {
+        Session *s = &sessions[k];
+        if (s->state == SESSION_PARKED && strcmp(s->username, username) == 0) {
+            // 다시 로그인했으면 예약된 root 는 새 연결로
+            if (s->root) {
+                s->root = false;
+                restore_root(client_sockets[idx]);
+            }
+            expire_session(s, "replaced by new login");
+        }
+        if (s->state == SESSION_FREE && !free_slot) free_slot = s;
+    }
+
+    // 가득 찼으면 가장 먼저 만료될 대기 세션을 비움
+    if (!free_slot) {
+        for (int k = 0; k < MAX_SESSIONS; k++) {
+            Session *s = &sessions[k];
+            if (s->state == SESSION_PARKED &&
+                (!free_slot || s->expires_at < free_slot->expires_at)) {
+                free_slot = s;
+            }
+        }
+        if (!free_slot) return false;
+        expire_session(free_slot, "evicted");
+    }
+
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->state = SESSION_ACTIVE;
+    snprintf(free_slot->username, sizeof(free_slot->username), "%s", username);
+    gen_token(free_slot->token);
+    slot_session[idx] = (int)(free_slot - sessions);
+
+    memcpy(token_out, free_slot->token, SESSION_TOKEN_LEN + 1);
+    return true;
+}
+
+/**
+ * 무중단 재시작으로 넘겨받은 연결의 세션을 같은 토큰으로 복원
+ */
+void session_adopt(int idx, const char *username, const char *token) {
+    init_sessions();
+    session_close(idx);
+
+    for (int k = 0; k < MAX_SESSIONS; k++) {
+        Session *s = &sessions[k];
+        if (s->state != SESSION_FREE) continue;
+
+        s->state = SESSION_ACTIVE;
+        snprintf(s->username, sizeof(s->username), "%s", username);
+        snprintf(s->token, sizeof(s->token), "%s", token);
+        slot_session[idx] = k;
+        return;
+    }
+}
+
+/**
+ * 연결의 현재 세션 토큰 (없으면 NULL)
+ */
+const char* session_token(int idx) {
+    init_sessions();
+    int k = slot_session[idx];
+    return k < 0 ? NULL : sessions[k].token;
+}
+
+/**
+ * 비정상 종료 (recv/send 오류) 시: 세션을 재접속 대기로 돌리고
+ * 아직 못 보낸 채팅을 보관, root 는 grace 동안 예약
+ */
+void session_park(int idx) {
+    init_sessions();
+    int k = slot_session[idx];
+    if (k < 0) return;
+
+    Session *s = &sessions[k];
+    slot_session[idx] = -1;
+
+    s->state = SESSION_PARKED;
+    s->expires_at = now_seconds() + SESSION_GRACE_SEC;
+    s->root = release_root(client_sockets[idx], true);
+
+    const char *room = room_name(room_current(idx));
+    snprintf(s->room, sizeof(s->room), "%s", room ? room : DEFAULT_ROOM);
+
+    conn_foreach_pending(idx, backlog_cb, s);
+
+    server_log("session: %s parked for %d sec", s->username, SESSION_GRACE_SEC);
+}
+
+/**
+ * 정상 종료 (/exit, 강퇴) 시: 세션 폐기
+ */
+void session_close(int idx) {
+    init_sessions();
+    int k = slot_session[idx];
+    if (k < 0) return;
+
+    slot_session[idx] = -1;
+    free_session(&sessions[k]);
+}
+
+/**
+ * MSG_RESUME 처리: 토큰이 맞으면 이름/root/방을 되살리고 밀린 메시지 전송
+ * 반환: 성공 여부 (응답 LOGIN_OK 는 여기서 보냄)
+ */
+bool session_resume(int idx, const char *token) {
+    init_sessions();
+
+    // 이미 로그인한 연결은 재개 불가 (지금 세션을 버리고 남의 세션을 가져가지 않도록)
+    if (usernames[idx][0] != '\0') return false;
+
+    Session *s = NULL;
+    for (int k = 0; k < MAX_SESSIONS; k++) {
+        if (sessions[k].state == SESSION_PARKED && token_equal(sessions[k].token, token)) {
+            s = &sessions[k];
+            break;
+        }
+    }
+    if (!s) return false;
+
+    int fd = client_sockets[idx];
+
+    session_close(idx);
+    s->state = SESSION_ACTIVE;
+    gen_token(s->token);                 // 토큰은 한 번만 사용
+    slot_session[idx] = (int)(s - sessions);
+
+    register_user(fd, s->username);
+    if (s->root) restore_root(fd);
+    s->root = false;
+
+    room_join(idx, DEFAULT_ROOM);
+    if (strcmp(s->room, DEFAULT_ROOM) != 0) room_join(idx, s->room);
+
+    Message reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.type = MSG_LOGIN_OK;
+    strcpy(reply.sender, "SERVER");
+    snprintf(reply.data, sizeof(reply.data), "LOGIN_OK %s", s->token);
+    queue_message(fd, &reply);
+
+    if (s->dropped > 0) {
+        Message note;
+        memset(&note, 0, sizeof(note));
+        note.type = MSG_CHAT;
+        strcpy(note.sender, "SERVER");
+        snprintf(note.data, sizeof(note.data),
+                 "%ld older messages were dropped while you were away.", s->dropped);
+        queue_message(fd, &note);
+    }
+
+    server_log("session: %s resumed (socket %d, %d queued)", s->username, fd, s->count);
+
+    while (s->count > 0) {
+        OutFrame *f = s->backlog[s->head];
+        queue_frame(idx, f);
+        frame_release(f);
+        s->head = (s->head + 1) % SESSION_BACKLOG;
+        s->count--;
+    }
+    s->head = 0;
+    s->dropped = 0;
+    return true;
+}
+
+/**
+ * 보낼 프레임을 재접속 대기 세션에도 보관
+ *  username 지정: 그 사용자만 (귓속말)
+ *  room 지정: 그 방에 있던 세션만
+ *  둘 다 NULL: 전체
+ */
+void session_capture(OutFrame *f, const char *room, const char *username) {
+    for (int k = 0; k < MAX_SESSIONS; k++) {
+        Session *s = &sessions[k];
+        if (s->state != SESSION_PARKED) continue;
+        if (username && strcmp(s->username, username) != 0) continue;
+        if (room && strcmp(s->room, room) != 0) continue;
+
+        backlog_push(s, f);
+    }
+}
+
+bool session_is_parked(const char *username) {
+    for (int k = 0; k < MAX_SESSIONS; k++) {
+        if (sessions[k].state == SESSION_PARKED &&
+            strcmp(sessions[k].username, username) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * 메인 루프 매 턴: grace 가 지난 세션 폐기
+ * 반환: 다음 만료까지 ms, 대기 세션이 없으면 -1
+ */
+int session_tick(void) {
+    double now = now_seconds();
+    int wait_ms = -1;
+
+    for (int k = 0; k < MAX_SESSIONS; k++) {
+        Session *s = &sessions[k];
+        if (s->state != SESSION_PARKED) continue;
+
+        if (s->expires_at <= now) {
+            expire_session(s, "grace expired");
+            continue;
+        }
+
+        int ms = (int)((s->expires_at - now) * 1000) + 1;
+        if (wait_ms < 0 || ms < wait_ms) wait_ms = ms;
+    }
+
+    return wait_ms;
+}
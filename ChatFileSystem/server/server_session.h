@@ -0,0 +1,22 @@
+#ifndef SERVER_SESSION_H
+#define SERVER_SESSION_H
+
+#include <stdbool.h>
+#include "server_conn.h"
+
+// 연결이 끊긴 뒤 토큰으로 재접속할 수 있는 시간 (초)
+#define SESSION_GRACE_SEC  60
+// 끊겨 있는 동안 보관하는 메시지 수 (넘치면 오래된 것부터 버림)
+#define SESSION_BACKLOG    256
+
+bool session_issue(int idx, const char *username, char *token_out);
+void session_adopt(int idx, const char *username, const char *token);
+const char* session_token(int idx);
+void session_park(int idx);
+void session_close(int idx);
+bool session_resume(int idx, const char *token);
+void session_capture(OutFrame *f, const char *room, const char *username);
+bool session_is_parked(const char *username);
+int  session_tick(void);
+
+#endif
@@ -0,0 +1,322 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "protocol.h"
+#include "server_trace.h"
+
+extern void server_log(const char *fmt, ...);
+
+// 링에 남기는 이벤트 하나 (32 바이트)
+typedef struct {
+    uint64_t ts;           // CLOCK_MONOTONIC ns
+    uint8_t  phase;        // 'B' 'E' (동기), 'b' 'e' (비동기)
+    uint8_t  ev;
+    int32_t  conn;
+    uint32_t xfer;
+    uint32_t id;
+    int32_t  arg;
+} TraceEvent;
+
+// 스레드 하나의 링 (쓰는 건 주인 스레드뿐, 덤프는 head 만 보고 복사)
+typedef struct {
+    bool       used;
+    bool       live;           // 주인 스레드가 살아 있음
+    char       name[32];
+    uint64_t   head;           // 지금까지 기록한 이벤트 수
+    TraceEvent *ev;
+} TraceRing;
+
+static const char *event_names[TR_EVENT_COUNT] = {
+    "select wait", "accept", "dispatch", "login verify",
+    "disk read", "disk write", "socket send", "server_log", "log fopen"
+};
+
+static TraceRing       rings[TRACE_MAX_THREADS];
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   ring_key;
+static pthread_once_t  key_once = PTHREAD_ONCE_INIT;
+
+static __thread TraceRing *my_ring = NULL;
+static __thread bool       my_ring_failed = false;
+
+static bool     enabled = true;
+static unsigned next_id = 0;
+static uint64_t start_ns = 0;
+
+static volatile sig_atomic_t dump_requested = 0;
+static int      dump_seq = 0;          // 같은 초에 여러 번 덤프해도 파일이 겹치지 않게
+
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 스레드가 끝나면 링은 그대로 두고 (덤프 가능) 다음 스레드가 재사용
+static void ring_retire(void *p) {
+    TraceRing *r = p;
+    pthread_mutex_lock(&ring_mutex);
+    r->live = false;
+    pthread_mutex_unlock(&ring_mutex);
+}
+
+static void make_key(void) {
+    pthread_key_create(&ring_key, ring_retire);
+    start_ns = now_ns();
+}
+
+/**
+ * 이 스레드의 링 (처음 기록할 때 할당, 모자라면 추적하지 않음)
+ */
+static TraceRing* ring_get(void) {
+    if (my_ring) return my_ring;
+    if (my_ring_failed) return NULL;
+
+    pthread_once(&key_once, make_key);
+    pthread_mutex_lock(&ring_mutex);
+
+    TraceRing *r = NULL;
+    for (int i = 0; i < TRACE_MAX_THREADS && !r; i++) {
+        if (!rings[i].used) r = &rings[i];
+    }
+    for (int i = 0; i < TRACE_MAX_THREADS && !r; i++) {
+        if (!rings[i].live) r = &rings[i];
+    }
+
+    if (r && !r->ev) {
+        r->ev = calloc(TRACE_RING_EVENTS, sizeof(TraceEvent));
+        if (!r->ev) r = NULL;
+    }
+
+    if (r) {
+        r->used = true;
+        r->live = true;
+        snprintf(r->name, sizeof(r->name), "thread %d", (int)(r - rings));
+        __atomic_store_n(&r->head, 0, __ATOMIC_RELEASE);
+        pthread_setspecific(ring_key, r);
+    }
+
+    pthread_mutex_unlock(&ring_mutex);
+
+    my_ring = r;
+    my_ring_failed = (r == NULL);
+    return r;
+}
+
+static void record(char phase, int ev, unsigned id, int conn, unsigned xfer, int arg) {
+    if (!enabled) return;
+
+    TraceRing *r = ring_get();
+    if (!r) return;
+
+    uint64_t h = r->head;
+    TraceEvent *e = &r->ev[h & (TRACE_RING_EVENTS - 1)];
+    e->ts = now_ns();
+    e->phase = (uint8_t)phase;
+    e->ev = (uint8_t)ev;
+    e->conn = conn;
+    e->xfer = xfer;
+    e->id = id;
+    e->arg = arg;
+    __atomic_store_n(&r->head, h + 1, __ATOMIC_RELEASE);
+}
+
+
+void trace_set_enabled(bool on) {
+    enabled = on;
+}
+
+bool trace_enabled(void) {
+    return enabled;
+}
+
+void trace_thread_name(const char *name) {
+    TraceRing *r = ring_get();
+    if (!r) return;
+
+    pthread_mutex_lock(&ring_mutex);
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    pthread_mutex_unlock(&ring_mutex);
+}
+
+void trace_begin(int ev, int conn, unsigned xfer, int arg) {
+    record('B', ev, 0, conn, xfer, arg);
+}
+
+void trace_end(int ev, int conn, unsigned xfer, int arg) {
+    record('E', ev, 0, conn, xfer, arg);
+}
+
+unsigned trace_next_id(void) {
+    return __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+}
+
+void trace_async_begin(int ev, unsigned id, int conn, unsigned xfer) {
+    record('b', ev, id, conn, xfer, 0);
+}
+
+void trace_async_end(int ev, unsigned id, int conn, unsigned xfer, int res) {
+    record('e', ev, id, conn, xfer, res);
+}
+
+
+/* ===================== 덤프 ===================== */
+
+static const char* msg_type_name(int type) {
+    switch (type) {
+        case MSG_LOGIN:             return "LOGIN";
+        case MSG_RESUME:            return "RESUME";
+        case MSG_CHAT:              return "CHAT";
+        case MSG_DIRECT:            return "DIRECT";
+        case MSG_FILE_UPLOAD:       return "FILE_UPLOAD";
+        case MSG_FILE_DOWNLOAD:     return "FILE_DOWNLOAD";
+        case MSG_FILE_DATA:         return "FILE_DATA";
+        case MSG_FILE_END:          return "FILE_END";
+        case MSG_FILE_SIG_REQUEST:  return "FILE_SIG";
+        case MSG_FILE_COPY:         return "FILE_COPY";
+        case MSG_FILE_LIST_REQUEST: return "FILE_LIST";
+        case MSG_LIST_REQEUST:      return "USER_LIST";
+        case MSG_PRESENCE_SUB:      return "PRESENCE_SUB";
+        case MSG_PONG:              return "PONG";
+        case MSG_EXIT:              return "EXIT";
+        default:                    return "OTHER";
+    }
+}
+
+static void write_event(FILE *fp, int tid, const TraceEvent *e, bool *first) {
+    if (e->ev >= TR_EVENT_COUNT) return;      // 덮어쓰는 중에 읽힌 칸
+
+    const char *name = event_names[e->ev];
+    char buf[48];
+    if (e->ev == TR_DISPATCH) {
+        snprintf(buf, sizeof(buf), "dispatch %s", msg_type_name(e->arg));
+        name = buf;
+    }
+
+    double ts = (e->ts >= start_ns ? e->ts - start_ns : 0) / 1000.0;
+
+    fprintf(fp, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,"
+                "\"pid\":1,\"tid\":%d",
+            *first ? "" : ",", name, event_names[e->ev], e->phase, ts, tid);
+    if (e->phase == 'b' || e->phase == 'e') fprintf(fp, ",\"id\":%u", e->id);
+    fprintf(fp, ",\"args\":{\"conn\":%d,\"xfer\":%u", e->conn, e->xfer);
+    if (e->phase == 'e' || (e->phase == 'E' && e->ev != TR_DISPATCH)) {
+        fprintf(fp, ",\"res\":%d", e->arg);
+    }
+    fprintf(fp, "}}");
+    *first = false;
+}
+
+/**
+ * 모든 링을 Chrome trace JSON 으로 기록 (메인 루프에서 호출)
+ *  - 다른 스레드는 그동안에도 계속 기록 → 복사 후 head 를 다시 보고 덮어쓴 칸은 버림
+ * 반환: 기록한 이벤트 수, 실패하면 -1
+ */
+int trace_dump(char *path, size_t pathsize) {
+    char tmp[256];
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+
+    mkdir(TRACE_DIR, 0755);
+    snprintf(path, pathsize, "%strace_%04d%02d%02d-%02d%02d%02d-%d.json", TRACE_DIR,
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+             tm.tm_hour, tm.tm_min, tm.tm_sec, ++dump_seq);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *fp = fopen(tmp, "w");
+    if (!fp) return -1;
+
+    TraceEvent *copy = malloc(sizeof(TraceEvent) * TRACE_RING_EVENTS);
+    if (!copy) {
+        fclose(fp);
+        unlink(tmp);
+        return -1;
+    }
+
+    pthread_once(&key_once, make_key);
+
+    int total = 0;
+    bool first = true;
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    for (int t = 0; t < TRACE_MAX_THREADS; t++) {
+        pthread_mutex_lock(&ring_mutex);
+        TraceRing *r = &rings[t];
+        bool used = r->used;
+        char name[32];
+        snprintf(name, sizeof(name), "%s", r->name);
+        pthread_mutex_unlock(&ring_mutex);
+        if (!used) continue;
+
+        fprintf(fp, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                    "\"args\":{\"name\":\"%s\"}}", first ? "" : ",", t, name);
+        first = false;
+
+        uint64_t end = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t begin = end > TRACE_RING_EVENTS ? end - TRACE_RING_EVENTS : 0;
+        for (uint64_t k = begin; k < end; k++) {
+            copy[k - begin] = r->ev[k & (TRACE_RING_EVENTS - 1)];
+        }
+
+        // 복사하는 동안 주인 스레드가 덮어쓴 앞부분은 버림
+        uint64_t after = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t valid = after > TRACE_RING_EVENTS ? after - TRACE_RING_EVENTS : 0;
+        if (after < end) valid = end;             // 그 사이 다른 스레드가 링을 재사용
+
+        for (uint64_t k = begin; k < end; k++) {
+            if (k < valid) continue;
+            write_event(fp, t, &copy[k - begin], &first);
+            total++;
+        }
+    }
+
+    fprintf(fp, "\n]}\n");
+    free(copy);
+
+    bool ok = fclose(fp) == 0;
+    if (!ok || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return total;
+}
+
+
+static void on_sigusr1(int signo) {
+    (void)signo;
+    dump_requested = 1;
+}
+
+void trace_install_signal(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigusr1;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+/**
+ * 메인 루프 매 턴: SIGUSR1 이 왔으면 덤프 (파일 쓰기는 시그널 핸들러 밖에서)
+ */
+void trace_poll(void) {
+    if (!dump_requested) return;
+    dump_requested = 0;
+
+    char path[256];
+    int n = trace_dump(path, sizeof(path));
+    if (n < 0) {
+        server_log("trace dump failed");
+    } else {
+        printf("[SERVER] trace: %d events → %s\n", n, path);
+        server_log("trace dump: %d events -> %s", n, path);
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef SERVER_TRACE_H
+#define SERVER_TRACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// 요청 처리 구간 추적: 스레드마다 바이너리 링에 begin/end 기록
+//  → SIGUSR1 또는 root 의 /trace 로 Chrome trace JSON 덤프 (chrome://tracing, Perfetto)
+#define TRACE_RING_EVENTS   16384     // 스레드당 최근 이벤트 수 (2의 거듭제곱)
+#define TRACE_MAX_THREADS   16        // 링 수 (끝난 스레드의 링은 재사용)
+#define TRACE_DIR           "./server/"
+
+// 이벤트 종류 (conn = 소켓 fd, xfer = 파일 전송 ID, 0 이면 없음)
+enum {
+    TR_SELECT,          // 메인 루프 select 대기
+    TR_ACCEPT,          // 새 연결 accept + 슬롯 등록
+    TR_DISPATCH,        // 메시지 하나 처리 (arg = 메시지 타입)
+    TR_LOGIN,           // 비밀번호 해시 검증 (작업 스레드)
+    TR_DISK_READ,       // 다운로드 파일 읽기 (비동기, arg = 결과)
+    TR_DISK_WRITE,      // 업로드 파일 쓰기 (비동기, arg = 결과)
+    TR_SOCK_SEND,       // 송신 큐 sendmsg (비동기, arg = 결과)
+    TR_LOG,             // server_log (잠금 대기 포함)
+    TR_LOG_OPEN,        // server_log 의 로그 파일 fopen
+    TR_EVENT_COUNT
+};
+
+void     trace_set_enabled(bool on);
+bool     trace_enabled(void);
+void     trace_thread_name(const char *name);
+
+// 같은 스레드 안에서 중첩되는 구간
+void     trace_begin(int ev, int conn, unsigned xfer, int arg);
+void     trace_end(int ev, int conn, unsigned xfer, int arg);
+
+// 제출과 완료가 따로인 비동기 I/O (id 로 짝을 맞춤)
+unsigned trace_next_id(void);
+void     trace_async_begin(int ev, unsigned id, int conn, unsigned xfer);
+void     trace_async_end(int ev, unsigned id, int conn, unsigned xfer, int res);
+
+void     trace_install_signal(void);
+void     trace_poll(void);
+int      trace_dump(char *path, size_t pathsize);
+
+#endif
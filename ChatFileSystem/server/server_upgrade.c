@@ -0,0 +1,417 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.h"
+#include "server_upgrade.h"
+#include "server_auth.h"
+#include "server_room.h"
+#include "server_conn.h"
+#include "server_session.h"
+#include "server_bucket.h"
+#include "server_presence.h"
+#include "server_admit.h"
+#include "server_peer.h"
+
+extern int client_sockets[];
+extern void server_log(const char *fmt, ...);
+extern void broadcast(int sender_fd, Message *msg, int max_clients);
+extern void disconnect_client(int idx);
+extern void abort_file_transfer(int idx);
+extern bool file_transfer_idle(void);
+extern bool file_transfer_active(int idx);
+extern int  login_in_flight(void);
+
+#define MAX_CLIENTS 10
+
+/*
+ * 무중단 재시작 (기존 서버 → 새 서버, UNIX SEQPACKET 소켓 + SCM_RIGHTS)
+ *
+ *  1. 새 서버(-u)가 UPGRADE_SOCK_PATH 로 접속 → 기존 서버는 drain 시작
+ *     (새 업로드/다운로드는 SERVER_UPGRADING 으로 거절, 채팅/접속은 계속 처리)
+ *  2. 진행 중인 전송과 송신 큐가 다 비면 수신을 멈추고 (io_uring recv 는 취소)
+ *  3. 리스닝 소켓(TCP, 로컬) → 접속자 fd + 세션 상태 → 끝 표시 순으로 넘기고 종료
+ *  4. 새 서버는 넘겨받은 소켓으로 bind 없이 바로 accept/수신 시작
+ */
+
+enum { HANDOFF_LISTEN = 1, HANDOFF_CLIENT, HANDOFF_DONE, HANDOFF_LOCAL, HANDOFF_PEER };
+
+// 넘기는 레코드 하나 (fd 는 SCM_RIGHTS 로 같이 전달)
+typedef struct {
+    int  kind;
+    char username[MAX_NAME];        // 로그인 전이면 빈 문자열
+    char token[SESSION_TOKEN_LEN + 1];
+    char room[ROOM_NAME_LEN];
+    int  root;
+    int  presence;                  // 접속/종료 알림 구독 중
+    int  inbuf_len;                 // 아직 다 안 모인 수신 프레임 조각
+    char inbuf[sizeof(Message)];
+} HandoffRecord;
+
+// 기존 서버 상태
+static int    ctl_listen_fd = -1;   // 새 서버의 접속을 기다림
+static int    ctl_fd = -1;          // 접속한 새 서버 (drain 중)
+static double drain_started = 0;
+static bool   quiescing = false;    // 수신을 멈추고 인계 직전
+
+// 새 서버가 받아둔 접속자 (upgrade_adopt 에서 슬롯에 등록)
+static HandoffRecord adopted[MAX_CLIENTS];
+static int           adopted_fd[MAX_CLIENTS];
+static int           adopted_count = 0;
+
+
+static void notify_all(const char *text) {
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = MSG_CHAT;
+    strcpy(msg.sender, "SERVER");
+    snprintf(msg.data, sizeof(msg.data), "%s", text);
+    broadcast(-1, &msg, MAX_CLIENTS);
+}
+
+static int send_record(const HandoffRecord *rec, int fd) {
+    struct iovec iov = { (void *)rec, sizeof(*rec) };
+    char ctrl[CMSG_SPACE(sizeof(int))];
+    struct msghdr mh;
+
+    memset(&mh, 0, sizeof(mh));
+    memset(ctrl, 0, sizeof(ctrl));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+
+    if (fd >= 0) {
+        mh.msg_control = ctrl;
+        mh.msg_controllen = sizeof(ctrl);
+
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cm), &fd, sizeof(int));
+    }
+
+    return sendmsg(ctl_fd, &mh, MSG_NOSIGNAL) == (ssize_t)sizeof(*rec) ? 0 : -1;
+}
+
+static int recv_record(int sock, HandoffRecord *rec, int *fd_out) {
+    struct iovec iov = { rec, sizeof(*rec) };
+    char ctrl[CMSG_SPACE(sizeof(int))];
+    struct msghdr mh;
+
+    memset(&mh, 0, sizeof(mh));
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    mh.msg_control = ctrl;
+    mh.msg_controllen = sizeof(ctrl);
+
+    *fd_out = -1;
+    ssize_t n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+    if (n != (ssize_t)sizeof(*rec)) return -1;
+
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&mh);
+    if (cm && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+        memcpy(fd_out, CMSG_DATA(cm), sizeof(int));
+    }
+    return 0;
+}
+
+static void cancel_upgrade(const char *why) {
+    server_log("upgrade: cancelled (%s)", why);
+    printf("[SERVER] 업그레이드 취소: %s\n", why);
+    close(ctl_fd);
+    ctl_fd = -1;
+    quiescing = false;
+    notify_all("Server upgrade cancelled.");
+}
+
+/**
+ * 리스닝 소켓과 접속자를 모두 넘기고 종료
+ * (close 는 이 프로세스의 참조만 없앰, shutdown 은 하지 않음)
+ */
+static void hand_off(int server_fd) {
+    HandoffRecord rec;
+    int count = 0;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.kind = HANDOFF_LISTEN;
+    if (send_record(&rec, server_fd) < 0) {
+        cancel_upgrade("new server went away");
+        return;
+    }
+
+    // 로컬(UNIX) 리스너도 같은 소켓 파일 그대로 (새 서버는 unlink/bind 하지 않음)
+    if (admit_local_fd() >= 0) {
+        rec.kind = HANDOFF_LOCAL;
+        send_record(&rec, admit_local_fd());
+    }
+
+    // 서버 간 링크 리스너도 넘김 (링크 자체는 끊고, 새 서버가 새 ID 로 다시 맞춤)
+    if (peer_listen_fd() >= 0) {
+        rec.kind = HANDOFF_PEER;
+        send_record(&rec, peer_listen_fd());
+    }
+
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        int sd = client_sockets[i];
+        if (sd <= 0) continue;
+
+        memset(&rec, 0, sizeof(rec));
+        rec.kind = HANDOFF_CLIENT;
+
+        const char *name = get_username(sd);
+        if (name && name[0] != '\0') {
+            const char *token = session_token(i);
+            const char *room = room_name(room_current(i));
+
+            snprintf(rec.username, sizeof(rec.username), "%s", name);
+            snprintf(rec.token, sizeof(rec.token), "%s", token ? token : "");
+            snprintf(rec.room, sizeof(rec.room), "%s", room ? room : DEFAULT_ROOM);
+            rec.root = is_root(sd);
+            rec.presence = presence_subscribed(i);
+        }
+        rec.inbuf_len = (int)conn_save_inbuf(i, rec.inbuf);
+
+        if (send_record(&rec, sd) < 0) {
+            server_log("upgrade: handoff failed for socket %d (errno=%d)", sd, errno);
+            continue;
+        }
+        count++;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.kind = HANDOFF_DONE;
+    send_record(&rec, -1);
+
+    peer_shutdown();
+
+    printf("[SERVER] 새 서버로 인계 완료 (접속자 %d명), 종료합니다.\n", count);
+    server_log("upgrade: handed off listener + %d clients", count);
+    exit(0);
+}
+
+
+/* ===================== 기존 서버 ===================== */
+
+/**
+ * 업그레이드 제어 소켓 열기 (시작 시 한 번)
+ */
+int upgrade_listen(void) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", UPGRADE_SOCK_PATH);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+
+    // 포트 bind 에 성공한(=혼자 도는) 서버만 여기까지 오므로 남은 파일은 지워도 됨
+    unlink(UPGRADE_SOCK_PATH);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1) < 0) {
+        server_log("upgrade: control socket unavailable (errno=%d)", errno);
+        close(fd);
+        return -1;
+    }
+
+    ctl_listen_fd = fd;
+    return 0;
+}
+
+/**
+ * select 로 감시할 fd (평소: 제어 소켓, drain 중: 새 서버 연결 → 끊기면 취소)
+ */
+int upgrade_watch_fd(void) {
+    return ctl_fd >= 0 ? ctl_fd : ctl_listen_fd;
+}
+
+void upgrade_on_readable(void) {
+    if (ctl_fd >= 0) {
+        // drain 중에 새 서버가 보낼 것은 없음 → 읽히면 종료된 것
+        char junk;
+        if (recv(ctl_fd, &junk, 1, MSG_DONTWAIT) <= 0) cancel_upgrade("new server went away");
+        return;
+    }
+
+    int fd = accept4(ctl_listen_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) return;
+
+    ctl_fd = fd;
+    drain_started = now_seconds();
+    quiescing = false;
+
+    printf("[SERVER] 업그레이드 요청: 진행 중인 전송을 마치는 대로 새 서버로 인계\n");
+    server_log("upgrade: requested, draining transfers");
+    notify_all("Server upgrade in progress. New file transfers are paused for a moment.");
+}
+
+bool upgrade_draining(void) {
+    return ctl_fd >= 0;
+}
+
+bool upgrade_quiescing(void) {
+    return quiescing;
+}
+
+/**
+ * 메인 루프 매 턴 (송신/전송 처리 전)
+ *  - 전송이 다 끝나면 수신을 멈추고, 걸린 recv 와 송신 큐가 비면 인계 (반환 안 함)
+ *  - drain 시간이 지나면 남은 전송은 중단
+ * 반환: 다음 확인까지 ms, drain 중이 아니면 -1
+ */
+long upgrade_tick(int server_fd) {
+    if (ctl_fd < 0) return -1;
+
+    double waited = now_seconds() - drain_started;
+
+    if (waited >= UPGRADE_DRAIN_SEC && !file_transfer_idle()) {
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (client_sockets[i] > 0 && file_transfer_active(i)) {
+                Message err;
+                memset(&err, 0, sizeof(err));
+                err.type = MSG_ERROR;
+                strcpy(err.sender, "SERVER");
+                strcpy(err.data, "SERVER_UPGRADING");
+                queue_message(client_sockets[i], &err);
+            }
+            abort_file_transfer(i);
+        }
+        server_log("upgrade: drain timeout, aborted remaining transfers");
+    }
+
+    if (!file_transfer_idle()) return 100;
+
+    if (!quiescing) {
+        quiescing = true;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            if (client_sockets[i] > 0) conn_cancel_read(i);
+        }
+    }
+
+    // 검증 중인 로그인 응답까지 보낸 뒤 인계
+    bool ready = login_in_flight() == 0;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (client_sockets[i] <= 0) continue;
+
+        if (conn_recv_busy(i)) {
+            ready = false;
+        } else if (!conn_idle(i)) {
+            // 받는 쪽이 안 읽어서 큐가 안 빠지면 끝내 기다리지 않음
+            if (waited >= UPGRADE_DRAIN_SEC + UPGRADE_FLUSH_SEC) {
+                server_log("upgrade: dropping stalled socket %d", client_sockets[i]);
+                disconnect_client(i);
+            } else {
+                ready = false;
+            }
+        }
+    }
+
+    if (ready) hand_off(server_fd);
+    return 10;
+}
+
+/**
+ * SIGINT 종료 시 제어 소켓 파일 정리
+ */
+void upgrade_cleanup(void) {
+    if (ctl_listen_fd >= 0) unlink(UPGRADE_SOCK_PATH);
+}
+
+
+/* ===================== 새 서버 ===================== */
+
+/**
+ * 실행 중인 서버에 업그레이드 요청 → 인계가 끝날 때까지 대기
+ * 반환: 넘겨받은 리스닝 소켓, 실패하면 -1
+ *  (로컬 리스너는 *local_fd, 서버 간 링크 리스너는 *peer_fd, 없으면 -1)
+ */
+int upgrade_receive(int *local_fd, int *peer_fd) {
+    *local_fd = -1;
+    *peer_fd = -1;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", UPGRADE_SOCK_PATH);
+
+    int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("upgrade connect failed");
+        close(sock);
+        return -1;
+    }
+
+    printf("[SERVER] 기존 서버에 업그레이드 요청, 진행 중인 전송이 끝나길 기다리는 중...\n");
+
+    int listen_fd = -1;
+    HandoffRecord rec;
+    int fd;
+
+    while (recv_record(sock, &rec, &fd) == 0) {
+        if (rec.kind == HANDOFF_DONE) break;
+
+        if (rec.kind == HANDOFF_LISTEN && fd >= 0) {
+            listen_fd = fd;
+        } else if (rec.kind == HANDOFF_LOCAL && fd >= 0) {
+            *local_fd = fd;
+        } else if (rec.kind == HANDOFF_PEER && fd >= 0) {
+            *peer_fd = fd;
+        } else if (rec.kind == HANDOFF_CLIENT && fd >= 0 && adopted_count < MAX_CLIENTS) {
+            adopted[adopted_count] = rec;
+            adopted_fd[adopted_count] = fd;
+            adopted_count++;
+        } else if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    close(sock);
+    return listen_fd;
+}
+
+/**
+ * 넘겨받은 접속자를 슬롯에 등록하고 이름/root/방/세션 토큰 복원
+ * (I/O 엔진과 방 초기화 뒤에 호출)
+ * 반환: 등록한 접속자 수
+ */
+int upgrade_adopt(void) {
+    int count = 0;
+
+    for (int k = 0; k < adopted_count; k++) {
+        HandoffRecord *rec = &adopted[k];
+        int fd = adopted_fd[k];
+
+        int i = 0;
+        while (i < MAX_CLIENTS && client_sockets[i] != 0) i++;
+        if (i == MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+
+        client_sockets[i] = fd;
+        set_client_index(fd, i);
+        conn_open(i);
+        conn_restore_inbuf(i, rec->inbuf, rec->inbuf_len);
+
+        if (rec->username[0] != '\0') {
+            register_user(fd, rec->username);
+            if (rec->token[0] != '\0') session_adopt(i, rec->username, rec->token);
+            if (rec->root) assign_root_if_first(fd);
+            presence_subscribe(i, rec->presence);
+
+            room_join(i, DEFAULT_ROOM);
+            if (strcmp(rec->room, DEFAULT_ROOM) != 0) room_join(i, rec->room);
+        }
+        count++;
+    }
+
+    adopted_count = 0;
+    if (count > 0) notify_all("Server upgraded.");
+    server_log("upgrade: adopted %d clients", count);
+    return count;
+}
@@ -0,0 +1,26 @@
+#ifndef SERVER_UPGRADE_H
+#define SERVER_UPGRADE_H
+
+#include <stdbool.h>
+
+// 새 바이너리(-u)가 접속해서 리스닝 소켓/접속자를 넘겨받는 UNIX 소켓
+#define UPGRADE_SOCK_PATH   "./server/upgrade.sock"
+// 진행 중인 업로드/다운로드를 기다리는 최대 시간 (지나면 중단하고 인계)
+#define UPGRADE_DRAIN_SEC   30
+// 그 뒤에도 송신 큐가 안 빠지는 연결은 이만큼 더 기다리고 끊음
+#define UPGRADE_FLUSH_SEC   5
+
+// 기존 서버 쪽
+int  upgrade_listen(void);
+int  upgrade_watch_fd(void);
+void upgrade_on_readable(void);
+bool upgrade_draining(void);
+bool upgrade_quiescing(void);
+long upgrade_tick(int server_fd);
+void upgrade_cleanup(void);
+
+// 새 서버 쪽
+int  upgrade_receive(int *local_fd, int *peer_fd);
+int  upgrade_adopt(void);
+
+#endif
@@ -1,7 +1,18 @@
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include "protocol.h"
+#include "server_room.h"
+#include "server_conn.h"
+#include "server_io.h"
+#include "server_session.h"
+#include "server_presence.h"
+
+extern void set_client_index(int socket_fd, int idx);
+extern void unregister_user(int idx);
+extern void abort_file_transfer(int idx);
+extern bool release_root(int socket_fd, bool reserve);
 
 extern int client_sockets[];
 extern char usernames[][MAX_NAME];   // server_auth.c에서 선언된 username 테이블
@@ -9,57 +20,46 @@ extern void server_log(const char *fmt, ...);
 
 #define MAX_CLIENTS 10
 
-int wb;
 /**
- *  접속자 목록 문자열을 생성 (username 기반)
- *  결과를 buf에 저장
+ *  특정 클라이언트에게 접속자 목록 한 페이지 전송 (/users [이전 페이지 마지막 이름])
+ *  이름순 목록에서 after 다음부터 한 메시지에 들어가는 만큼 (넘치면 다음 페이지 안내)
  */
-void build_user_list(char *buf, size_t bufsize) {
-    buf[0] = '\0';  // 초기화
-
-    char temp[128];
-
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (client_sockets[i] > 0 && usernames[i][0] != '\0') {
-            snprintf(temp, sizeof(temp), "- %s (socket %d)\n",
-                     usernames[i], client_sockets[i]);
-            strncat(buf, temp, bufsize - strlen(buf) - 1);
-        }
-    }
-
-    if (strlen(buf) == 0)
-        strcpy(buf, "(no users online)\n");
-}
-
-
-/**
- *  특정 클라이언트에게 접속자 목록 전송
- */
-void send_user_list(int client_fd) {
-    char list_buf[1024];
-    build_user_list(list_buf, sizeof(list_buf));
-
+void send_user_list(int client_fd, const char *after) {
     Message msg;
     memset(&msg, 0, sizeof(msg));
 
     msg.type = MSG_CHAT;
     strcpy(msg.sender, "SERVER");
-    snprintf(msg.data, MAX_BUF, "%s", list_buf);
+    presence_text_page(after, msg.data, sizeof(msg.data));
 
-
-    wb = write(client_fd, &msg, sizeof(msg));
-
-    if(wb < 0){
-        perror("write");
-    }
+    queue_message(client_fd, &msg);
     server_log("접속자 목록 전송 (to socket %d)", client_fd);
 }
 
 void disconnect_client(int idx) {
     if (client_sockets[idx] > 0) {
+        release_root(client_sockets[idx], false);   // root 면 다음 접속자에게
+        session_close(idx);        // 재접속 대기로 돌린 세션이 아니면 폐기
+        conn_flush(idx);           // 남은 안내 메시지(강퇴 등) 최대한 전송
+        io_submit();
+        conn_reset(idx);
+        shutdown(client_sockets[idx], SHUT_RDWR);   // 걸려 있는 io_uring recv 깨우기
         close(client_sockets[idx]);
+        set_client_index(client_sockets[idx], -1);
         client_sockets[idx] = 0;
-        usernames[idx][0] = '\0';  // 이름 초기화
+        unregister_user(idx);      // 이름/이름 해시 초기화
+        room_leave_all(idx);       // 참여 중인 방에서 제거
+        abort_file_transfer(idx);  // 진행 중인 업로드 폐기
         printf("[SERVER] Client %d disconnected\n", idx);
     }
-}
\ No newline at end of file
+}
+
+/**
+ * 비정상 종료 (연결 끊김/송신 오류): 토큰으로 재접속할 수 있게 세션을 남겨둠
+ */
+void drop_client(int idx) {
+    if (client_sockets[idx] > 0) {
+        session_park(idx);
+        disconnect_client(idx);
+    }
+}
@@ -1,8 +1,9 @@
 #ifndef SERVER_USER_LIST_H
 #define SERVER_USER_LIST_H
 
-void send_user_list(int client_fd);
+void send_user_list(int client_fd, const char *after);
 void register_user(int client_fd, const char *username);
 void disconnect_client(int idx);
+void drop_client(int idx);
 
 #endif